@@ -0,0 +1,81 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_INPROC_HPP
+#define XPYT_INPROC_HPP
+
+#include <memory>
+#include <optional>
+
+#include "xeus/xkernel.hpp"
+#include "xeus/xmessage.hpp"
+
+#include "xeus_python_config.hpp"
+
+namespace xpyt
+{
+    /**
+     * In-process transport, for a client living in the process of the
+     * kernel (test suites, host applications embedding the kernel).
+     *
+     * The messages are moved as xeus::xmessage objects through lock-free
+     * queues, without ZMQ, serialization nor signature. The kernel is
+     * created with make_inproc_server_factory and started on a thread of
+     * its own, which runs the asyncio loop of the shell; control requests
+     * are handled by a second thread, as with ZMQ:
+     *
+     *   auto channels = xpyt::make_inproc_channels();
+     *   xeus::xkernel kernel(xeus::get_user_name(), xeus::make_empty_context(),
+     *                        std::move(interpreter), xpyt::make_inproc_server_factory(channels),
+     *                        xeus::make_in_memory_history_manager(), nullptr);
+     *   std::thread kernel_thread([&kernel]() { kernel.start(); });
+     *   xpyt::xinproc_client client(channels);
+     *
+     * The kernel has no port, no heartbeat and no debugger. POSIX only.
+     */
+    class xinproc_channels;
+
+    XEUS_PYTHON_API
+    std::shared_ptr<xinproc_channels> make_inproc_channels();
+
+    // A set of channels serves a single kernel.
+    XEUS_PYTHON_API
+    xeus::xkernel::server_builder make_inproc_server_factory(std::shared_ptr<xinproc_channels> channels);
+
+    /**
+     * Client side of the channels. The send methods can be called from any
+     * thread, each receive method from one thread at a time. A negative
+     * timeout, in milliseconds, waits until a message arrives or the kernel
+     * stops.
+     */
+    class XEUS_PYTHON_API xinproc_client
+    {
+    public:
+
+        explicit xinproc_client(std::shared_ptr<xinproc_channels> channels);
+
+        void send_on_shell(xeus::xmessage message);
+        void send_on_control(xeus::xmessage message);
+        void send_on_stdin(xeus::xmessage message);
+
+        std::optional<xeus::xmessage> receive_on_shell(long timeout = -1);
+        std::optional<xeus::xmessage> receive_on_control(long timeout = -1);
+        std::optional<xeus::xmessage> receive_on_stdin(long timeout = -1);
+        std::optional<xeus::xpub_message> receive_on_iopub(long timeout = -1);
+
+        bool kernel_stopped() const;
+
+    private:
+
+        std::shared_ptr<xinproc_channels> p_channels;
+    };
+}
+
+#endif
@@ -16,8 +16,10 @@
     #pragma GCC diagnostic ignored "-Wattributes"
 #endif
 
+#include <atomic>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "nlohmann/json.hpp"
 
@@ -32,6 +34,8 @@ namespace nl = nlohmann;
 
 namespace xpyt
 {
+    class xnamespace_snapshot;
+
     class XEUS_PYTHON_API XPYT_FORCE_PYBIND11_EXPORT interpreter : public xeus::xinterpreter
     {
     public:
@@ -44,9 +48,13 @@ namespace xpyt
         // If redirect_display_enabled is true (default) then this interpreter will
         // overwrite sys.displayhook and send execution results using publish_execution_result.
         // Disable this if your interpreter uses custom display hook.
+        // If lazy_configure is true, the IPython shell is initialized on its
+        // first use or when the kernel becomes idle after startup, so that
+        // the kernel answers kernel_info requests without waiting for it.
         interpreter(
                 py::dict globals,
-                bool redirect_output_enabled=true, bool redirect_display_enabled = true);
+                bool redirect_output_enabled=true, bool redirect_display_enabled = true,
+                bool lazy_configure = false);
         virtual ~interpreter();
 
     protected:
@@ -80,6 +88,10 @@ namespace xpyt
 
         void redirect_output();
 
+        // Initializes the IPython shell if the configuration was lazy and
+        // it has not been used yet. Requires the GIL.
+        void ensure_shell_initialized();
+
         py::dict m_global_dict;
         py::object m_ipython_shell_app;
         py::object m_ipython_shell;
@@ -102,9 +114,19 @@ namespace xpyt
 
         bool m_redirect_output_enabled;
         bool m_redirect_display_enabled;
+        bool m_lazy_configure;
+        // Initialization state of the IPython shell, see call_once_with_gil
+        std::atomic<int> m_shell_state{0};
+
+        // Namespace used to answer completion and inspection requests
+        // received by another thread while a cell is running
+        std::unique_ptr<xnamespace_snapshot> p_snapshot;
 
     private:
 
+        void initialize_shell();
+        // In-process restart requested with xpython_runtime.soft_restart()
+        void soft_restart(const std::vector<std::string>& allow_list);
         virtual void instanciate_ipython_shell();
         virtual bool use_jedi_for_completion() const;
     };
@@ -14,8 +14,10 @@
     #pragma GCC diagnostic ignored "-Wattributes"
 #endif
 
+#include <atomic>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "nlohmann/json.hpp"
 
@@ -30,6 +32,8 @@ namespace nl = nlohmann;
 
 namespace xpyt
 {
+    class xnamespace_snapshot;
+
     class XEUS_PYTHON_API XPYT_FORCE_PYBIND11_EXPORT raw_interpreter : public xeus::xinterpreter
     {
     public:
@@ -42,9 +46,12 @@ namespace xpyt
         // If redirect_display_enabled is true (default) then this interpreter will
         // overwrite sys.displayhook and send execution results using publish_execution_result.
         // Disable this if your interpreter uses custom display hook.
+        // If lazy_configure is true, jedi is imported and configured when the
+        // first completion or inspection request arrives instead of at startup.
         raw_interpreter(
             py::dict globals,
-            bool redirect_output_enabled=true, bool redirect_display_enabled = true);
+            bool redirect_output_enabled=true, bool redirect_display_enabled = true,
+            bool lazy_configure = false);
         virtual ~raw_interpreter();
 
     protected:
@@ -76,6 +83,15 @@ namespace xpyt
 
         void redirect_output();
 
+        // Imports and configures jedi if it has not been done yet. Requires
+        // the GIL.
+        void ensure_jedi_configured();
+
+        // Names defined by the kernel in the user namespace
+        void init_namespace();
+        // In-process restart requested with xpython_runtime.soft_restart()
+        void soft_restart(const std::vector<std::string>& allow_list);
+
         py::object m_displayhook;
 
         // The interpreter has the same scope as a `gil_scoped_release` instance
@@ -92,7 +108,14 @@ namespace xpyt
         bool m_release_gil_at_startup = true;
         gil_scoped_release_ptr m_release_gil = nullptr;
         bool m_redirect_display_enabled;
+        bool m_lazy_configure;
+        // Configuration state of jedi, see call_once_with_gil
+        std::atomic<int> m_jedi_state{0};
         py::dict m_global_dict;
+
+        // Namespace used to answer completion and inspection requests
+        // received by another thread while a cell is running
+        std::unique_ptr<xnamespace_snapshot> p_snapshot;
     };
 
 }
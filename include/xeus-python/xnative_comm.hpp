@@ -0,0 +1,70 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_NATIVE_COMM_HPP
+#define XPYT_NATIVE_COMM_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "xeus/xcomm.hpp"
+
+#include "xeus_python_config.hpp"
+
+namespace xpyt
+{
+    /**
+     * Comm targets implemented in C++.
+     *
+     * The handlers of a native target receive the xeus::xcomm and the
+     * xeus::xmessage directly: they are called on the shell thread without
+     * holding the GIL, and no message is converted to a Python object.
+     * Handlers that need to run Python code must acquire the GIL. The
+     * shell thread holds the GIL for every other message, the handlers of
+     * a native comm must therefore be set with on_native_message and
+     * on_native_close rather than with the methods of xeus::xcomm.
+     *
+     * Native comms remain visible from Python: comm.native_targets() lists
+     * the native targets, and get_comm_manager().get_comm(comm_id) returns
+     * a NativeComm object that can send messages on a native comm.
+     */
+
+    using native_target_callback = std::function<void(xeus::xcomm&&, const xeus::xmessage&)>;
+    using native_message_callback = std::function<void(const xeus::xmessage&)>;
+
+    // Must be called once the interpreter has been created.
+    XEUS_PYTHON_API
+    void register_native_comm_target(const std::string& target_name, const native_target_callback& callback);
+
+    XEUS_PYTHON_API
+    void unregister_native_comm_target(const std::string& target_name);
+
+    XEUS_PYTHON_API
+    bool is_native_comm_target(const std::string& target_name);
+
+    XEUS_PYTHON_API
+    std::vector<std::string> native_comm_targets();
+
+    // Creates a comm on a native target. The comm is not opened, open()
+    // must be called on it before sending messages. Throws
+    // std::runtime_error if the target has not been registered.
+    XEUS_PYTHON_API
+    xeus::xcomm make_native_comm(const std::string& target_name);
+
+    // Set the handlers of a native comm, called without holding the GIL.
+    XEUS_PYTHON_API
+    void on_native_message(xeus::xcomm& comm, const native_message_callback& callback);
+
+    XEUS_PYTHON_API
+    void on_native_close(xeus::xcomm& comm, const native_message_callback& callback);
+}
+
+#endif
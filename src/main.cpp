@@ -9,10 +9,15 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 #include <signal.h>
 
 #ifdef __GNUC__
@@ -41,6 +46,10 @@
 #include "xeus-python/xutils.hpp"
 #include "xeus-python/xaserver.hpp"
 
+#include "xforkserver.hpp"
+#include "xnotebook_runner.hpp"
+#include "xruntime.hpp"
+
 namespace py = pybind11;
 
 int main(int argc, char* argv[])
@@ -61,6 +70,30 @@ int main(int argc, char* argv[])
         std::clog.setstate(std::ios_base::failbit);
     }
 
+    // Hands the launch over to a forkserver template when one is listening,
+    // see xforkserver.hpp. Otherwise the kernel starts in this process.
+    std::string forkserver_client = xpyt::get_option_value("--forkserver-client", argc, argv);
+    if (!forkserver_client.empty())
+    {
+        xpyt::xfork_request request;
+        request.m_connection_file = xpyt::get_option_value("-f", argc, argv);
+        request.m_raw = std::any_of(argv, argv + argc, [](const char* arg)
+        {
+            return std::string(arg) == "-r" || std::string(arg) == "--raw";
+        });
+        int status = xpyt::run_forkserver_client(forkserver_client, request);
+        if (status >= 0)
+        {
+            return status;
+        }
+        std::clog << "No forkserver listening on " << forkserver_client << ", starting the kernel" << std::endl;
+    }
+
+    // Runs a notebook in this process instead of serving a kernel, see
+    // xnotebook_runner.hpp
+    xpyt::xnotebook_run_options run_options;
+    bool run_notebook = xpyt::extract_notebook_run_options(argc, argv, run_options);
+
     // Registering SIGSEGV handler
 #ifdef __GNUC__
     std::clog << "registering handler for SIGSEGV" << std::endl;
@@ -69,6 +102,8 @@ int main(int argc, char* argv[])
     // Registering SIGINT and SIGKILL handlers
     signal(SIGKILL, xpyt::sigkill_handler);
 #endif
+    // Until the interpreter is configured, it then installs a Python
+    // handler of SIGINT interrupting the running cell.
     signal(SIGINT, xpyt::sigkill_handler);
 
     // Python initialization
@@ -136,28 +171,77 @@ int main(int argc, char* argv[])
     delete[] argw;
 
 
-    std::unique_ptr<xeus::xcontext> context = xeus::make_zmq_context();
+    // In forkserver mode this process is a template that forks a kernel per
+    // launch request. No ZMQ context and no thread may be created before
+    // the fork, run_forkserver only returns in the forked kernels.
+    std::optional<xpyt::xfork_request> fork_request;
+    std::string forkserver_socket = xpyt::get_option_value("--forkserver", argc, argv);
+    if (!forkserver_socket.empty())
+    {
+        bool raw_template = xpyt::extract_option("-r", "--raw", argc, argv);
+        std::vector<std::string> preload = xpyt::default_forkserver_preload(raw_template);
+        std::string preload_option = xpyt::get_option_value("--preload", argc, argv);
+        if (!preload_option.empty())
+        {
+            preload.clear();
+            std::stringstream preload_stream(preload_option);
+            std::string name;
+            while (std::getline(preload_stream, name, ','))
+            {
+                preload.push_back(name);
+            }
+        }
+        fork_request = xpyt::run_forkserver(forkserver_socket, preload);
+
+        if (std::getenv("JPY_PARENT_PID") != NULL)
+        {
+            std::clog.setstate(std::ios_base::failbit);
+        }
+    }
 
     // we want to use **the same global dict everywhere**
     py::dict globals = py::globals();    
 
     // Instantiating the xeus xinterpreter
-    bool raw_mode = xpyt::extract_option("-r", "--raw", argc, argv);
+    bool raw_mode = fork_request ? fork_request->m_raw : xpyt::extract_option("-r", "--raw", argc, argv);
+    // Answers kernel_info before importing IPython or jedi
+    bool lazy_configure = xpyt::extract_option("--lazy", "--lazy", argc, argv);
+    // Seconds between the start of the loop and the deferred configuration
+    std::string lazy_delay = xpyt::get_option_value("--lazy-delay", argc, argv);
+    if (!lazy_delay.empty())
+    {
+        try
+        {
+            xpyt::set_idle_task_delay(std::stod(lazy_delay));
+        }
+        catch (const std::exception&)
+        {
+            std::cerr << "Invalid --lazy-delay value: " << lazy_delay << std::endl;
+            return 1;
+        }
+    }
     using interpreter_ptr = std::unique_ptr<xeus::xinterpreter>;
     interpreter_ptr interpreter;
     if (raw_mode)
     {
-        interpreter = interpreter_ptr(new xpyt::raw_interpreter(globals));
+        interpreter = interpreter_ptr(new xpyt::raw_interpreter(globals, true, true, lazy_configure));
     }
     else
     {
-        interpreter = interpreter_ptr(new xpyt::interpreter(globals));
+        interpreter = interpreter_ptr(new xpyt::interpreter(globals, true, true, lazy_configure));
     }
 
+    if (run_notebook)
+    {
+        return xpyt::run_notebook(*interpreter, run_options);
+    }
+
+    std::unique_ptr<xeus::xcontext> context = xeus::make_zmq_context();
+
     using history_manager_ptr = std::unique_ptr<xeus::xhistory_manager>;
     history_manager_ptr hist = xeus::make_in_memory_history_manager();
 
-    std::string connection_filename = xeus::extract_filename(argc, argv);
+    std::string connection_filename = fork_request ? fork_request->m_connection_file : xeus::extract_filename(argc, argv);
 
 #ifdef XEUS_PYTHON_PYPI_WARNING
     std::clog <<
@@ -12,6 +12,8 @@
 #include <memory>
 
 #include "xasync_runner.hpp"
+#include "xexecution_timing.hpp"
+#include "xruntime.hpp"
 #include "pybind11/embed.h"
 #include "pybind11/pybind11.h"
 
@@ -39,12 +41,15 @@ namespace xpyt
         py::cpp_function controller_callback = py::cpp_function([this]() {
             this->on_message_doorbell_controller();
         });
+        py::cpp_function idle_callback = py::cpp_function([]() {
+            xpyt::run_idle_tasks();
+        });
 
         // ensure gil
         py::gil_scoped_acquire acquire;
 
         // pure python impl of the main loop
-        exec(R"(
+        py::exec(R"(
         import sys
         import asyncio
         import traceback
@@ -68,26 +73,28 @@ namespace xpyt
                     self._sock.detach()
                 except:
                     pass
-                
+
         def make_fd(fd):
             if is_win:
                 return ZMQSockReader(fd)
             else:
                 return fd
 
-        def run_main_non_busy_loop(fd_shell, fd_controller, shell_callback, controller_callback):
+        def run_main_non_busy_loop(fd_shell, fd_controller, shell_callback, controller_callback, idle_callback, idle_delay):
             # here we create / ensure we have an event loop
             loop = asyncio.new_event_loop() 
             asyncio.set_event_loop(loop)
             loop.add_reader(fd_shell, shell_callback)
             loop.add_reader(fd_controller, controller_callback)
+            # deferred startup work runs once the first requests have been answered
+            loop.call_later(idle_delay, idle_callback)
             loop.run_forever()
-    
-        def run_main(fd_shell, fd_controller, shell_callback, controller_callback):
+
+        def run_main(fd_shell, fd_controller, shell_callback, controller_callback, idle_callback, idle_delay):
             try:
                 fd_controller = make_fd(fd_controller)
                 fd_shell = make_fd(fd_shell)
-                run_main_non_busy_loop(fd_shell, fd_controller, shell_callback, controller_callback)
+                run_main_non_busy_loop(fd_shell, fd_controller, shell_callback, controller_callback, idle_callback, idle_delay)
 
             except Exception as e:
                 traceback_str = traceback.format_exc()
@@ -96,17 +103,22 @@ namespace xpyt
 
         )", m_global_dict);
 
-        m_global_dict["run_main"](fd_shell_int, fd_controller_int, shell_callback, controller_callback);
+        m_global_dict["run_main"](fd_shell_int, fd_controller_int, shell_callback, controller_callback, idle_callback,
+                                  xpyt::idle_task_delay());
     
     }
 
     void xasync_runner::on_message_doorbell_shell()
     {
+        // Messages read in this batch have been waiting at least since the
+        // wake-up, this is the queue time reported in execution timings.
+        xpyt::notify_shell_wakeup(true);
         int ZMQ_DONTWAIT{ 1 }; // from zmq.h 
         while (auto msg = read_shell(ZMQ_DONTWAIT))
         {
             notify_shell_listener(std::move(msg.value()));
         }
+        xpyt::notify_shell_wakeup(false);
     }
 
     void xasync_runner::on_message_doorbell_controller()
@@ -129,7 +141,7 @@ namespace xpyt
                 py::exec(R"(
                 import asyncio
                 import sys
-                
+
                 def stop_loop(fd_shell, fd_controller):
                     loop = asyncio.get_event_loop()
                     loop.remove_reader(make_fd(fd_shell))
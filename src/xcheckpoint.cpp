@@ -0,0 +1,577 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xcheckpoint.hpp"
+#include "xgc_tuning.hpp"
+#include "xinterrupt.hpp"
+#include "xsubshell.hpp"
+#include "xthreading.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        constexpr char checkpoint_magic[] = "XPYTCKP2";
+        constexpr std::size_t magic_size = sizeof(checkpoint_magic) - 1;
+        constexpr std::size_t footer_size = 2 * sizeof(std::uint64_t) + magic_size;
+        constexpr std::uint64_t buffer_alignment = 64;
+
+        std::string error_string(py::error_already_set& e)
+        {
+            std::string res = py::str(e.type().attr("__name__")).cast<std::string>();
+            std::string message = py::str(e.value()).cast<std::string>();
+            return message.empty() ? res : res + ": " + message;
+        }
+
+        // The names of the IPython shell (In, Out, exit...) are not part
+        // of the user state, like in %who
+        py::dict hidden_names()
+        {
+            py::dict modules = py::module::import("sys").attr("modules");
+            if (!modules.contains("IPython"))
+            {
+                return py::dict();
+            }
+            py::object shell = py::module::import("IPython").attr("get_ipython")();
+            return shell.is_none() ? py::dict() : py::dict(shell.attr("user_ns_hidden"));
+        }
+
+        bool defined_in_notebook(py::handle value)
+        {
+            PyObject* obj = value.ptr();
+            if (!PyFunction_Check(obj) && !PyType_Check(obj))
+            {
+                return false;
+            }
+            py::object module = py::getattr(value, "__module__", py::none());
+            return py::isinstance<py::str>(module) && module.cast<std::string>() == "__main__";
+        }
+
+        class checkpoint_writer
+        {
+        public:
+
+            explicit checkpoint_writer(const std::string& path)
+            {
+#ifndef _WIN32
+                // Readable by the owner only, the namespace may hold secrets
+                std::error_code ec;
+                std::filesystem::remove(path, ec);
+                int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+                if (fd == -1)
+                {
+                    throw std::runtime_error("cannot create " + path);
+                }
+                ::close(fd);
+#endif
+                m_stream.open(path, std::ios::binary | std::ios::trunc);
+                if (!m_stream)
+                {
+                    throw std::runtime_error("cannot open " + path);
+                }
+                write(checkpoint_magic, magic_size);
+            }
+
+            std::uint64_t offset() const
+            {
+                return m_offset;
+            }
+
+            void align()
+            {
+                static const char zeros[buffer_alignment] = {};
+                std::uint64_t padding = (buffer_alignment - m_offset % buffer_alignment) % buffer_alignment;
+                write(zeros, padding);
+            }
+
+            // Writes the content of an object supporting the buffer protocol
+            nl::json write_buffer(py::handle obj)
+            {
+                Py_buffer view;
+                if (PyObject_GetBuffer(obj.ptr(), &view, PyBUF_SIMPLE) != 0)
+                {
+                    throw py::error_already_set();
+                }
+                std::uint64_t start = m_offset;
+                write(static_cast<const char*>(view.buf), static_cast<std::uint64_t>(view.len));
+                PyBuffer_Release(&view);
+                return nl::json::array({start, m_offset - start});
+            }
+
+            void write(const char* data, std::uint64_t size)
+            {
+                m_stream.write(data, static_cast<std::streamsize>(size));
+                m_offset += size;
+            }
+
+            void write_u64(std::uint64_t value)
+            {
+                write(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+
+            void close(const std::string& path)
+            {
+                m_stream.close();
+                if (!m_stream)
+                {
+                    throw std::runtime_error("cannot write " + path);
+                }
+            }
+
+        private:
+
+            std::ofstream m_stream;
+            std::uint64_t m_offset = 0;
+        };
+    }
+
+    nl::json checkpoint_namespace(const py::dict& ns, const std::string& path)
+    {
+        py::module pickle = py::module::import("pickle");
+        py::dict hidden = hidden_names();
+
+        nl::json modules = nl::json::object();
+        nl::json saved = nl::json::array();
+        nl::json skipped = nl::json::object();
+        py::dict variables;
+
+        for (auto item : ns)
+        {
+            if (!PyUnicode_Check(item.first.ptr()))
+            {
+                continue;
+            }
+            std::string name = item.first.cast<std::string>();
+            if (name.empty() || name[0] == '_')
+            {
+                continue;
+            }
+            py::handle value = item.second;
+            if (hidden.contains(item.first) && hidden[item.first].is(value))
+            {
+                continue;
+            }
+
+            if (PyModule_Check(value.ptr()))
+            {
+                modules[name] = py::str(value.attr("__name__")).cast<std::string>();
+                saved.push_back(name);
+            }
+            else if (defined_in_notebook(value))
+            {
+                skipped[name] = "defined in the notebook, run its cell again";
+            }
+            else
+            {
+                variables[item.first] = value;
+            }
+        }
+
+        // Out-of-band buffers of the variables
+        py::list buffers;
+        py::cpp_function buffer_callback([&buffers](py::object pickle_buffer)
+        {
+            try
+            {
+                buffers.append(pickle_buffer.attr("raw")());
+                return false;
+            }
+            catch (py::error_already_set&)
+            {
+                // Not contiguous, serialized in the pickle stream
+                return true;
+            }
+        });
+
+        // The variables are pickled together, so that the objects they
+        // share are shared again once restored. When one of them cannot be
+        // pickled, each is tried alone to report it, without copying the
+        // buffers.
+        py::object data;
+        try
+        {
+            data = pickle.attr("dumps")(variables, py::arg("protocol") = 5, py::arg("buffer_callback") = buffer_callback);
+        }
+        catch (py::error_already_set&)
+        {
+            py::cpp_function drop_buffer([](py::object) { return false; });
+            py::dict picklable;
+            for (auto item : variables)
+            {
+                try
+                {
+                    pickle.attr("dumps")(item.second, py::arg("protocol") = 5, py::arg("buffer_callback") = drop_buffer);
+                    picklable[item.first] = item.second;
+                }
+                catch (py::error_already_set& e)
+                {
+                    skipped[item.first.cast<std::string>()] = error_string(e);
+                }
+            }
+            variables = picklable;
+            buffers = py::list();
+            data = pickle.attr("dumps")(variables, py::arg("protocol") = 5, py::arg("buffer_callback") = buffer_callback);
+        }
+        for (auto item : variables)
+        {
+            saved.push_back(item.first.cast<std::string>());
+        }
+
+        std::string tmp_path = path + ".tmp";
+        checkpoint_writer writer(tmp_path);
+        nl::json index = {{"modules", std::move(modules)}};
+        index["data"] = writer.write_buffer(data);
+        nl::json buffer_ranges = nl::json::array();
+        for (py::handle buffer : buffers)
+        {
+            writer.align();
+            buffer_ranges.push_back(writer.write_buffer(buffer));
+        }
+        index["buffers"] = std::move(buffer_ranges);
+
+        std::string index_data = index.dump();
+        std::uint64_t index_offset = writer.offset();
+        writer.write(index_data.data(), index_data.size());
+        writer.write_u64(index_offset);
+        writer.write_u64(index_data.size());
+        writer.write(checkpoint_magic, magic_size);
+        std::uint64_t size = writer.offset();
+        writer.close(tmp_path);
+
+        // The previous checkpoint may still be mapped by restored variables,
+        // the mapping keeps its content.
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmp_path, ec);
+            throw std::runtime_error("cannot write " + path);
+        }
+
+        return {
+            {"path", path},
+            {"saved", std::move(saved)},
+            {"skipped", std::move(skipped)},
+            {"bytes", size}
+        };
+    }
+
+    nl::json restore_namespace(py::dict ns, const std::string& path)
+    {
+        py::module pickle = py::module::import("pickle");
+        py::module mmap = py::module::import("mmap");
+        py::module importlib = py::module::import("importlib");
+
+        // Copy-on-write, so that the restored arrays are writable
+        py::object file = py::module::import("io").attr("open")(path, "rb");
+        py::object mapping;
+        try
+        {
+            mapping = mmap.attr("mmap")(file.attr("fileno")(), 0, py::arg("access") = mmap.attr("ACCESS_COPY"));
+        }
+        catch (py::error_already_set&)
+        {
+            file.attr("close")();
+            throw;
+        }
+        file.attr("close")();
+
+        py::memoryview view(mapping);
+        Py_buffer* buffer = PyMemoryView_GET_BUFFER(view.ptr());
+        const char* data = static_cast<const char*>(buffer->buf);
+        std::uint64_t size = static_cast<std::uint64_t>(buffer->len);
+        if (size < magic_size + footer_size
+            || std::memcmp(data, checkpoint_magic, magic_size) != 0
+            || std::memcmp(data + size - magic_size, checkpoint_magic, magic_size) != 0)
+        {
+            throw std::runtime_error(path + " is not a checkpoint");
+        }
+
+        std::uint64_t index_offset;
+        std::uint64_t index_size;
+        std::memcpy(&index_offset, data + size - footer_size, sizeof(index_offset));
+        std::memcpy(&index_size, data + size - footer_size + sizeof(index_offset), sizeof(index_size));
+        if (index_offset + index_size > size - footer_size)
+        {
+            throw std::runtime_error(path + " is truncated");
+        }
+        nl::json index = nl::json::parse(data + index_offset, data + index_offset + index_size);
+
+        // Slices of the mapping, which they keep alive
+        auto slice = [&view](const nl::json& range) -> py::object
+        {
+            std::uint64_t start = range[0].get<std::uint64_t>();
+            std::uint64_t stop = start + range[1].get<std::uint64_t>();
+            return view[py::slice(static_cast<py::ssize_t>(start), static_cast<py::ssize_t>(stop), 1)];
+        };
+
+        nl::json restored = nl::json::array();
+        nl::json failed = nl::json::object();
+        for (const auto& entry : index["modules"].items())
+        {
+            try
+            {
+                ns[py::str(entry.key())] = importlib.attr("import_module")(entry.value().get<std::string>());
+                restored.push_back(entry.key());
+            }
+            catch (py::error_already_set& e)
+            {
+                failed[entry.key()] = error_string(e);
+            }
+        }
+
+        py::list buffers;
+        for (const auto& range : index["buffers"])
+        {
+            buffers.append(slice(range));
+        }
+        try
+        {
+            py::dict variables = pickle.attr("loads")(slice(index["data"]), py::arg("buffers") = buffers);
+            for (auto item : variables)
+            {
+                ns[item.first] = item.second;
+                restored.push_back(item.first.cast<std::string>());
+            }
+        }
+        catch (py::error_already_set& e)
+        {
+            failed["*"] = error_string(e);
+        }
+
+        return {
+            {"path", path},
+            {"restored", std::move(restored)},
+            {"failed", std::move(failed)}
+        };
+    }
+
+    /***************************************
+     * xhibernation implementation
+     ***************************************/
+
+    void xhibernation::configure(double timeout, const std::string& path)
+    {
+        wake();
+        std::string default_path;
+        {
+            xstate_lock lock(m_mutex);
+            default_path = m_default_path;
+        }
+        if (path.empty() && default_path.empty() && timeout > 0.)
+        {
+            // Created with mode 0700, other users cannot predict nor read
+            // the checkpoint
+            py::object mkdtemp = py::module::import("tempfile").attr("mkdtemp");
+            std::string directory = mkdtemp(py::arg("prefix") = "xpython-hibernation-").cast<std::string>();
+            default_path = (std::filesystem::path(directory) / "namespace.ckpt").string();
+        }
+        xstate_lock lock(m_mutex);
+        if (m_default_path.empty())
+        {
+            m_default_path = default_path;
+        }
+        m_timeout = timeout > 0. ? timeout : 0.;
+        m_path = path.empty() ? m_default_path : path;
+    }
+
+    void xhibernation::arm(const py::dict& ns)
+    {
+        // Released without the lock
+        py::object previous = ns;
+        {
+            xstate_lock lock(m_mutex);
+            std::swap(m_ns, previous);
+        }
+        arm();
+    }
+
+    void xhibernation::arm()
+    {
+        double timeout;
+        py::object previous;
+        {
+            xstate_lock lock(m_mutex);
+            if (m_timeout == 0. || !m_ns)
+            {
+                return;
+            }
+            timeout = m_timeout;
+            std::swap(m_handle, previous);
+            m_armed.store(false);
+        }
+        if (previous)
+        {
+            previous.attr("cancel")();
+        }
+
+        py::object loop;
+        try
+        {
+            loop = py::module::import("asyncio").attr("get_running_loop")();
+        }
+        catch (py::error_already_set&)
+        {
+            // Not driven by an asyncio loop, e.g. embedded
+            return;
+        }
+
+        py::object handle = loop.attr("call_later")(timeout, py::cpp_function([this]() { hibernate(); }));
+        {
+            xstate_lock lock(m_mutex);
+            std::swap(m_handle, handle);
+            m_armed.store(true);
+        }
+        // Armed concurrently
+        if (handle)
+        {
+            handle.attr("cancel")();
+        }
+    }
+
+    void xhibernation::wake()
+    {
+        if (!m_armed.load() && !m_hibernating.load())
+        {
+            return;
+        }
+
+        py::object handle;
+        py::object ns;
+        std::string path;
+        {
+            xstate_lock lock(m_mutex);
+            std::swap(m_handle, handle);
+            m_armed.store(false);
+            if (m_hibernating.exchange(false))
+            {
+                ns = m_ns;
+                path = m_path;
+            }
+        }
+        if (handle)
+        {
+            handle.attr("cancel")();
+        }
+        if (!ns)
+        {
+            return;
+        }
+
+        nl::json report;
+        try
+        {
+            report = restore_namespace(ns, path);
+        }
+        catch (std::exception& e)
+        {
+            // py::error_already_set included
+            std::clog << "cannot restore the namespace: " << e.what() << std::endl;
+            report = {{"error", e.what()}};
+        }
+        xstate_lock lock(m_mutex);
+        m_restore = std::move(report);
+    }
+
+    void xhibernation::hibernate()
+    {
+        py::object handle;
+        py::object ns;
+        std::string path;
+        {
+            xstate_lock lock(m_mutex);
+            std::swap(m_handle, handle);
+            m_armed.store(false);
+            if (m_hibernating.load() || !m_ns)
+            {
+                return;
+            }
+            ns = m_ns;
+            path = m_path;
+        }
+        if (interruptible_execution_running() || subshell_execution_running())
+        {
+            return;
+        }
+
+        nl::json report;
+        try
+        {
+            report = checkpoint_namespace(ns, path);
+        }
+        catch (std::exception& e)
+        {
+            std::clog << "cannot checkpoint the namespace: " << e.what() << std::endl;
+            xstate_lock lock(m_mutex);
+            m_checkpoint = {{"error", e.what()}};
+            return;
+        }
+
+        // The variables that could not be saved stay in memory
+        for (const auto& name : report["saved"])
+        {
+            PyDict_DelItemString(ns.ptr(), name.get<std::string>().c_str());
+        }
+        get_gc_tuner().collect_all();
+#if defined(__GLIBC__)
+        malloc_trim(0);
+#endif
+        xstate_lock lock(m_mutex);
+        m_checkpoint = std::move(report);
+        m_hibernating.store(true);
+    }
+
+    nl::json xhibernation::info() const
+    {
+        xstate_lock lock(m_mutex);
+        return {
+            {"enabled", m_timeout > 0.},
+            {"timeout", m_timeout},
+            {"hibernating", m_hibernating.load()},
+            {"path", m_path},
+            {"last_checkpoint", m_checkpoint},
+            {"last_restore", m_restore}
+        };
+    }
+
+    xhibernation& get_hibernation()
+    {
+        // Leaked, the Python objects must not be released after the
+        // interpreter is finalized
+        static xhibernation* hibernation = new xhibernation();
+        return *hibernation;
+    }
+}
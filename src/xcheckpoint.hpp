@@ -0,0 +1,110 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_CHECKPOINT_HPP
+#define XPYT_CHECKPOINT_HPP
+
+#include <atomic>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xthreading.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Checkpoint of the user namespace.
+     *
+     * The variables are pickled together with protocol 5, so that the
+     * objects they share stay shared: the pickle stream and the out-of-band
+     * buffers (numpy arrays, including the ones held by pandas objects,
+     * bytes-like objects...) are written raw and 64-byte aligned in the
+     * checkpoint file, followed by a JSON index:
+     *
+     *   "XPYTCKP2" | blocks... | index | index offset (u64) | index size (u64) | "XPYTCKP2"
+     *
+     * Modules are recorded by name and imported again on restore. Private
+     * names and the functions and classes defined in the notebook, which
+     * pickle by reference, are not saved. The variables that cannot be
+     * pickled are reported with the error.
+     *
+     * Restoring maps the file copy-on-write: the pickle streams are loaded
+     * but the out-of-band buffers stay backed by the file, their pages are
+     * read on first access. The file is written under a temporary name and
+     * then renamed, so that a new checkpoint never modifies a mapped one.
+     * It is created readable and writable by the owner only.
+     *
+     * All the functions require the GIL.
+     */
+
+    // Returns {"path", "saved", "skipped": {name: error}, "bytes"}
+    nl::json checkpoint_namespace(const py::dict& ns, const std::string& path);
+
+    // Returns {"path", "restored", "failed": {name: error}}
+    nl::json restore_namespace(py::dict ns, const std::string& path);
+
+    /**
+     * Idle hibernation: once the kernel has been idle for the configured
+     * time, the namespace is checkpointed, the saved variables are removed
+     * from it and the memory is released. The namespace is restored by the
+     * next request that may use it (execute, complete, inspect, comm
+     * messages). Values still referenced elsewhere, e.g. by the output
+     * cache of IPython, are not released.
+     */
+    class xhibernation
+    {
+    public:
+
+        // 0 disables the hibernation. An empty path selects a file in a
+        // private directory created in the temporary directory.
+        void configure(double timeout, const std::string& path);
+
+        // Called when a request has been answered, schedules the
+        // hibernation on the running asyncio loop.
+        void arm(const py::dict& ns);
+
+        // Schedules the hibernation of the last namespace armed, after the
+        // messages that do not know the namespace (comms)
+        void arm();
+
+        // Cancels the scheduled hibernation and restores the namespace if
+        // the kernel is hibernating.
+        void wake();
+
+        nl::json info() const;
+
+    private:
+
+        void hibernate();
+
+        // Guards the members, the Python objects are copied or swapped
+        // under the lock and used after releasing it
+        mutable xstate_mutex m_mutex;
+        double m_timeout = 0.;
+        std::string m_path;
+        std::string m_default_path;
+        py::object m_ns;
+        py::object m_handle;
+        std::atomic<bool> m_armed{false};
+        std::atomic<bool> m_hibernating{false};
+        nl::json m_checkpoint = nl::json::object();
+        nl::json m_restore = nl::json::object();
+    };
+
+    xhibernation& get_hibernation();
+}
+
+#endif
@@ -0,0 +1,152 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <functional>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "xcode_cache.hpp"
+
+namespace xpyt
+{
+    /******************************
+     * xcode_cache implementation *
+     ******************************/
+
+    xcode_cache::xcode_cache(std::size_t capacity)
+        : m_capacity(capacity)
+        , m_hits(0)
+        , m_misses(0)
+    {
+    }
+
+    bool xcode_cache::find(const std::string& code, int flags, entry& res)
+    {
+        xstate_lock lock(m_mutex);
+        auto it = find_node(hash(code, flags), code, flags);
+        if (it == m_index.end())
+        {
+            ++m_misses;
+            return false;
+        }
+        ++m_hits;
+        // Most recently used entries are kept at the front
+        m_nodes.splice(m_nodes.begin(), m_nodes, it->second);
+        res = it->second->m_entry;
+        return true;
+    }
+
+    void xcode_cache::insert(const std::string& code, int flags, entry value)
+    {
+        xstate_lock lock(m_mutex);
+        if (m_capacity == 0)
+        {
+            return;
+        }
+
+        std::size_t key = hash(code, flags);
+        auto it = find_node(key, code, flags);
+        if (it != m_index.end())
+        {
+            it->second->m_entry = std::move(value);
+            m_nodes.splice(m_nodes.begin(), m_nodes, it->second);
+            return;
+        }
+
+        m_nodes.push_front(node{code, flags, std::move(value)});
+        m_index.emplace(key, m_nodes.begin());
+        evict();
+    }
+
+    std::size_t xcode_cache::capacity() const
+    {
+        xstate_lock lock(m_mutex);
+        return m_capacity;
+    }
+
+    void xcode_cache::set_capacity(std::size_t capacity)
+    {
+        xstate_lock lock(m_mutex);
+        m_capacity = capacity;
+        evict();
+    }
+
+    std::size_t xcode_cache::size() const
+    {
+        xstate_lock lock(m_mutex);
+        return m_nodes.size();
+    }
+
+    std::size_t xcode_cache::hits() const
+    {
+        xstate_lock lock(m_mutex);
+        return m_hits;
+    }
+
+    std::size_t xcode_cache::misses() const
+    {
+        xstate_lock lock(m_mutex);
+        return m_misses;
+    }
+
+    void xcode_cache::clear()
+    {
+        xstate_lock lock(m_mutex);
+        m_index.clear();
+        m_nodes.clear();
+        m_hits = 0;
+        m_misses = 0;
+    }
+
+    std::size_t xcode_cache::hash(const std::string& code, int flags)
+    {
+        std::size_t seed = std::hash<std::string>()(code);
+        return seed ^ (std::hash<int>()(flags) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+
+    auto xcode_cache::find_node(std::size_t key, const std::string& code, int flags) -> index_type::iterator
+    {
+        auto range = m_index.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second->m_flags == flags && it->second->m_code == code)
+            {
+                return it;
+            }
+        }
+        return m_index.end();
+    }
+
+    void xcode_cache::evict()
+    {
+        while (m_nodes.size() > m_capacity)
+        {
+            auto last = std::prev(m_nodes.end());
+            auto it = find_node(hash(last->m_code, last->m_flags), last->m_code, last->m_flags);
+            m_index.erase(it);
+            m_nodes.erase(last);
+        }
+    }
+
+    xcode_cache& get_code_cache()
+    {
+        // Leaked on purpose: the entries hold Python objects that must not
+        // be released after the interpreter has been finalized.
+        static xcode_cache* cache = new xcode_cache(256);
+        return *cache;
+    }
+
+    xcode_cache& get_snippet_cache()
+    {
+        static xcode_cache* cache = new xcode_cache(64);
+        return *cache;
+    }
+}
@@ -0,0 +1,103 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_CODE_CACHE_HPP
+#define XPYT_CODE_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "pybind11/pybind11.h"
+
+#include "xthreading.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    /**
+     * Bounded LRU cache of the compiled code of cells.
+     *
+     * An entry holds the code object of the cell body and, when the last
+     * statement of the cell is an expression compiled in interactive mode,
+     * the code object of that expression. Entries are keyed by the source
+     * and the compile flags, the source is compared on lookup so that hash
+     * collisions can never return the code of another cell.
+     *
+     * The cache holds Python objects, it must only be used with the GIL
+     * (or an attached thread state on free-threaded builds).
+     */
+    class xcode_cache
+    {
+    public:
+
+        struct entry
+        {
+            py::object m_body;
+            py::object m_interactive;
+        };
+
+        explicit xcode_cache(std::size_t capacity);
+
+        // Copies the entry to res on a hit, the cache may be modified by
+        // another thread once the function returns.
+        bool find(const std::string& code, int flags, entry& res);
+        void insert(const std::string& code, int flags, entry value);
+
+        std::size_t capacity() const;
+        void set_capacity(std::size_t capacity);
+        std::size_t size() const;
+        std::size_t hits() const;
+        std::size_t misses() const;
+
+        void clear();
+
+    private:
+
+        struct node
+        {
+            std::string m_code;
+            int m_flags;
+            entry m_entry;
+        };
+
+        using list_type = std::list<node>;
+        using index_type = std::unordered_multimap<std::size_t, list_type::iterator>;
+
+        static std::size_t hash(const std::string& code, int flags);
+        index_type::iterator find_node(std::size_t key, const std::string& code, int flags);
+        void evict();
+
+        mutable xstate_mutex m_mutex;
+        std::size_t m_capacity;
+        std::size_t m_hits;
+        std::size_t m_misses;
+        list_type m_nodes;
+        index_type m_index;
+    };
+
+    // Cache used by the raw interpreter, also exposed to Python through
+    // the runtime module.
+    xcode_cache& get_code_cache();
+
+    // Cache of the snippets run by exec_snippet. The kernel runs some of its
+    // own snippets over and over (e.g. the rich inspection of the
+    // debugger), their code objects are compiled once. The code of users,
+    // such as the one of internal requests, goes through xpyt::exec and is
+    // not cached.
+    xcode_cache& get_snippet_cache();
+
+    // Same as xpyt::exec, for the snippets of the kernel. Requires the GIL.
+    void exec_snippet(const py::str& code, const py::object& scope = py::globals());
+}
+
+#endif
@@ -8,6 +8,10 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include "nlohmann/json.hpp"
@@ -20,11 +24,18 @@
 #include "pybind11/pybind11.h"
 #include "pybind11/functional.h"
 #include "pybind11/eval.h"
+#include "pybind11/stl.h"
 
+#include "xeus-python/xnative_comm.hpp"
 #include "xeus-python/xutils.hpp"
 
+#include "xcheckpoint.hpp"
 #include "xcomm.hpp"
+#include "xcomm_codec.hpp"
+#include "xcomm_dispatcher.hpp"
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
+#include "xjson.hpp"
 
 namespace py = pybind11;
 namespace nl = nlohmann;
@@ -33,19 +44,91 @@ using namespace pybind11::literals;
 namespace xpyt
 {
 
+    namespace
+    {
+        // Leaked, guarded by the GIL. Empty when comms are available.
+        std::string& comms_disabled_reason()
+        {
+            static std::string* reason = new std::string();
+            return *reason;
+        }
+
+        // Same report as for the errors raised by the handlers
+        void print_python_error(py::error_already_set& e)
+        {
+            py::module::import("traceback").attr("print_exception")(e.type(), e.value(), e.trace());
+        }
+    }
+
+    void disable_comms(const std::string& reason)
+    {
+        comms_disabled_reason() = reason;
+    }
+
     /************************
      * xcomm implementation *
      ************************/
 
     xcomm::xcomm(const py::object& target_name, const py::object& data, const py::object& metadata, const py::object& buffers, const py::kwargs& kwargs)
         : m_comm(target(target_name), id(kwargs))
+        , m_compression_threshold(default_compression_threshold)
+        , p_codec(nullptr)
+        , m_shm_threshold(default_shm_threshold)
+        , m_conflate(false)
+        , m_conflate_interval(0.)
+        , m_pending_updates(0)
+        , m_max_pending_updates(0)
+        , m_conflated_updates(0)
+        , m_sent_updates(0)
     {
-        m_comm.open(metadata, data, pylist_to_cpp_buffers(buffers));
+        init_compression(kwargs);
+        init_shared_memory(kwargs);
+        init_dispatcher(kwargs);
+        init_conflation(kwargs);
+        m_comm.on_message([this](const xeus::xmessage& msg)
+        {
+            XPYT_HOLDING_GIL(process_transport_metadata(msg))
+        });
+
+        nl::json cpp_metadata = pyobject_to_json(metadata);
+        if (!m_preferred_codecs.empty())
+        {
+            // Advertise the codecs this comm is willing to use, the frontend
+            // enables the compression by sending back the ones it accepts.
+            cpp_metadata[buffer_codecs_key] = m_preferred_codecs;
+        }
+        if (p_shm_ring)
+        {
+            cpp_metadata[buffer_transports_key] = nl::json::array({shm_transport_name});
+        }
+        m_comm.open(std::move(cpp_metadata), pyobject_to_json(data), pylist_to_cpp_buffers(buffers));
     }
 
     xcomm::xcomm(xeus::xcomm&& comm)
         : m_comm(std::move(comm))
+        , m_compression_threshold(default_compression_threshold)
+        , p_codec(nullptr)
+        , m_shm_threshold(default_shm_threshold)
+        , m_conflate(false)
+        , m_conflate_interval(0.)
+        , m_pending_updates(0)
+        , m_max_pending_updates(0)
+        , m_conflated_updates(0)
+        , m_sent_updates(0)
     {
+        init_dispatcher(py::kwargs());
+        m_comm.on_message([this](const xeus::xmessage& msg)
+        {
+            XPYT_HOLDING_GIL(process_transport_metadata(msg))
+        });
+    }
+
+    xcomm::~xcomm()
+    {
+        if (m_flush_handle)
+        {
+            XPYT_HOLDING_GIL(m_flush_handle.attr("cancel")())
+        }
     }
 
     std::string xcomm::comm_id() const
@@ -58,22 +141,118 @@ namespace xpyt
         return true;
     }
 
+    py::object xcomm::compression() const
+    {
+        const xbuffer_codec* codec = nullptr;
+        {
+            xstate_lock lock(m_state_mutex);
+            codec = p_codec;
+        }
+        if (codec == nullptr)
+        {
+            return py::none();
+        }
+        return py::str(codec->name());
+    }
+
+    py::object xcomm::shared_memory() const
+    {
+        if (!p_shm_ring)
+        {
+            return py::none();
+        }
+        py::dict res;
+        res["segment"] = p_shm_ring->segment_name();
+        res["capacity"] = p_shm_ring->capacity();
+        res["threshold"] = m_shm_threshold;
+        res["used"] = p_shm_ring->used();
+        res["outstanding"] = p_shm_ring->outstanding();
+        xstate_lock lock(m_state_mutex);
+        res["consumers"] = m_shm_consumers.size();
+        return res;
+    }
+
+    py::object xcomm::max_concurrency() const
+    {
+        return m_dispatcher.cast<const xhandler_dispatcher&>().max_concurrency();
+    }
+
+    void xcomm::set_max_concurrency(const py::object& value)
+    {
+        m_dispatcher.cast<xhandler_dispatcher&>().set_max_concurrency(value);
+    }
+
+    bool xcomm::ordered() const
+    {
+        return m_dispatcher.cast<const xhandler_dispatcher&>().ordered();
+    }
+
+    void xcomm::set_ordered(bool value)
+    {
+        m_dispatcher.cast<xhandler_dispatcher&>().set_ordered(value);
+    }
+
+    bool xcomm::conflate() const
+    {
+        xstate_lock lock(m_state_mutex);
+        return m_conflate;
+    }
+
+    void xcomm::set_conflate(bool value)
+    {
+        {
+            xstate_lock lock(m_state_mutex);
+            m_conflate = value;
+        }
+        // Updates conflated by other threads until the store are sent
+        // after it, none is conflated afterwards
+        if (!value)
+        {
+            flush_pending_update();
+        }
+    }
+
+    py::dict xcomm::conflation_stats() const
+    {
+        xstate_lock lock(m_state_mutex);
+        py::dict res;
+        res["pending"] = m_pending_updates;
+        res["max_pending"] = m_max_pending_updates;
+        res["conflated"] = m_conflated_updates;
+        res["sent"] = m_sent_updates;
+        return res;
+    }
+
     void xcomm::close(const py::object& data, const py::object& metadata, const py::object& buffers)
     {
-        m_comm.close(metadata, data, pylist_to_cpp_buffers(buffers));
+        flush_pending_update();
+        nl::json cpp_metadata = pyobject_to_json(metadata);
+        xeus::buffer_sequence cpp_buffers = pylist_to_cpp_buffers(buffers);
+        encode_buffers(cpp_metadata, cpp_buffers);
+        m_comm.close(std::move(cpp_metadata), pyobject_to_json(data), std::move(cpp_buffers));
     }
 
     void xcomm::send(const py::object& data, const py::object& metadata, const py::object& buffers)
     {
-        m_comm.send(metadata, data, pylist_to_cpp_buffers(buffers));
+        nl::json cpp_data = pyobject_to_json(data);
+        nl::json cpp_metadata = pyobject_to_json(metadata);
+        bool has_buffers = !buffers.is_none() && py::len(buffers) != 0;
+        if (!has_buffers && conflate() && conflate_update(cpp_data, cpp_metadata))
+        {
+            return;
+        }
+
+        // Pending updates are sent first to preserve the order of the messages
+        flush_pending_update();
+        send_now(std::move(cpp_data), std::move(cpp_metadata), pylist_to_cpp_buffers(buffers));
     }
 
-    void xcomm::on_msg(const python_callback_type& callback)
+    void xcomm::on_msg(const py::object& callback)
     {
         m_comm.on_message(cpp_callback(callback));
     }
 
-    void xcomm::on_close(const python_callback_type& callback)
+    void xcomm::on_close(const py::object& callback)
     {
         m_comm.on_close(cpp_close_callback(callback));
     }
@@ -87,8 +266,19 @@ namespace xpyt
         });
     }
 
+    void xcomm::negotiate_compression(const xeus::xmessage& msg)
+    {
+        xstate_lock lock(m_state_mutex);
+        add_peer(msg.header().value("session", ""), msg.metadata());
+    }
+
     const xeus::xtarget* xcomm::target(const py::object& target_name) const
     {
+        // First member initialized when a comm is opened from Python
+        if (!comms_disabled_reason().empty())
+        {
+            throw std::runtime_error(comms_disabled_reason());
+        }
         auto& comm_manager = xeus::get_interpreter().comm_manager();
         auto res = comm_manager.target(target_name.cast<std::string>());
         if (!res)
@@ -113,31 +303,497 @@ namespace xpyt
         }
     }
 
-    auto xcomm::cpp_callback(const python_callback_type& py_callback) const -> cpp_callback_type
+    auto xcomm::cpp_callback(const py::object& py_callback) -> cpp_callback_type
     {
         return [this, py_callback](const xeus::xmessage& msg)
         {
-            XPYT_HOLDING_GIL(py_callback(cppmessage_to_pymessage(msg)))
+            auto handle_message = [this, &py_callback, &msg]()
+            {
+                // The handler may use the variables of the namespace
+                get_hibernation().wake();
+                if (!process_transport_metadata(msg))
+                {
+                    py::object pymsg = to_pymessage(msg);
+                    if (!pymsg.is_none())
+                    {
+                        dispatch(py_callback(pymsg));
+                    }
+                }
+                get_hibernation().arm();
+            };
+            XPYT_HOLDING_GIL(handle_message())
         };
     }
 
-    auto xcomm::cpp_close_callback(const python_callback_type& py_callback) const -> cpp_callback_type
+    auto xcomm::cpp_close_callback(const py::object& py_callback) -> cpp_callback_type
     {
         return [this, py_callback](const xeus::xmessage& msg)
         {
-            XPYT_HOLDING_GIL(py_callback(cppmessage_to_pymessage(msg)))
-            if (m_close_callback)
+            auto handle_close = [this, &py_callback, &msg]()
+            {
+                // When the handler is a coroutine, the cleanup must wait for
+                // its completion since it may release the last reference on
+                // this comm.
+                py::cpp_function cleanup([this]()
+                {
+                    if (m_close_callback)
+                    {
+                        m_close_callback();
+                    }
+                });
+                get_hibernation().wake();
+                py::object pymsg = to_pymessage(msg);
+                if (pymsg.is_none() || !dispatch(py_callback(pymsg), cleanup))
+                {
+                    cleanup();
+                }
+                get_hibernation().arm();
+            };
+            XPYT_HOLDING_GIL(handle_close())
+        };
+    }
+
+    void xcomm::init_dispatcher(const py::kwargs& kwargs)
+    {
+        py::object max_concurrency = kwargs.contains("max_concurrency") ? py::object(kwargs["max_concurrency"]) : py::none();
+        bool ordered = kwargs.contains("ordered") && is_pyobject_true(kwargs["ordered"]);
+        m_dispatcher = get_comm_module().attr("HandlerDispatcher")(max_concurrency, ordered);
+    }
+
+    bool xcomm::dispatch(const py::object& result, const py::object& done_callback)
+    {
+        if (!is_pyobject_true(get_handle(xhandle::inspect_isawaitable)(result)))
+        {
+            return false;
+        }
+        m_dispatcher.cast<xhandler_dispatcher&>().submit(result, done_callback);
+        return true;
+    }
+
+    void xcomm::init_compression(const py::kwargs& kwargs)
+    {
+        if (kwargs.contains("compression"))
+        {
+            py::object compression = kwargs["compression"];
+            std::vector<std::string> requested;
+            if (py::isinstance<py::str>(compression))
+            {
+                requested.push_back(compression.cast<std::string>());
+            }
+            else if (!compression.is_none())
+            {
+                requested = compression.cast<std::vector<std::string>>();
+            }
+
+            // Codecs that are not part of this build are silently ignored,
+            // buffers are then sent uncompressed.
+            for (const std::string& name : requested)
+            {
+                if (get_buffer_codec(name) != nullptr)
+                {
+                    m_preferred_codecs.push_back(name);
+                }
+            }
+        }
+
+        if (kwargs.contains("compression_threshold"))
+        {
+            m_compression_threshold = kwargs["compression_threshold"].cast<std::size_t>();
+        }
+    }
+
+    void xcomm::init_shared_memory(const py::kwargs& kwargs)
+    {
+        if (!kwargs.contains("shared_memory") || !is_pyobject_true(kwargs["shared_memory"]))
+        {
+            return;
+        }
+
+        std::size_t capacity = kwargs.contains("shm_capacity")
+            ? kwargs["shm_capacity"].cast<std::size_t>()
+            : default_shm_capacity;
+        if (kwargs.contains("shm_threshold"))
+        {
+            m_shm_threshold = kwargs["shm_threshold"].cast<std::size_t>();
+        }
+
+        // When shared memory is not available, the transport is simply not
+        // advertised and buffers are sent inline.
+        p_shm_ring = xshm_ring::create(capacity);
+    }
+
+    void xcomm::add_peer(const std::string& session, const nl::json& metadata)
+    {
+        m_peers.insert(session);
+        auto it = metadata.find(buffer_codecs_key);
+        if (it != metadata.end())
+        {
+            m_peer_codecs[session] = select_buffer_codec(m_preferred_codecs, *it);
+        }
+
+        // Messages are broadcast on iopub, buffers are compressed only if
+        // every peer that talked on the comm can decode them.
+        p_codec = nullptr;
+        if (!m_peer_codecs.empty() && m_peer_codecs.size() == m_peers.size())
+        {
+            p_codec = m_peer_codecs.begin()->second;
+            for (const auto& peer : m_peer_codecs)
+            {
+                if (peer.second != p_codec)
+                {
+                    p_codec = nullptr;
+                    break;
+                }
+            }
+        }
+    }
+
+    bool xcomm::process_transport_metadata(const xeus::xmessage& msg)
+    {
+        const nl::json& metadata = msg.metadata();
+        // Peers and consumers are identified by their session, a
+        // shared-memory buffer is held by the consumers at sending time
+        // until each releases it.
+        std::string session = msg.header().value("session", "");
+        xstate_lock lock(m_state_mutex);
+        add_peer(session, metadata);
+        if (!p_shm_ring)
+        {
+            return false;
+        }
+
+        auto it = metadata.find(buffer_transports_key);
+        if (it != metadata.end() && it->is_array())
+        {
+            if (std::find(it->cbegin(), it->cend(), shm_transport_name) != it->cend())
             {
-                m_close_callback();
+                m_shm_consumers.insert(session);
+            }
+            else if (m_shm_consumers.erase(session) != 0)
+            {
+                p_shm_ring->release_all(session);
+            }
+        }
+
+        auto release_it = metadata.find(buffer_release_key);
+        if (release_it == metadata.end() || !release_it->is_array())
+        {
+            return false;
+        }
+        for (const auto& id : *release_it)
+        {
+            if (id.is_number_unsigned())
+            {
+                p_shm_ring->release(id.get<std::uint64_t>(), session);
+            }
+        }
+        auto data_it = msg.content().find("data");
+        return data_it == msg.content().end() || data_it->empty();
+    }
+
+    void xcomm::encode_buffers(nl::json& metadata, xeus::buffer_sequence& buffers) const
+    {
+        std::set<std::string> consumers;
+        const xbuffer_codec* codec = nullptr;
+        bool use_shm = false;
+        {
+            xstate_lock lock(m_state_mutex);
+            // Messages are broadcast on iopub, buffers are moved to shared
+            // memory only if every peer that talked on the comm reads them
+            // from there.
+            use_shm = p_shm_ring && !m_shm_consumers.empty() && m_shm_consumers.size() == m_peers.size();
+            if (use_shm)
+            {
+                consumers = m_shm_consumers;
+            }
+            codec = p_codec;
+        }
+        if ((codec == nullptr && !use_shm) || buffers.empty())
+        {
+            return;
+        }
+
+        // Buffers moved to shared memory are left empty and therefore not
+        // compressed.
+        nl::json handles;
+        nl::json encodings;
+        auto encode = [&]()
+        {
+            if (use_shm)
+            {
+                handles = write_shm_buffers(*p_shm_ring, buffers, m_shm_threshold, consumers);
+            }
+            if (codec != nullptr)
+            {
+                encodings = compress_buffers(*codec, buffers, m_compression_threshold);
             }
         };
+
+        if (holding_gil())
+        {
+            py::gil_scoped_release release;
+            encode();
+        }
+        else
+        {
+            encode();
+        }
+
+        if (!handles.is_null())
+        {
+            metadata[buffer_handles_key] = std::move(handles);
+        }
+        if (!encodings.is_null())
+        {
+            metadata[buffer_encodings_key] = std::move(encodings);
+        }
+    }
+
+    void xcomm::send_now(nl::json data, nl::json metadata, xeus::buffer_sequence buffers)
+    {
+        encode_buffers(metadata, buffers);
+        m_comm.send(std::move(metadata), std::move(data), std::move(buffers));
     }
 
+    void xcomm::init_conflation(const py::kwargs& kwargs)
+    {
+        m_conflate = kwargs.contains("conflate") && is_pyobject_true(kwargs["conflate"]);
+        if (kwargs.contains("conflate_interval"))
+        {
+            m_conflate_interval = kwargs["conflate_interval"].cast<double>();
+        }
+    }
+
+    bool xcomm::conflate_update(const nl::json& data, const nl::json& metadata)
+    {
+        // Only plain state updates can be merged, updates with binary
+        // buffers are sent as they are.
+        if (!data.is_object() || data.value("method", "") != "update")
+        {
+            return false;
+        }
+        auto state = data.find("state");
+        auto buffer_paths = data.find("buffer_paths");
+        if (state == data.end() || !state->is_object() ||
+            (buffer_paths != data.end() && !buffer_paths->empty()))
+        {
+            return false;
+        }
+
+        // The loop is only called outside of the lock, which does not
+        // protect Python calls. The first update schedules the flush.
+        auto merge = [this, &state, &metadata]()
+        {
+            m_pending_data["state"].update(*state);
+            if (metadata.is_object())
+            {
+                m_pending_metadata.update(metadata);
+            }
+            ++m_conflated_updates;
+            ++m_pending_updates;
+            m_max_pending_updates = std::max(m_max_pending_updates, m_pending_updates);
+        };
+        {
+            // Checked again under the lock, conflation may have been
+            // disabled since the caller checked it
+            xstate_lock lock(m_state_mutex);
+            if (!m_conflate)
+            {
+                return false;
+            }
+            if (m_pending_updates != 0)
+            {
+                merge();
+                return true;
+            }
+        }
+
+        py::object loop;
+        try
+        {
+            loop = get_handle(xhandle::asyncio_get_running_loop)();
+        }
+        catch (py::error_already_set&)
+        {
+            // No loop in this thread to flush the update later
+            return false;
+        }
+
+        py::cpp_function flush([this]()
+        {
+            py::object handle;
+            {
+                xstate_lock flush_lock(m_state_mutex);
+                handle = std::move(m_flush_handle);
+            }
+            flush_pending_update();
+        });
+        py::object handle = loop.attr("call_later")(m_conflate_interval, flush);
+
+        // Another thread may have scheduled a flush, or disabled the
+        // conflation, meanwhile
+        py::object unused;
+        bool conflated = true;
+        {
+            xstate_lock lock(m_state_mutex);
+            if (!m_conflate)
+            {
+                unused = std::move(handle);
+                conflated = false;
+            }
+            else if (m_pending_updates != 0)
+            {
+                merge();
+                unused = std::move(handle);
+            }
+            else
+            {
+                unused = std::move(m_flush_handle);
+                m_flush_handle = std::move(handle);
+                m_pending_data = data;
+                m_pending_metadata = metadata;
+                ++m_pending_updates;
+                m_max_pending_updates = std::max(m_max_pending_updates, m_pending_updates);
+            }
+        }
+        if (unused)
+        {
+            unused.attr("cancel")();
+        }
+        return conflated;
+    }
+
+    void xcomm::flush_pending_update()
+    {
+        nl::json data;
+        nl::json metadata;
+        py::object handle;
+        {
+            xstate_lock lock(m_state_mutex);
+            if (m_pending_updates == 0)
+            {
+                return;
+            }
+
+            handle = std::move(m_flush_handle);
+            m_pending_updates = 0;
+            ++m_sent_updates;
+            data = std::move(m_pending_data);
+            metadata = std::move(m_pending_metadata);
+            m_pending_data = nl::json();
+            m_pending_metadata = nl::json();
+        }
+        // Cancelled and sent outside of the lock, encoding the buffers
+        // takes it
+        if (handle)
+        {
+            handle.attr("cancel")();
+        }
+        send_now(std::move(data), std::move(metadata), xeus::buffer_sequence());
+    }
+
+    py::object xcomm::to_pymessage(const xeus::xmessage& msg) const
+    {
+        if (!msg.metadata().contains(buffer_encodings_key))
+        {
+            return cppmessage_to_pymessage(msg);
+        }
+
+        xeus::buffer_sequence buffers;
+        std::string error;
+        {
+            py::gil_scoped_release release;
+            try
+            {
+                buffers = decompress_buffers(msg.metadata(), msg.buffers());
+            }
+            catch (const std::runtime_error& e)
+            {
+                error = e.what();
+            }
+        }
+        if (!error.empty())
+        {
+            // The handler is not called, the error is reported as if it
+            // had raised it
+            PyErr_SetString(PyExc_ValueError, error.c_str());
+            py::error_already_set e;
+            print_python_error(e);
+            return py::none();
+        }
+        return cppmessage_to_pymessage(msg, buffers);
+    }
+
+    /************************************
+     * xnative_comm_view implementation *
+     ************************************/
+
+    xnative_comm_view::xnative_comm_view(const xeus::xguid& id)
+        : m_id(id)
+    {
+    }
+
+    std::string xnative_comm_view::comm_id() const
+    {
+        return m_id;
+    }
+
+    std::string xnative_comm_view::target_name() const
+    {
+        return comm().target().name();
+    }
+
+    bool xnative_comm_view::kernel() const
+    {
+        return true;
+    }
+
+    bool xnative_comm_view::closed() const
+    {
+        const auto& comms = xeus::get_interpreter().comm_manager().comms();
+        return comms.find(m_id) == comms.end();
+    }
+
+    void xnative_comm_view::close(const py::object& data, const py::object& metadata, const py::object& buffers)
+    {
+        comm().close(metadata, data, pylist_to_cpp_buffers(buffers));
+    }
+
+    void xnative_comm_view::send(const py::object& data, const py::object& metadata, const py::object& buffers)
+    {
+        comm().send(metadata, data, pylist_to_cpp_buffers(buffers));
+    }
+
+    xeus::xcomm& xnative_comm_view::comm() const
+    {
+        const auto& comms = xeus::get_interpreter().comm_manager().comms();
+        auto it = comms.find(m_id);
+        if (it == comms.end())
+        {
+            throw std::runtime_error("comm " + std::string(m_id) + " is closed");
+        }
+        return *(it->second);
+    }
+
+    /********************************
+     * xcomm_manager implementation *
+     ********************************/
+
     void xcomm_manager::register_target(const py::str& target_name, const py::object& callback)
     {
         auto target_callback = [callback] (xeus::xcomm&& comm, const xeus::xmessage& msg)
         {
-            XPYT_HOLDING_GIL(callback(xcomm(std::move(comm)), cppmessage_to_pymessage(msg)));
+            // The comm is owned by its Python wrapper so that the callback
+            // can keep it alive after the comm_open message is handled.
+            auto open_comm = [&callback, &comm, &msg]()
+            {
+                get_hibernation().wake();
+                py::object pycomm = py::cast(new xcomm(std::move(comm)), py::return_value_policy::take_ownership);
+                pycomm.cast<xcomm&>().negotiate_compression(msg);
+                callback(pycomm, cppmessage_to_pymessage(msg));
+                get_hibernation().arm();
+            };
+            XPYT_HOLDING_GIL(open_comm())
         };
 
         xeus::get_interpreter().comm_manager().register_comm_target(
@@ -158,6 +814,32 @@ namespace xpyt
         });
     }
 
+    py::object xcomm_manager::get_comm(const std::string& comm_id) const
+    {
+        // Ensures the NativeComm type is registered in raw mode as well
+        get_comm_module();
+        const auto& comms = xeus::get_interpreter().comm_manager().comms();
+        auto it = comms.find(xeus::xguid(comm_id));
+        if (it == comms.end() || !is_native_comm_target(it->second->target().name()))
+        {
+            return py::none();
+        }
+        return py::cast(xnative_comm_view(it->first));
+    }
+
+    void bind_native_comm(py::module& module)
+    {
+        py::class_<xnative_comm_view>(module, "NativeComm")
+            .def("close", &xnative_comm_view::close, "data"_a=py::dict(), "metadata"_a=py::dict(), "buffers"_a=py::list())
+            .def("send", &xnative_comm_view::send, "data"_a=py::dict(), "metadata"_a=py::dict(), "buffers"_a=py::list())
+            .def_property_readonly("comm_id", &xnative_comm_view::comm_id)
+            .def_property_readonly("target_name", &xnative_comm_view::target_name)
+            .def_property_readonly("kernel", &xnative_comm_view::kernel)
+            .def_property_readonly("closed", &xnative_comm_view::closed);
+
+        module.def("native_targets", &native_comm_targets);
+    }
+
     /***************
      * comm module *
      ***************/
@@ -176,18 +858,32 @@ namespace xpyt
             .def("on_msg", &xcomm::on_msg)
             .def("on_close", &xcomm::on_close)
             .def_property_readonly("comm_id", &xcomm::comm_id)
-            .def_property_readonly("kernel", &xcomm::kernel);
+            .def_property_readonly("kernel", &xcomm::kernel)
+            .def_property_readonly("compression", &xcomm::compression)
+            .def_property_readonly("shared_memory", &xcomm::shared_memory)
+            .def_property_readonly("conflation_stats", &xcomm::conflation_stats)
+            .def_property("conflate", &xcomm::conflate, &xcomm::set_conflate)
+            .def_property("max_concurrency", &xcomm::max_concurrency, &xcomm::set_max_concurrency)
+            .def_property("ordered", &xcomm::ordered, &xcomm::set_ordered);
 
         py::class_<xcomm_manager>(comm_module, "CommManager")
             .def(py::init<>())
             .def("register_target", &xcomm_manager::register_target)
-            .def("register_comm", &xcomm_manager::register_comm);
+            .def("register_comm", &xcomm_manager::register_comm)
+            .def("get_comm", &xcomm_manager::get_comm);
+
+        bind_native_comm(comm_module);
+        bind_handler_dispatcher(comm_module);
 
         comm_module.def("get_comm_manager", [&comm_module]() {
             static py::object comm_manager = comm_module.attr("CommManager")();
             return comm_manager;
         });
 
+        comm_module.def("available_buffer_codecs", []() {
+            return available_buffer_codecs();
+        });
+
         comm_module.def("create_comm", [&comm_module](py::args objs, py::kwargs kw) {
             py::object comm = comm_module.attr("Comm")(*objs, **kw);
             comm_module.attr("get_comm_manager")().attr("register_comm")(comm);
@@ -11,18 +11,34 @@
 #ifndef XPYT_COMM_HPP
 #define XPYT_COMM_HPP
 
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xcomm.hpp"
+
 #include "pybind11/pybind11.h"
 
+#include "xshm_ring.hpp"
+#include "xthreading.hpp"
+
 namespace py = pybind11;
+namespace nl = nlohmann;
 
 namespace xpyt
 {
+    class xbuffer_codec;
+
     class xcomm
     {
     public:
 
         using close_callback_type = std::function<void()>;
-        using python_callback_type = std::function<void(py::object)>;
         using cpp_callback_type = std::function<void(const xeus::xmessage&)>;
         using buffers_sequence = xeus::buffer_sequence;
 
@@ -32,18 +48,39 @@ namespace xpyt
         xcomm& operator=(xcomm&& rhs) = delete;
         xcomm(const xcomm&) = delete;
         xcomm& operator=(xcomm& rhs) = delete;
-        ~xcomm() = default;
+        ~xcomm();
 
         std::string comm_id() const;
         bool kernel() const;
+        py::object compression() const;
+        py::object shared_memory() const;
+
+        bool conflate() const;
+        void set_conflate(bool value);
+        py::dict conflation_stats() const;
+
+        py::object max_concurrency() const;
+        void set_max_concurrency(const py::object& value);
+        bool ordered() const;
+        void set_ordered(bool value);
 
         void close(const py::object& data, const py::object& metadata, const py::object& buffers);
         void send(const py::object& data, const py::object& metadata, const py::object& buffers);
-        void on_msg(const python_callback_type& callback);
-        void on_close(const python_callback_type& callback);
+
+        // Handlers can be plain functions or coroutine functions. Awaitables
+        // returned by a handler are scheduled as tasks on the asyncio loop of
+        // the shell, with at most max_concurrency tasks running at the same
+        // time for this comm, or one at a time when ordered is true.
+        void on_msg(const py::object& callback);
+        void on_close(const py::object& callback);
 
         void on_close_cleanup(close_callback_type callback);
 
+        // Records the peer which sent the message and enables the
+        // compression of outbound buffers if every peer accepted the same
+        // codec among the ones this comm is willing to use.
+        void negotiate_compression(const xeus::xmessage& msg);
+
     private:
 
         // Warning: this function creates and register the target with a dummy
@@ -51,11 +88,89 @@ namespace xpyt
         // has the same behavior as ipykernel.
         const xeus::xtarget* target(const py::object& target_name) const;
         xeus::xguid id(const py::kwargs& kwargs) const;
-        cpp_callback_type cpp_callback(const python_callback_type& callback) const;
-        cpp_callback_type cpp_close_callback(const python_callback_type& callback) const;
+        cpp_callback_type cpp_callback(const py::object& callback);
+        cpp_callback_type cpp_close_callback(const py::object& callback);
+
+        void init_dispatcher(const py::kwargs& kwargs);
+        bool dispatch(const py::object& result, const py::object& done_callback = py::none());
+
+        void init_compression(const py::kwargs& kwargs);
+        // Requires m_state_mutex
+        void add_peer(const std::string& session, const nl::json& metadata);
+        void init_shared_memory(const py::kwargs& kwargs);
+
+        // Handles the transport negotiation and the release of shared-memory
+        // buffers. Returns true if the message only carries transport
+        // information and must not be forwarded to the handlers.
+        bool process_transport_metadata(const xeus::xmessage& msg);
+
+        void encode_buffers(nl::json& metadata, xeus::buffer_sequence& buffers) const;
+        void send_now(nl::json data, nl::json metadata, xeus::buffer_sequence buffers);
+
+        // State updates sent while others are pending are merged into the
+        // pending one, which is sent by a callback scheduled on the running
+        // asyncio loop. Returns false if the update cannot be conflated.
+        void init_conflation(const py::kwargs& kwargs);
+        bool conflate_update(const nl::json& data, const nl::json& metadata);
+        void flush_pending_update();
+        // Returns None, after printing a ValueError, if the buffers cannot
+        // be decoded.
+        py::object to_pymessage(const xeus::xmessage& msg) const;
 
         xeus::xcomm m_comm;
         close_callback_type m_close_callback;
+
+        std::vector<std::string> m_preferred_codecs;
+        std::size_t m_compression_threshold;
+        const xbuffer_codec* p_codec;
+
+        std::unique_ptr<xshm_ring> p_shm_ring;
+        std::size_t m_shm_threshold;
+        std::set<std::string> m_shm_consumers;
+        // Sessions of the peers which sent a message on the comm, and
+        // codec accepted by the ones which advertised their codecs
+        std::set<std::string> m_peers;
+        std::map<std::string, const xbuffer_codec*> m_peer_codecs;
+
+        py::object m_dispatcher;
+
+        bool m_conflate;
+        double m_conflate_interval;
+        nl::json m_pending_data;
+        nl::json m_pending_metadata;
+        py::object m_flush_handle;
+        std::size_t m_pending_updates;
+        std::size_t m_max_pending_updates;
+        std::size_t m_conflated_updates;
+        std::size_t m_sent_updates;
+
+        // Transport negotiation and conflation state, updated by the comm
+        // handlers and by the threads sending messages.
+        mutable xstate_mutex m_state_mutex;
+    };
+
+    // Python view on a comm of a native target. The comm is owned by the
+    // C++ code that handles it, the view only holds its id and raises once
+    // the comm has been closed.
+    class xnative_comm_view
+    {
+    public:
+
+        explicit xnative_comm_view(const xeus::xguid& id);
+
+        std::string comm_id() const;
+        std::string target_name() const;
+        bool kernel() const;
+        bool closed() const;
+
+        void close(const py::object& data, const py::object& metadata, const py::object& buffers);
+        void send(const py::object& data, const py::object& metadata, const py::object& buffers);
+
+    private:
+
+        xeus::xcomm& comm() const;
+
+        xeus::xguid m_id;
     };
 
     struct xcomm_manager
@@ -64,8 +179,19 @@ namespace xpyt
 
         void register_target(const py::str& target_name, const py::object& callback);
         void register_comm(py::object comm);
+
+        // Returns a NativeComm if comm_id is the id of a comm opened on a
+        // native target, None otherwise.
+        py::object get_comm(const std::string& comm_id) const;
     };
 
+    void bind_native_comm(py::module& module);
+
+    // Makes the creation of comms raise a RuntimeError with the given
+    // reason, for an interpreter which is not served by a kernel and
+    // cannot publish comm messages. Requires the GIL.
+    void disable_comms(const std::string& reason);
+
     py::module get_comm_module();
 
 }
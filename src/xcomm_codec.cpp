@@ -0,0 +1,331 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#ifdef XPYT_WITH_ZSTD
+#include "zstd.h"
+#endif
+
+#ifdef XPYT_WITH_LZ4
+#include "lz4frame.h"
+#endif
+
+#include "xcomm_codec.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /********************************
+     * xbuffer_codec implementation *
+     ********************************/
+
+    xbuffer_codec::xbuffer_codec(std::string name)
+        : m_name(std::move(name))
+    {
+    }
+
+    const std::string& xbuffer_codec::name() const
+    {
+        return m_name;
+    }
+
+    xeus::binary_buffer xbuffer_codec::compress(const xeus::binary_buffer& buffer) const
+    {
+        return compress_impl(buffer);
+    }
+
+    xeus::binary_buffer xbuffer_codec::decompress(const xeus::binary_buffer& buffer) const
+    {
+        return decompress_impl(buffer);
+    }
+
+    namespace
+    {
+#ifdef XPYT_WITH_ZSTD
+        /**************
+         * zstd codec *
+         **************/
+
+        class xzstd_codec final : public xbuffer_codec
+        {
+        public:
+
+            xzstd_codec()
+                : xbuffer_codec("zstd")
+            {
+            }
+
+        private:
+
+            // Level 1 favors speed: the goal is to reduce the size on the
+            // wire without making the kernel slower to answer.
+            static constexpr int compression_level = 1;
+
+            xeus::binary_buffer compress_impl(const xeus::binary_buffer& buffer) const override
+            {
+                std::size_t bound = ZSTD_compressBound(buffer.size());
+                xeus::binary_buffer res(bound);
+                std::size_t size = ZSTD_compress(res.data(), bound, buffer.data(), buffer.size(), compression_level);
+                if (ZSTD_isError(size))
+                {
+                    throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(size));
+                }
+                res.resize(size);
+                return res;
+            }
+
+            xeus::binary_buffer decompress_impl(const xeus::binary_buffer& buffer) const override
+            {
+                unsigned long long content_size = ZSTD_getFrameContentSize(buffer.data(), buffer.size());
+                if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN)
+                {
+                    throw std::runtime_error("zstd decompression failed: invalid frame header");
+                }
+                if (content_size > max_decompressed_size)
+                {
+                    throw std::runtime_error("zstd decompression failed: content too large");
+                }
+                xeus::binary_buffer res(static_cast<std::size_t>(content_size));
+                std::size_t size = ZSTD_decompress(res.data(), res.size(), buffer.data(), buffer.size());
+                if (ZSTD_isError(size))
+                {
+                    throw std::runtime_error(std::string("zstd decompression failed: ") + ZSTD_getErrorName(size));
+                }
+                res.resize(size);
+                return res;
+            }
+        };
+#endif
+
+#ifdef XPYT_WITH_LZ4
+        /*************
+         * lz4 codec *
+         *************/
+
+        // The frame format is used instead of the block format so that the
+        // frontend can decode buffers with any standard lz4 library.
+        class xlz4_codec final : public xbuffer_codec
+        {
+        public:
+
+            xlz4_codec()
+                : xbuffer_codec("lz4")
+            {
+            }
+
+        private:
+
+            xeus::binary_buffer compress_impl(const xeus::binary_buffer& buffer) const override
+            {
+                LZ4F_preferences_t preferences;
+                std::memset(&preferences, 0, sizeof(preferences));
+                preferences.frameInfo.contentSize = buffer.size();
+
+                std::size_t bound = LZ4F_compressFrameBound(buffer.size(), &preferences);
+                xeus::binary_buffer res(bound);
+                std::size_t size = LZ4F_compressFrame(res.data(), bound, buffer.data(), buffer.size(), &preferences);
+                if (LZ4F_isError(size))
+                {
+                    throw std::runtime_error(std::string("lz4 compression failed: ") + LZ4F_getErrorName(size));
+                }
+                res.resize(size);
+                return res;
+            }
+
+            xeus::binary_buffer decompress_impl(const xeus::binary_buffer& buffer) const override
+            {
+                LZ4F_dctx* dctx = nullptr;
+                LZ4F_errorCode_t err = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+                if (LZ4F_isError(err))
+                {
+                    throw std::runtime_error(std::string("lz4 decompression failed: ") + LZ4F_getErrorName(err));
+                }
+                std::unique_ptr<LZ4F_dctx, decltype(&LZ4F_freeDecompressionContext)> guard(dctx, &LZ4F_freeDecompressionContext);
+
+                const char* src = buffer.data();
+                std::size_t remaining = buffer.size();
+
+                LZ4F_frameInfo_t frame_info;
+                std::size_t consumed = remaining;
+                std::size_t hint = LZ4F_getFrameInfo(dctx, &frame_info, src, &consumed);
+                if (LZ4F_isError(hint))
+                {
+                    throw std::runtime_error(std::string("lz4 decompression failed: ") + LZ4F_getErrorName(hint));
+                }
+                src += consumed;
+                remaining -= consumed;
+
+                if (frame_info.contentSize > max_decompressed_size)
+                {
+                    throw std::runtime_error("lz4 decompression failed: content too large");
+                }
+
+                xeus::binary_buffer res;
+                res.reserve(static_cast<std::size_t>(frame_info.contentSize));
+                xeus::binary_buffer chunk(64 * 1024);
+                while (hint != 0)
+                {
+                    std::size_t dst_size = chunk.size();
+                    std::size_t src_size = remaining;
+                    hint = LZ4F_decompress(dctx, chunk.data(), &dst_size, src, &src_size, nullptr);
+                    if (LZ4F_isError(hint))
+                    {
+                        throw std::runtime_error(std::string("lz4 decompression failed: ") + LZ4F_getErrorName(hint));
+                    }
+                    if (hint != 0 && dst_size == 0 && src_size == 0)
+                    {
+                        throw std::runtime_error("lz4 decompression failed: truncated frame");
+                    }
+                    // The content size is optional in the frame header
+                    if (res.size() + dst_size > max_decompressed_size)
+                    {
+                        throw std::runtime_error("lz4 decompression failed: content too large");
+                    }
+                    res.insert(res.end(), chunk.data(), chunk.data() + dst_size);
+                    src += src_size;
+                    remaining -= src_size;
+                }
+                return res;
+            }
+        };
+#endif
+
+        using codec_list = std::vector<std::unique_ptr<xbuffer_codec>>;
+
+        const codec_list& get_codec_list()
+        {
+            static const codec_list codecs = []()
+            {
+                codec_list res;
+#ifdef XPYT_WITH_ZSTD
+                res.push_back(std::make_unique<xzstd_codec>());
+#endif
+#ifdef XPYT_WITH_LZ4
+                res.push_back(std::make_unique<xlz4_codec>());
+#endif
+                return res;
+            }();
+            return codecs;
+        }
+    }
+
+    const std::vector<std::string>& available_buffer_codecs()
+    {
+        static const std::vector<std::string> names = []()
+        {
+            std::vector<std::string> res;
+            for (const auto& codec : get_codec_list())
+            {
+                res.push_back(codec->name());
+            }
+            return res;
+        }();
+        return names;
+    }
+
+    const xbuffer_codec* get_buffer_codec(const std::string& name)
+    {
+        const codec_list& codecs = get_codec_list();
+        auto it = std::find_if(codecs.cbegin(), codecs.cend(), [&name](const auto& codec)
+        {
+            return codec->name() == name;
+        });
+        return it != codecs.cend() ? it->get() : nullptr;
+    }
+
+    const xbuffer_codec* select_buffer_codec(const std::vector<std::string>& preferred,
+                                             const nl::json& accepted)
+    {
+        if (!accepted.is_array())
+        {
+            return nullptr;
+        }
+
+        for (const std::string& name : preferred)
+        {
+            auto it = std::find(accepted.cbegin(), accepted.cend(), name);
+            if (it != accepted.cend())
+            {
+                if (const xbuffer_codec* codec = get_buffer_codec(name))
+                {
+                    return codec;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    nl::json compress_buffers(const xbuffer_codec& codec,
+                              xeus::buffer_sequence& buffers,
+                              std::size_t threshold)
+    {
+        nl::json encodings(buffers.size(), nullptr);
+        bool compressed = false;
+        for (std::size_t i = 0; i < buffers.size(); ++i)
+        {
+            if (buffers[i].size() < threshold)
+            {
+                continue;
+            }
+            xeus::binary_buffer res = codec.compress(buffers[i]);
+            // Incompressible payloads (already compressed images for
+            // instance) are sent as they are.
+            if (res.size() < buffers[i].size())
+            {
+                buffers[i] = std::move(res);
+                encodings[i] = codec.name();
+                compressed = true;
+            }
+        }
+        return compressed ? encodings : nl::json();
+    }
+
+    xeus::buffer_sequence decompress_buffers(const nl::json& metadata,
+                                             const xeus::buffer_sequence& buffers)
+    {
+        auto it = metadata.find(buffer_encodings_key);
+        if (it == metadata.end() || !it->is_array())
+        {
+            return buffers;
+        }
+
+        const nl::json& encodings = *it;
+        xeus::buffer_sequence res;
+        res.reserve(buffers.size());
+        for (std::size_t i = 0; i < buffers.size(); ++i)
+        {
+            if (i < encodings.size() && encodings[i].is_string())
+            {
+                const std::string name = encodings[i].get<std::string>();
+                const xbuffer_codec* codec = get_buffer_codec(name);
+                if (codec == nullptr)
+                {
+                    throw std::runtime_error("cannot decode comm buffer: codec " + name + " is not available");
+                }
+                res.push_back(codec->decompress(buffers[i]));
+            }
+            else
+            {
+                res.push_back(buffers[i]);
+            }
+        }
+        return res;
+    }
+}
@@ -0,0 +1,100 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_COMM_CODEC_HPP
+#define XPYT_COMM_CODEC_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xcomm.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Metadata keys used to negotiate the compression of comm buffers.
+     *
+     * - buffer_codecs: list of codec names a peer is able to decode, sent
+     *   by the kernel in comm_open and by the frontend in any comm message.
+     * - buffer_encodings: list with one entry per buffer of the message,
+     *   holding the codec name used for that buffer, or null when the
+     *   buffer is sent uncompressed.
+     */
+    constexpr const char* buffer_codecs_key = "buffer_codecs";
+    constexpr const char* buffer_encodings_key = "buffer_encodings";
+
+    // Buffers smaller than this are never worth compressing.
+    constexpr std::size_t default_compression_threshold = 64 * 1024;
+
+    // Buffers are decoded in memory, a frame announcing a larger content
+    // is rejected instead of being allocated.
+    constexpr std::size_t max_decompressed_size = std::size_t(1) << 30;
+
+    class xbuffer_codec
+    {
+    public:
+
+        virtual ~xbuffer_codec() = default;
+
+        xbuffer_codec(const xbuffer_codec&) = delete;
+        xbuffer_codec& operator=(const xbuffer_codec&) = delete;
+        xbuffer_codec(xbuffer_codec&&) = delete;
+        xbuffer_codec& operator=(xbuffer_codec&&) = delete;
+
+        const std::string& name() const;
+
+        xeus::binary_buffer compress(const xeus::binary_buffer& buffer) const;
+        xeus::binary_buffer decompress(const xeus::binary_buffer& buffer) const;
+
+    protected:
+
+        explicit xbuffer_codec(std::string name);
+
+    private:
+
+        virtual xeus::binary_buffer compress_impl(const xeus::binary_buffer& buffer) const = 0;
+        virtual xeus::binary_buffer decompress_impl(const xeus::binary_buffer& buffer) const = 0;
+
+        std::string m_name;
+    };
+
+    // Names of the codecs compiled in this build, by order of preference.
+    const std::vector<std::string>& available_buffer_codecs();
+
+    // Returns nullptr if the codec is unknown or not available in this build.
+    const xbuffer_codec* get_buffer_codec(const std::string& name);
+
+    // Picks the first codec of preferred that is also listed in accepted.
+    // Returns nullptr if there is none.
+    const xbuffer_codec* select_buffer_codec(const std::vector<std::string>& preferred,
+                                             const nl::json& accepted);
+
+    // Compresses in place, one after the other, the buffers whose size is
+    // above threshold. This does not touch any Python object and can be
+    // called with the GIL released. Returns the buffer_encodings annotation, or null if no
+    // buffer has been compressed.
+    nl::json compress_buffers(const xbuffer_codec& codec,
+                              xeus::buffer_sequence& buffers,
+                              std::size_t threshold);
+
+    // Returns the decoded buffers according to the buffer_encodings
+    // annotation of the message metadata. Throws std::runtime_error if a
+    // buffer has been encoded with an unavailable codec, is corrupted, or
+    // decodes to more than max_decompressed_size bytes.
+    xeus::buffer_sequence decompress_buffers(const nl::json& metadata,
+                                             const xeus::buffer_sequence& buffers);
+}
+
+#endif
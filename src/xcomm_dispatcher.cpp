@@ -0,0 +1,219 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <utility>
+
+#include "pybind11/pybind11.h"
+
+#include "xcomm_dispatcher.hpp"
+#include "xhandles.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    namespace
+    {
+        std::size_t to_limit(const py::object& max_concurrency)
+        {
+            if (max_concurrency.is_none())
+            {
+                return 0;
+            }
+            long long limit = max_concurrency.cast<long long>();
+            if (limit < 1)
+            {
+                throw py::value_error("max_concurrency must be None or a positive integer");
+            }
+            return static_cast<std::size_t>(limit);
+        }
+
+        void print_exception(const py::handle& type, const py::handle& value, const py::handle& trace)
+        {
+            py::module::import("traceback").attr("print_exception")(type, value, trace);
+        }
+    }
+
+    xhandler_dispatcher::xhandler_dispatcher(const py::object& max_concurrency, bool ordered)
+        : m_max_concurrency(to_limit(max_concurrency))
+        , m_ordered(ordered)
+        , m_running(0)
+    {
+    }
+
+    py::object xhandler_dispatcher::max_concurrency() const
+    {
+        std::size_t limit = 0;
+        {
+            xstate_lock lock(m_mutex);
+            limit = m_max_concurrency;
+        }
+        return limit == 0 ? py::object(py::none()) : py::object(py::int_(limit));
+    }
+
+    void xhandler_dispatcher::set_max_concurrency(const py::object& value)
+    {
+        std::size_t limit = to_limit(value);
+        {
+            xstate_lock lock(m_mutex);
+            m_max_concurrency = limit;
+        }
+        pump();
+    }
+
+    bool xhandler_dispatcher::ordered() const
+    {
+        xstate_lock lock(m_mutex);
+        return m_ordered;
+    }
+
+    void xhandler_dispatcher::set_ordered(bool value)
+    {
+        {
+            xstate_lock lock(m_mutex);
+            m_ordered = value;
+        }
+        pump();
+    }
+
+    void xhandler_dispatcher::submit(const py::object& awaitable, const py::object& done_callback)
+    {
+        {
+            xstate_lock lock(m_mutex);
+            m_pending.emplace_back(awaitable, done_callback);
+        }
+        pump();
+    }
+
+    bool xhandler_dispatcher::pop_runnable(item_type& item)
+    {
+        std::size_t limit = m_ordered ? 1 : m_max_concurrency;
+        if (m_pending.empty() || (limit != 0 && m_running >= limit))
+        {
+            return false;
+        }
+        item = std::move(m_pending.front());
+        m_pending.pop_front();
+        ++m_running;
+        return true;
+    }
+
+    void xhandler_dispatcher::pump()
+    {
+        try
+        {
+            get_handle(xhandle::asyncio_get_running_loop)();
+        }
+        catch (py::error_already_set& e)
+        {
+            if (!e.matches(PyExc_RuntimeError))
+            {
+                throw;
+            }
+            run_in_place();
+            return;
+        }
+
+        py::object self = py::cast(this, py::return_value_policy::reference);
+        while (true)
+        {
+            // Declared in the loop so that the assignment under the lock
+            // does not release a previous item
+            item_type item;
+            {
+                xstate_lock lock(m_mutex);
+                if (!pop_runnable(item))
+                {
+                    return;
+                }
+            }
+            py::object task = get_handle(xhandle::asyncio_ensure_future)(item.first);
+            m_tasks.add(task);
+            py::object done_callback = std::move(item.second);
+            task.attr("add_done_callback")(py::cpp_function([self, done_callback](const py::object& done_task)
+            {
+                self.cast<xhandler_dispatcher&>().on_done(done_callback, done_task);
+            }));
+        }
+    }
+
+    void xhandler_dispatcher::run_in_place()
+    {
+        while (true)
+        {
+            item_type item;
+            {
+                xstate_lock lock(m_mutex);
+                if (m_pending.empty())
+                {
+                    return;
+                }
+                item = std::move(m_pending.front());
+                m_pending.pop_front();
+            }
+
+            py::object loop = py::module::import("asyncio").attr("new_event_loop")();
+            auto finish = [&loop, &item]()
+            {
+                loop.attr("close")();
+                if (!item.second.is_none())
+                {
+                    item.second();
+                }
+            };
+            try
+            {
+                loop.attr("run_until_complete")(item.first);
+            }
+            catch (py::error_already_set& e)
+            {
+                if (!e.matches(PyExc_Exception))
+                {
+                    finish();
+                    throw;
+                }
+                print_exception(e.type(), e.value(), e.trace());
+            }
+            finish();
+        }
+    }
+
+    void xhandler_dispatcher::on_done(const py::object& done_callback, const py::object& task)
+    {
+        PySet_Discard(m_tasks.ptr(), task.ptr());
+        {
+            xstate_lock lock(m_mutex);
+            --m_running;
+        }
+        if (!task.attr("cancelled")().cast<bool>())
+        {
+            py::object exc = task.attr("exception")();
+            if (!exc.is_none())
+            {
+                print_exception(exc.attr("__class__"), exc, exc.attr("__traceback__"));
+            }
+        }
+        if (!done_callback.is_none())
+        {
+            done_callback();
+        }
+        pump();
+    }
+
+    void bind_handler_dispatcher(py::module& module)
+    {
+        py::class_<xhandler_dispatcher>(module, "HandlerDispatcher")
+            .def(py::init<const py::object&, bool>(), py::arg("max_concurrency") = py::none(), py::arg("ordered") = false)
+            .def("submit", &xhandler_dispatcher::submit, py::arg("awaitable"), py::arg("done_callback") = py::none())
+            .def_property("max_concurrency", &xhandler_dispatcher::max_concurrency, &xhandler_dispatcher::set_max_concurrency)
+            .def_property("ordered", &xhandler_dispatcher::ordered, &xhandler_dispatcher::set_ordered);
+    }
+}
@@ -0,0 +1,79 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_COMM_DISPATCHER_HPP
+#define XPYT_COMM_DISPATCHER_HPP
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+#include "pybind11/pybind11.h"
+
+#include "xthreading.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    /**
+     * Runs the awaitables returned by the handlers of a comm.
+     *
+     * The tasks are created on the running loop, which is the one of the
+     * asyncio shell runner. When there is no running loop, the awaitables
+     * are run to completion in place, one after the other. Errors raised
+     * by the awaitables are printed, like the ones of plain handlers.
+     *
+     * Instances are created from Python (see bind_handler_dispatcher) so
+     * that the tasks keep their dispatcher alive after the comm is gone.
+     */
+    class xhandler_dispatcher
+    {
+    public:
+
+        // max_concurrency is None, for no limit, or a positive integer.
+        xhandler_dispatcher(const py::object& max_concurrency, bool ordered);
+
+        py::object max_concurrency() const;
+        void set_max_concurrency(const py::object& value);
+        bool ordered() const;
+        void set_ordered(bool value);
+
+        // Requires the GIL
+        void submit(const py::object& awaitable, const py::object& done_callback);
+
+    private:
+
+        using item_type = std::pair<py::object, py::object>;
+
+        // Returns false when no task can be started, otherwise pops the
+        // next item and counts it as running. Requires m_mutex.
+        bool pop_runnable(item_type& item);
+
+        void pump();
+        void run_in_place();
+        void on_done(const py::object& done_callback, const py::object& task);
+
+        // 0 when there is no limit
+        std::size_t m_max_concurrency;
+        bool m_ordered;
+        std::deque<item_type> m_pending;
+        std::size_t m_running;
+        // Strong references to the running tasks, the loop only keeps weak
+        // ones.
+        py::set m_tasks;
+        mutable xstate_mutex m_mutex;
+    };
+
+    // Binds HandlerDispatcher in the comm module.
+    void bind_handler_dispatcher(py::module& module);
+}
+
+#endif
@@ -29,6 +29,7 @@
 
 #include "xeus-python/xdebugger.hpp"
 #include "xeus-python/xutils.hpp"
+#include "xcode_cache.hpp"
 #include "xdebugpy_client.hpp"
 #include "xinternal_utils.hpp"
 
@@ -120,7 +121,7 @@ namespace xpyt
             std::string code = "from IPython import get_ipython;";
             code += var_repr_data + ',' + var_repr_metadata + "= get_ipython().display_formatter.format(" + var_name + ")";
             py::gil_scoped_acquire acquire;
-            exec(py::str(code));
+            exec_snippet(py::str(code));
         }
         else
         {
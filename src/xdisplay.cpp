@@ -26,7 +26,10 @@
 #include "xeus-python/xutils.hpp"
 
 #include "xdisplay.hpp"
+#include "xexecution_timing.hpp"
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
+#include "xjson.hpp"
 
 #ifdef __GNUC__
     #pragma GCC diagnostic push
@@ -48,19 +51,15 @@ namespace xpyt_ipython
         auto& interp = xeus::get_interpreter();
 
         // Make sure transient is not None
-        py::object transient_ = transient;
-        if (transient_.is_none())
-        {
-            transient_ = py::dict();
-        }
+        nl::json cpp_transient = xpyt::pyobject_to_json_object(transient);
 
         if (update)
         {
-            interp.update_display_data(data, metadata, transient_);
+            interp.update_display_data(xpyt::pyobject_to_json(data), xpyt::pyobject_to_json(metadata), std::move(cpp_transient));
         }
         else
         {
-            interp.display_data(data, metadata, transient_);
+            interp.display_data(xpyt::pyobject_to_json(data), xpyt::pyobject_to_json(metadata), std::move(cpp_transient));
         }
     }
 
@@ -70,12 +69,13 @@ namespace xpyt_ipython
 
     void xpublish_execution_result(const py::int_& execution_count, const py::object& data, const py::object& metadata)
     {
+        xpyt::xnested_phase phase(xpyt::xphase::display_hook);
         auto& interp = xeus::get_interpreter();
 
-        nl::json cpp_data = data;
+        nl::json cpp_data = xpyt::pyobject_to_json(data);
         if (cpp_data.size() != 0)
         {
-            interp.publish_execution_result(execution_count, std::move(cpp_data), metadata);
+            interp.publish_execution_result(execution_count, std::move(cpp_data), xpyt::pyobject_to_json(metadata));
         }
     }
 
@@ -177,8 +177,7 @@ namespace xpyt_raw
 
     py::tuple mime_bundle_repr(const py::object& obj, const std::vector<std::string>& include = {}, const std::vector<std::string>& exclude = {})
     {
-        py::module py_json = py::module::import("json");
-        py::module builtins = py::module::import("builtins");
+        py::object builtins = xpyt::get_handle(xpyt::xhandle::builtins);
         py::dict pub_data;
         py::dict pub_metadata;
 
@@ -243,6 +242,7 @@ namespace xpyt_raw
 
     void xdisplayhook::operator()(const py::object& obj, bool raw = false) const
     {
+        xpyt::xnested_phase phase(xpyt::xphase::display_hook);
         auto& interp = xeus::get_interpreter();
 
         if (!obj.is_none())
@@ -266,7 +266,7 @@ namespace xpyt_raw
                 pub_metadata = repr[1];
             }
 
-            interp.publish_execution_result(m_execution_count, pub_data, pub_metadata);
+            interp.publish_execution_result(m_execution_count, xpyt::pyobject_to_json(pub_data), xpyt::pyobject_to_json(pub_metadata));
         }
     }
 
@@ -310,7 +310,7 @@ namespace xpyt_raw
                 }
                 pub_metadata.attr("update")(metadata);
 
-                nl::json cpp_transient = transient.is_none() ? nl::json::object() : nl::json(transient);
+                nl::json cpp_transient = xpyt::pyobject_to_json_object(transient);
 
                 if (!display_id.is_none())
                 {
@@ -318,11 +318,11 @@ namespace xpyt_raw
                 }
                 if (update)
                 {
-                    interp.update_display_data(pub_data, pub_metadata, std::move(cpp_transient));
+                    interp.update_display_data(xpyt::pyobject_to_json(pub_data), xpyt::pyobject_to_json(pub_metadata), std::move(cpp_transient));
                 }
                 else
                 {
-                    interp.display_data(pub_data, pub_metadata, std::move(cpp_transient));
+                    interp.display_data(xpyt::pyobject_to_json(pub_data), xpyt::pyobject_to_json(pub_metadata), std::move(cpp_transient));
                 }
             }
         }
@@ -356,7 +356,7 @@ namespace xpyt_raw
     {
         auto& interp = xeus::get_interpreter();
 
-        interp.display_data(data, metadata, transient);
+        interp.display_data(xpyt::pyobject_to_json(data), xpyt::pyobject_to_json(metadata), xpyt::pyobject_to_json(transient));
     }
 
     void xdisplay_mimetype(const std::string& mimetype, py::args objs, py::kwargs kw)
@@ -480,9 +480,7 @@ namespace xpyt_raw
     xdisplay_object::xdisplay_object(const py::object& data, const py::object& url, const py::object& filename, const py::object& metadata, const std::string& read_flag)
         : m_data(data), m_url(url), m_filename(filename), m_metadata(metadata), m_read_flag(read_flag)
     {
-        py::module pathlib = py::module::import("pathlib");
-
-        if (py::isinstance(data, py::make_tuple(pathlib.attr("Path"), pathlib.attr("PurePath"))))
+        if (py::isinstance(data, xpyt::get_handle(xpyt::xhandle::path_types)))
         {
             m_data = py::str(data);
         }
@@ -512,15 +510,13 @@ namespace xpyt_raw
 
     py::object xdisplay_object::data_and_metadata() const
     {
-        py::module copy = py::module::import("copy");
-
         if (m_metadata.is_none())
         {
             return m_data;
         }
         else
         {
-            return py::make_tuple(m_data, copy.attr("deepcopy")(m_metadata));
+            return py::make_tuple(m_data, xpyt::get_handle(xpyt::xhandle::copy_deepcopy)(m_metadata));
         }
     }
 
@@ -546,7 +542,7 @@ namespace xpyt_raw
 
     void xdisplay_object::reload()
     {
-        py::module builtins = py::module::import("builtins");
+        py::object builtins = xpyt::get_handle(xpyt::xhandle::builtins);
 
         if (!m_filename.is_none())
         {
@@ -793,8 +789,6 @@ namespace xpyt_raw
 
     py::object xmath::repr_latex()
     {
-        py::module copy = py::module::import("copy");
-
         std::ostringstream string_stream;
         string_stream << R"($\displaystyle )" << get_data().attr("strip")("$").cast<std::string>() << "$";
         py::str s = py::str(string_stream.str());
@@ -805,7 +799,7 @@ namespace xpyt_raw
         }
         else
         {
-            return py::make_tuple(s, copy.attr("deepcopy")(get_metadata()));
+            return py::make_tuple(s, xpyt::get_handle(xpyt::xhandle::copy_deepcopy)(get_metadata()));
         }
     }
 
@@ -935,9 +929,7 @@ namespace xpyt_raw
 
     void xjson::set_data(const py::object& data)
     {
-        py::module pathlib = py::module::import("pathlib");
-
-        if (py::isinstance(data, py::make_tuple(pathlib.attr("Path"), pathlib.attr("PurePath"))))
+        if (py::isinstance(data, xpyt::get_handle(xpyt::xhandle::path_types)))
         {
             xdisplay_object::set_data(py::str(data));
             return;
@@ -945,9 +937,7 @@ namespace xpyt_raw
 
         if (py::isinstance<py::str>(data))
         {
-            py::module json = py::module::import("json");
-
-            xdisplay_object::set_data(json.attr("loads")(data));
+            xdisplay_object::set_data(xpyt::get_handle(xpyt::xhandle::json_loads)(data));
             return;
         }
 
@@ -1136,12 +1126,11 @@ namespace xpyt_raw
 
     py::object pngxy(const py::object& data)
     {
-        py::module builtins = py::module::import("builtins");
-        py::module struct_module = py::module::import("struct");
+        py::object builtins = xpyt::get_handle(xpyt::xhandle::builtins);
 
         std::size_t ihdr = data.attr("index")(builtins.attr("bytes")("IHDR", "UTF8")).cast<std::size_t>();
 
-        return struct_module.attr("unpack")(">ii", data[builtins.attr("slice")(ihdr + 4, ihdr + 12)]);
+        return xpyt::get_handle(xpyt::xhandle::struct_unpack)(">ii", data[builtins.attr("slice")(ihdr + 4, ihdr + 12)]);
     }
 
     /******************
@@ -0,0 +1,246 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xexecution_timing.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        using clock_type = xexecution_timer::clock_type;
+
+        // Time point of the last shell wake-up, 0 when the shell loop is
+        // not handling messages.
+        std::atomic<clock_type::rep> shell_wakeup{0};
+        std::atomic<bool> timing_enabled{false};
+
+        // Per thread, requests handled concurrently by other threads (free
+        // threaded builds) must not record their phases in this timer.
+        thread_local xexecution_timer* current_timer = nullptr;
+
+        double to_seconds(clock_type::duration duration)
+        {
+            return std::chrono::duration<double>(duration).count();
+        }
+    }
+
+    const char* phase_name(xphase phase)
+    {
+        switch (phase)
+        {
+            case xphase::queue: return "queue";
+            case xphase::input_setup: return "input_setup";
+            case xphase::compile: return "compile";
+            case xphase::user_code: return "user_code";
+            case xphase::display_hook: return "display_hook";
+            case xphase::finalize: return "finalize";
+            case xphase::reply: return "reply";
+            default: return "unknown";
+        }
+    }
+
+    /***********************************
+     * xexecution_timer implementation *
+     ***********************************/
+
+    xexecution_timer::xexecution_timer()
+        : m_durations{}
+        , m_recorded{}
+        , m_last(clock_type::now())
+        , m_nested(clock_type::duration::zero())
+    {
+        clock_type::rep wakeup = shell_wakeup.load(std::memory_order_relaxed);
+        if (wakeup != 0)
+        {
+            clock_type::duration queue = m_last - clock_type::time_point(clock_type::duration(wakeup));
+            std::size_t index = static_cast<std::size_t>(xphase::queue);
+            m_durations[index] = std::max(queue, clock_type::duration::zero());
+            m_recorded[index] = true;
+        }
+    }
+
+    xexecution_timer::~xexecution_timer()
+    {
+        deactivate();
+    }
+
+    void xexecution_timer::mark(xphase phase)
+    {
+        clock_type::time_point now = clock_type::now();
+        std::size_t index = static_cast<std::size_t>(phase);
+        m_durations[index] += std::max(now - m_last - m_nested, clock_type::duration::zero());
+        m_recorded[index] = true;
+        m_last = now;
+        m_nested = clock_type::duration::zero();
+    }
+
+    void xexecution_timer::add_nested(xphase phase, clock_type::duration duration)
+    {
+        std::size_t index = static_cast<std::size_t>(phase);
+        m_durations[index] += duration;
+        m_recorded[index] = true;
+        m_nested += duration;
+    }
+
+    nl::json xexecution_timer::to_json() const
+    {
+        nl::json res = nl::json::object();
+        for (std::size_t i = 0; i < phase_count; ++i)
+        {
+            if (m_recorded[i])
+            {
+                res[phase_name(static_cast<xphase>(i))] = to_seconds(m_durations[i]);
+            }
+        }
+        return res;
+    }
+
+    void xexecution_timer::record() const
+    {
+        if (!execution_timing_enabled())
+        {
+            return;
+        }
+        xtiming_histograms& histograms = get_timing_histograms();
+        for (std::size_t i = 0; i < phase_count; ++i)
+        {
+            if (m_recorded[i])
+            {
+                histograms.add(static_cast<xphase>(i), to_seconds(m_durations[i]));
+            }
+        }
+    }
+
+    xexecution_timer* xexecution_timer::current()
+    {
+        return current_timer;
+    }
+
+    void xexecution_timer::activate()
+    {
+        current_timer = this;
+    }
+
+    void xexecution_timer::deactivate()
+    {
+        if (current_timer == this)
+        {
+            current_timer = nullptr;
+        }
+    }
+
+    /********************************
+     * xnested_phase implementation *
+     ********************************/
+
+    xnested_phase::xnested_phase(xphase phase)
+        : m_phase(phase)
+        , m_start(clock_type::now())
+    {
+    }
+
+    xnested_phase::~xnested_phase()
+    {
+        if (xexecution_timer* timer = xexecution_timer::current())
+        {
+            timer->add_nested(m_phase, clock_type::now() - m_start);
+        }
+    }
+
+    void notify_shell_wakeup(bool awake)
+    {
+        clock_type::rep stamp = awake ? clock_type::now().time_since_epoch().count() : 0;
+        shell_wakeup.store(stamp, std::memory_order_relaxed);
+    }
+
+    bool execution_timing_enabled()
+    {
+        return timing_enabled.load(std::memory_order_relaxed);
+    }
+
+    void set_execution_timing_enabled(bool enabled)
+    {
+        timing_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    /*************************************
+     * xtiming_histograms implementation *
+     *************************************/
+
+    void xtiming_histograms::add(xphase phase, double seconds)
+    {
+        double micros = seconds * 1e6;
+        std::size_t bucket = micros < 1. ? 0 : static_cast<std::size_t>(std::log2(micros)) + 1;
+        bucket = std::min(bucket, bucket_count - 1);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        histogram& h = m_histograms[static_cast<std::size_t>(phase)];
+        ++h.m_buckets[bucket];
+        h.m_min = h.m_count == 0 ? seconds : std::min(h.m_min, seconds);
+        h.m_max = std::max(h.m_max, seconds);
+        h.m_total += seconds;
+        ++h.m_count;
+    }
+
+    nl::json xtiming_histograms::to_json() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        nl::json res = nl::json::object();
+        for (std::size_t i = 0; i < phase_count; ++i)
+        {
+            const histogram& h = m_histograms[i];
+            if (h.m_count == 0)
+            {
+                continue;
+            }
+
+            // Trailing empty buckets are dropped
+            std::size_t last = bucket_count;
+            while (last != 0 && h.m_buckets[last - 1] == 0)
+            {
+                --last;
+            }
+
+            res[phase_name(static_cast<xphase>(i))] = {
+                {"count", h.m_count},
+                {"total", h.m_total},
+                {"min", h.m_min},
+                {"max", h.m_max},
+                {"buckets", std::vector<std::uint64_t>(h.m_buckets.begin(), h.m_buckets.begin() + last)}
+            };
+        }
+        return res;
+    }
+
+    void xtiming_histograms::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_histograms = {};
+    }
+
+    xtiming_histograms& get_timing_histograms()
+    {
+        static xtiming_histograms histograms;
+        return histograms;
+    }
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_EXECUTION_TIMING_HPP
+#define XPYT_EXECUTION_TIMING_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Phases of the execution of a cell, in the order they happen.
+     *
+     * - queue: from the shell socket wake-up to the start of the request
+     * - input_setup: redirection of input and getpass
+     * - compile: parse and compilation of the cell (raw mode only)
+     * - user_code: execution of the cell, display hook excluded
+     * - display_hook: publication of the result of the last expression
+     * - finalize: payload, user expressions, history and error reporting
+     * - reply: serialization and sending of the execute_reply
+     */
+    enum class xphase : std::size_t
+    {
+        queue,
+        input_setup,
+        compile,
+        user_code,
+        display_hook,
+        finalize,
+        reply,
+        count
+    };
+
+    constexpr std::size_t phase_count = static_cast<std::size_t>(xphase::count);
+
+    const char* phase_name(xphase phase);
+
+    /**
+     * Monotonic timer of the phases of an execute request.
+     *
+     * Each call to mark attributes the time elapsed since the previous mark
+     * to a phase, minus the time of the nested phases recorded in between
+     * (the display hook runs within the user code).
+     */
+    class xexecution_timer
+    {
+    public:
+
+        using clock_type = std::chrono::steady_clock;
+
+        xexecution_timer();
+        ~xexecution_timer();
+
+        xexecution_timer(const xexecution_timer&) = delete;
+        xexecution_timer& operator=(const xexecution_timer&) = delete;
+
+        void mark(xphase phase);
+        void add_nested(xphase phase, clock_type::duration duration);
+
+        // Durations in seconds of the phases recorded so far
+        nl::json to_json() const;
+
+        // Adds the recorded phases to the process-wide histograms, if the
+        // timings are enabled
+        void record() const;
+
+        // Timer of the request being executed by this thread, nullptr if
+        // none.
+        static xexecution_timer* current();
+        void activate();
+        void deactivate();
+
+    private:
+
+        std::array<clock_type::duration, phase_count> m_durations;
+        std::array<bool, phase_count> m_recorded;
+        clock_type::time_point m_last;
+        clock_type::duration m_nested;
+    };
+
+    // Records the duration of a phase nested in the current one, if a
+    // request is being timed.
+    class xnested_phase
+    {
+    public:
+
+        explicit xnested_phase(xphase phase);
+        ~xnested_phase();
+
+        xnested_phase(const xnested_phase&) = delete;
+        xnested_phase& operator=(const xnested_phase&) = delete;
+
+    private:
+
+        xphase m_phase;
+        xexecution_timer::clock_type::time_point m_start;
+    };
+
+    // Called by the shell loop when it wakes up to read messages, and with
+    // false once they have all been handled.
+    void notify_shell_wakeup(bool awake);
+
+    // Whether the timings are added to the execute replies and to the
+    // histograms, off by default.
+    bool execution_timing_enabled();
+    void set_execution_timing_enabled(bool enabled);
+
+    /**
+     * Distribution of the duration of each phase, in power of two buckets
+     * of microseconds: bucket i counts the durations in [2^(i-1), 2^i) us,
+     * bucket 0 the durations under 1 us.
+     */
+    class xtiming_histograms
+    {
+    public:
+
+        static constexpr std::size_t bucket_count = 32;
+
+        void add(xphase phase, double seconds);
+        nl::json to_json() const;
+        void clear();
+
+    private:
+
+        struct histogram
+        {
+            std::array<std::uint64_t, bucket_count> m_buckets = {};
+            std::uint64_t m_count = 0;
+            double m_total = 0.;
+            double m_min = 0.;
+            double m_max = 0.;
+        };
+
+        mutable std::mutex m_mutex;
+        std::array<histogram, phase_count> m_histograms;
+    };
+
+    xtiming_histograms& get_timing_histograms();
+}
+
+#endif
@@ -0,0 +1,611 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define XPYT_HAS_FORKSERVER
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xforkserver.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    std::string get_option_value(const std::string& option, int argc, char* argv[])
+    {
+        for (int i = 0; i + 1 < argc; ++i)
+        {
+            if (option == argv[i])
+            {
+                return argv[i + 1];
+            }
+        }
+        return "";
+    }
+
+    std::vector<std::string> default_forkserver_preload(bool raw)
+    {
+        if (raw)
+        {
+            return { "jedi" };
+        }
+        return { "IPython", "jedi", "xeus_python_shell.shell" };
+    }
+
+#ifdef XPYT_HAS_FORKSERVER
+
+    namespace
+    {
+        using clock_type = std::chrono::steady_clock;
+
+        // Requests are a single line of JSON, this bounds the environment
+        // a client can send.
+        constexpr std::size_t max_request_size = 1 << 20;
+
+        // The template serves the clients one at a time, a client that does
+        // not send its request in time is dropped.
+        constexpr std::chrono::seconds request_timeout(5);
+
+        // Number of standard streams passed by the client
+        constexpr int stdio_count = 3;
+
+        // With a deadline, the socket must have a receive timeout so that a
+        // read cannot block past it.
+        bool read_line(int fd, std::string& line, std::size_t max_size,
+                       clock_type::time_point deadline = clock_type::time_point::max())
+        {
+            line.clear();
+            char c;
+            while (line.size() < max_size)
+            {
+                if (clock_type::now() > deadline)
+                {
+                    return false;
+                }
+                ssize_t n = ::read(fd, &c, 1);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return false;
+                }
+                if (c == '\n')
+                {
+                    return true;
+                }
+                line.push_back(c);
+            }
+            return false;
+        }
+
+        // The whole text must be a number
+        bool parse_int(const std::string& text, int& value)
+        {
+            const char* end = text.data() + text.size();
+            auto res = std::from_chars(text.data(), end, value);
+            return res.ec == std::errc() && res.ptr == end;
+        }
+
+        // Whether the peer closed the connection, without blocking
+        bool connection_closed(int fd)
+        {
+            char c;
+            return ::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+        }
+
+        bool write_all(int fd, const std::string& data)
+        {
+            std::size_t written = 0;
+            while (written < data.size())
+            {
+                ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return false;
+                }
+                written += static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
+        void close_all(const std::vector<int>& fds)
+        {
+            for (int fd : fds)
+            {
+                ::close(fd);
+            }
+        }
+
+        bool set_receive_timeout(int fd, std::chrono::seconds timeout)
+        {
+            timeval tv;
+            tv.tv_sec = static_cast<time_t>(timeout.count());
+            tv.tv_usec = 0;
+            return ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+        }
+
+        // The client sends its standard streams in the ancillary data of a
+        // single byte, before its request.
+        bool send_stdio(int fd)
+        {
+            int fds[stdio_count];
+            for (int i = 0; i < stdio_count; ++i)
+            {
+                // A closed stream is replaced with /dev/null
+                fds[i] = ::fcntl(i, F_GETFD) == -1 ? ::open("/dev/null", O_RDWR) : i;
+            }
+
+            char byte = 0;
+            iovec iov = { &byte, 1 };
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+            std::memset(control, 0, sizeof(control));
+            msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+            std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+            ssize_t n;
+            do
+            {
+                n = ::sendmsg(fd, &msg, 0);
+            }
+            while (n < 0 && errno == EINTR);
+
+            for (int i = 0; i < stdio_count; ++i)
+            {
+                if (fds[i] != i && fds[i] >= 0)
+                {
+                    ::close(fds[i]);
+                }
+            }
+            return n == 1;
+        }
+
+        // Returns the standard streams of the client, or an empty vector if
+        // it did not send them.
+        std::vector<int> receive_stdio(int fd)
+        {
+            char byte;
+            iovec iov = { &byte, 1 };
+            alignas(cmsghdr) char control[CMSG_SPACE(stdio_count * sizeof(int))];
+            msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            ssize_t n;
+            do
+            {
+                n = ::recvmsg(fd, &msg, 0);
+            }
+            while (n < 0 && errno == EINTR);
+
+            std::vector<int> res;
+            cmsghdr* cmsg = n == 1 ? CMSG_FIRSTHDR(&msg) : nullptr;
+            if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                res.resize(count);
+                std::memcpy(res.data(), CMSG_DATA(cmsg), count * sizeof(int));
+            }
+            if (res.size() != stdio_count || (msg.msg_flags & MSG_CTRUNC) != 0)
+            {
+                close_all(res);
+                res.clear();
+            }
+            return res;
+        }
+
+        bool make_address(const std::string& socket_path, sockaddr_un& addr)
+        {
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (socket_path.size() >= sizeof(addr.sun_path))
+            {
+                return false;
+            }
+            std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+            return true;
+        }
+
+        int exit_code(int status)
+        {
+            if (WIFEXITED(status))
+            {
+                return WEXITSTATUS(status);
+            }
+            if (WIFSIGNALED(status))
+            {
+                return 128 + WTERMSIG(status);
+            }
+            return 1;
+        }
+
+        struct forked_kernel
+        {
+            int m_client;
+            bool m_killed;
+        };
+
+        using kernel_map = std::map<pid_t, forked_kernel>;
+
+        // Sends the exit status of the terminated kernels to their client
+        void reap(kernel_map& kernels)
+        {
+            int status;
+            pid_t pid;
+            while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                auto it = kernels.find(pid);
+                if (it != kernels.end())
+                {
+                    write_all(it->second.m_client, std::to_string(exit_code(status)) + "\n");
+                    ::close(it->second.m_client);
+                    kernels.erase(it);
+                }
+            }
+        }
+
+        // Makes the forked process look like it has been started by the
+        // client: same working directory, same environment.
+        void setup_kernel_process(const nl::json& msg)
+        {
+            if (msg.contains("cwd") && msg["cwd"].is_string())
+            {
+                std::error_code ec;
+                std::filesystem::current_path(msg["cwd"].get<std::string>(), ec);
+                if (ec)
+                {
+                    std::clog << "forkserver: cannot change directory: " << ec.message() << std::endl;
+                }
+            }
+
+            // Updating os.environ also updates the process environment
+            if (msg.contains("env") && msg["env"].is_object())
+            {
+                py::object environ_obj = py::module::import("os").attr("environ");
+                environ_obj.attr("clear")();
+                for (const auto& item : msg["env"].items())
+                {
+                    if (item.value().is_string())
+                    {
+                        environ_obj[py::str(item.key())] = item.value().get<std::string>();
+                    }
+                }
+            }
+
+            // The forked kernels must not share the random state of the
+            // template
+            py::dict modules = py::module::import("sys").attr("modules");
+            if (modules.contains("random"))
+            {
+                modules["random"].attr("seed")();
+            }
+        }
+    }
+
+    xfork_request run_forkserver(const std::string& socket_path,
+                                 const std::vector<std::string>& preload)
+    {
+        for (const std::string& name : preload)
+        {
+            try
+            {
+                py::module::import(name.c_str());
+            }
+            catch (py::error_already_set& e)
+            {
+                std::clog << "forkserver: cannot preload " << name << ": " << e.what() << std::endl;
+            }
+        }
+
+        // Only the forking thread survives in the child
+        std::size_t threads = py::module::import("threading").attr("active_count")().cast<std::size_t>();
+        if (threads > 1)
+        {
+            std::clog << "forkserver: " << threads << " Python threads are running in the template,"
+                      << " they will not exist in the kernels" << std::endl;
+        }
+
+        sockaddr_un addr;
+        if (!make_address(socket_path, addr))
+        {
+            throw std::runtime_error("forkserver socket path is too long: " + socket_path);
+        }
+
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+        {
+            throw std::runtime_error(std::string("cannot create forkserver socket: ") + std::strerror(errno));
+        }
+        // Stale socket of a previous template
+        ::unlink(socket_path.c_str());
+        if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || ::chmod(socket_path.c_str(), S_IRUSR | S_IWUSR) != 0
+            || ::listen(listener, SOMAXCONN) != 0)
+        {
+            std::string error = std::strerror(errno);
+            ::close(listener);
+            throw std::runtime_error("cannot listen on " + socket_path + ": " + error);
+        }
+
+        // Clients that went away are detected when writing their status
+        ::signal(SIGPIPE, SIG_IGN);
+
+        std::clog << "xpython forkserver listening on " << socket_path << std::endl;
+
+        kernel_map kernels;
+        while (true)
+        {
+            reap(kernels);
+
+            std::vector<pollfd> fds;
+            fds.push_back({ listener, POLLIN, 0 });
+            for (const auto& kernel : kernels)
+            {
+                fds.push_back({ kernel.second.m_client, POLLIN, 0 });
+            }
+
+            // The timeout bounds the delay to report terminated kernels
+            int ready = ::poll(fds.data(), fds.size(), 100);
+            if (ready < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error(std::string("forkserver poll failed: ") + std::strerror(errno));
+            }
+
+            // A client never writes after its request, a readable client
+            // socket means it has hung up. The kernel must not outlive it.
+            std::size_t index = 1;
+            for (auto& kernel : kernels)
+            {
+                if (fds[index++].revents != 0 && !kernel.second.m_killed)
+                {
+                    ::kill(kernel.first, SIGKILL);
+                    kernel.second.m_killed = true;
+                }
+            }
+
+            if ((fds[0].revents & POLLIN) == 0)
+            {
+                continue;
+            }
+
+            int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0)
+            {
+                continue;
+            }
+
+            std::string line;
+            nl::json msg;
+            std::vector<int> stdio;
+            auto deadline = clock_type::now() + request_timeout;
+            if (set_receive_timeout(client, request_timeout))
+            {
+                stdio = receive_stdio(client);
+            }
+            if (!stdio.empty() && read_line(client, line, max_request_size, deadline))
+            {
+                msg = nl::json::parse(line, nullptr, false);
+            }
+            if (!msg.is_object() || !msg.contains("connection_file") || !msg["connection_file"].is_string())
+            {
+                close_all(stdio);
+                ::close(client);
+                continue;
+            }
+
+            PyOS_BeforeFork();
+            pid_t pid = ::fork();
+            if (pid == 0)
+            {
+                PyOS_AfterFork_Child();
+                ::close(listener);
+                ::close(client);
+                for (const auto& kernel : kernels)
+                {
+                    ::close(kernel.second.m_client);
+                }
+                ::signal(SIGPIPE, SIG_DFL);
+
+                // The kernel writes to the streams of the client
+                for (int i = 0; i < stdio_count; ++i)
+                {
+                    ::dup2(stdio[static_cast<std::size_t>(i)], i);
+                }
+                for (int fd : stdio)
+                {
+                    if (fd >= stdio_count)
+                    {
+                        ::close(fd);
+                    }
+                }
+
+                setup_kernel_process(msg);
+
+                xfork_request request;
+                request.m_connection_file = msg["connection_file"].get<std::string>();
+                request.m_raw = msg.value("raw", false);
+                return request;
+            }
+
+            PyOS_AfterFork_Parent();
+            close_all(stdio);
+            if (pid < 0)
+            {
+                std::clog << "forkserver: fork failed: " << std::strerror(errno) << std::endl;
+                ::close(client);
+                continue;
+            }
+
+            write_all(client, std::to_string(pid) + "\n");
+            kernels[pid] = { client, false };
+        }
+    }
+
+    namespace
+    {
+        volatile sig_atomic_t forwarded_pid = 0;
+
+        void forward_signal(int sig)
+        {
+            if (forwarded_pid > 0)
+            {
+                ::kill(forwarded_pid, sig);
+            }
+        }
+    }
+
+    int run_forkserver_client(const std::string& socket_path, const xfork_request& request)
+    {
+        sockaddr_un addr;
+        if (!make_address(socket_path, addr))
+        {
+            return -1;
+        }
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+
+        nl::json env = nl::json::object();
+        for (char** var = environ; *var != nullptr; ++var)
+        {
+            std::string entry(*var);
+            std::size_t pos = entry.find('=');
+            if (pos != std::string::npos)
+            {
+                env[entry.substr(0, pos)] = entry.substr(pos + 1);
+            }
+        }
+
+        nl::json msg = {
+            {"connection_file", request.m_connection_file},
+            {"raw", request.m_raw},
+            {"cwd", std::filesystem::current_path().string()},
+            {"env", std::move(env)}
+        };
+
+        if (!send_stdio(fd)
+            || !write_all(fd, msg.dump(-1, ' ', false, nl::json::error_handler_t::replace) + "\n")
+            || !set_receive_timeout(fd, request_timeout))
+        {
+            ::close(fd);
+            return -1;
+        }
+
+        // The template answers with the pid of the kernel once it has
+        // forked it, and closes the connection without answering when it
+        // drops the request. Any other outcome may leave a kernel serving
+        // the connection file, starting another one would race it for the
+        // ports. Closing the connection makes the template kill it.
+        std::string line;
+        bool answered = read_line(fd, line, 32, clock_type::now() + request_timeout);
+        int pid = 0;
+        if (!answered || !parse_int(line, pid) || pid <= 0)
+        {
+            bool dropped = !answered && line.empty() && connection_closed(fd);
+            ::close(fd);
+            if (dropped)
+            {
+                return -1;
+            }
+            std::clog << "forkserver: invalid answer from the template on " << socket_path << std::endl;
+            return 1;
+        }
+        forwarded_pid = static_cast<sig_atomic_t>(pid);
+        set_receive_timeout(fd, std::chrono::seconds(0));
+
+        // Interrupts and termination requests of the kernel manager are
+        // meant for the kernel
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = forward_signal;
+        sigemptyset(&action.sa_mask);
+        for (int sig : { SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGUSR1, SIGUSR2 })
+        {
+            ::sigaction(sig, &action, nullptr);
+        }
+
+        // read_line retries on EINTR, it returns once the status is sent
+        // or when the template dies
+        int status = 1;
+        bool done = read_line(fd, line, 32) && parse_int(line, status);
+        ::close(fd);
+        return done ? status : 1;
+    }
+
+#else
+
+    xfork_request run_forkserver(const std::string&, const std::vector<std::string>&)
+    {
+        throw std::runtime_error("the forkserver mode is not supported on this platform");
+    }
+
+    int run_forkserver_client(const std::string&, const xfork_request&)
+    {
+        return -1;
+    }
+
+#endif
+}
@@ -0,0 +1,62 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_FORKSERVER_HPP
+#define XPYT_FORKSERVER_HPP
+
+#include <string>
+#include <vector>
+
+namespace xpyt
+{
+    /**
+     * Forkserver mode of the xpython executable.
+     *
+     * A template process started with `xpython --forkserver <socket>`
+     * initializes Python, imports the heavy modules once and listens on a
+     * Unix domain socket. A kernel launched with `--forkserver-client
+     * <socket>` sends its standard streams (with SCM_RIGHTS), connection
+     * file, working directory and environment to the template, which forks
+     * a kernel process for it. The client stays alive as the process seen
+     * by the Jupyter kernel manager: it forwards the signals it receives
+     * to the kernel and exits with its status. The template serves the
+     * clients one at a time and drops the ones whose request does not
+     * arrive within a few seconds.
+     *
+     * The template never creates a ZMQ context nor starts threads, both
+     * are created by the forked kernel.
+     */
+    struct xfork_request
+    {
+        std::string m_connection_file;
+        bool m_raw = false;
+    };
+
+    // Value following the option in argv, empty if absent. argv is not
+    // modified.
+    std::string get_option_value(const std::string& option, int argc, char* argv[]);
+
+    // Runs the template. Only returns in the forked kernel processes, with
+    // the request to serve. Requires the GIL.
+    xfork_request run_forkserver(const std::string& socket_path,
+                                 const std::vector<std::string>& preload);
+
+    // Default modules imported by the template.
+    std::vector<std::string> default_forkserver_preload(bool raw);
+
+    // Asks the template listening on socket_path to start a kernel and
+    // waits for it. Returns the exit status of the kernel, or -1 if no
+    // template could be reached or if it dropped the request: no kernel
+    // was forked and the caller can start one. Once the request is sent,
+    // an invalid or missing answer is a failure of the launch.
+    int run_forkserver_client(const std::string& socket_path, const xfork_request& request);
+}
+
+#endif
@@ -0,0 +1,210 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xgc_tuning.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        // Upper bound of the threshold of the youngest generation, relative
+        // to its initial value
+        constexpr std::int64_t max_threshold_factor = 64;
+
+        nl::json to_json_thresholds(py::handle thresholds)
+        {
+            nl::json res = nl::json::array();
+            for (py::handle threshold : thresholds)
+            {
+                res.push_back(threshold.cast<std::int64_t>());
+            }
+            return res;
+        }
+    }
+
+    void xgc_tuner::configure(bool enabled, std::int64_t freeze_blocks, double pause_budget)
+    {
+        py::module gc = py::module::import("gc");
+        m_freeze_blocks = freeze_blocks;
+        m_pause_budget = pause_budget;
+
+        if (enabled && !m_enabled.load())
+        {
+            m_initial_thresholds = gc.attr("get_threshold")();
+            m_initial_threshold0 = py::tuple(m_initial_thresholds)[0].cast<std::int64_t>();
+            m_blocks_at_freeze = allocated_blocks();
+            m_callback = py::cpp_function([this](const std::string& phase, py::dict info)
+            {
+                on_collection(phase, info["generation"].cast<std::size_t>());
+            });
+            gc.attr("callbacks").attr("append")(m_callback);
+        }
+        else if (!enabled && m_enabled.load())
+        {
+            gc.attr("callbacks").attr("remove")(m_callback);
+            m_callback = py::object();
+            gc.attr("unfreeze")();
+            gc.attr("set_threshold")(*m_initial_thresholds);
+        }
+        m_enabled.store(enabled);
+    }
+
+    bool xgc_tuner::enabled() const
+    {
+        return m_enabled.load();
+    }
+
+    void xgc_tuner::begin_cell()
+    {
+        if (!m_enabled.load())
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_collections = {};
+        m_pause = 0.;
+        m_max_pause = 0.;
+    }
+
+    nl::json xgc_tuner::end_cell(int execution_count)
+    {
+        if (!m_enabled.load())
+        {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        nl::json res = {
+            {"execution_count", execution_count},
+            {"collections", m_collections},
+            {"pause", m_pause},
+            {"max_pause", m_max_pause}
+        };
+        m_last_cell_pause = m_pause;
+        if (m_history.size() == history_capacity)
+        {
+            m_history.pop_front();
+        }
+        m_history.push_back(res);
+        return res;
+    }
+
+    void xgc_tuner::after_reply()
+    {
+        if (!m_enabled.load())
+        {
+            return;
+        }
+        py::module gc = py::module::import("gc");
+
+        // The collection before the freeze avoids keeping the garbage of
+        // the cells forever
+        if (allocated_blocks() - m_blocks_at_freeze > m_freeze_blocks)
+        {
+            gc.attr("collect")();
+            gc.attr("freeze")();
+            ++m_freezes;
+            m_blocks_at_freeze = allocated_blocks();
+        }
+
+        double last_pause;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            last_pause = m_last_cell_pause;
+        }
+        py::tuple thresholds = gc.attr("get_threshold")();
+        std::int64_t threshold0 = thresholds[0].cast<std::int64_t>();
+        std::int64_t tuned = threshold0;
+        if (last_pause > m_pause_budget)
+        {
+            tuned = std::min(threshold0 * 2, m_initial_threshold0 * max_threshold_factor);
+        }
+        else if (last_pause < m_pause_budget / 10)
+        {
+            tuned = std::max(threshold0 / 2, m_initial_threshold0);
+        }
+        if (tuned != threshold0)
+        {
+            gc.attr("set_threshold")(tuned, thresholds[1], thresholds[2]);
+        }
+    }
+
+    void xgc_tuner::collect_all()
+    {
+        py::module gc = py::module::import("gc");
+        if (m_enabled.load())
+        {
+            gc.attr("unfreeze")();
+            m_blocks_at_freeze = 0;
+        }
+        gc.attr("collect")();
+    }
+
+    nl::json xgc_tuner::info() const
+    {
+        py::module gc = py::module::import("gc");
+        nl::json res = {
+            {"enabled", m_enabled.load()},
+            {"freeze_blocks", m_freeze_blocks},
+            {"pause_budget", m_pause_budget},
+            {"thresholds", to_json_thresholds(gc.attr("get_threshold")())},
+            {"freezes", m_freezes},
+            {"frozen_objects", gc.attr("get_freeze_count")().cast<std::int64_t>()}
+        };
+        res["initial_thresholds"] = m_initial_thresholds ? to_json_thresholds(m_initial_thresholds) : nl::json(nullptr);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        res["cells"] = nl::json(m_history);
+        return res;
+    }
+
+    void xgc_tuner::on_collection(const std::string& phase, std::size_t generation)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (phase == "start")
+        {
+            m_collection_start = clock_type::now();
+            return;
+        }
+        double pause = std::chrono::duration<double>(clock_type::now() - m_collection_start).count();
+        m_pause += pause;
+        m_max_pause = std::max(m_max_pause, pause);
+        if (generation < generation_count)
+        {
+            ++m_collections[generation];
+        }
+    }
+
+    std::int64_t xgc_tuner::allocated_blocks() const
+    {
+        return py::module::import("sys").attr("getallocatedblocks")().cast<std::int64_t>();
+    }
+
+    xgc_tuner& get_gc_tuner()
+    {
+        // Leaked, the Python objects must not be released after the
+        // interpreter is finalized
+        static xgc_tuner* tuner = new xgc_tuner();
+        return *tuner;
+    }
+}
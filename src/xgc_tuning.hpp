@@ -0,0 +1,103 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_GC_TUNING_HPP
+#define XPYT_GC_TUNING_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Tuning of the garbage collector between cells, off by default.
+     *
+     * - The pauses of the collector are timed with gc.callbacks and
+     *   reported per cell, in the execute reply under "gc".
+     * - Once the reply is sent, when the cells have allocated more than
+     *   freeze_blocks Python blocks since the last freeze, the objects are
+     *   collected once and moved to the permanent generation with
+     *   gc.freeze(), so that the later full collections skip them.
+     * - When the collections of a cell pause for longer than pause_budget
+     *   seconds, the threshold of the youngest generation is doubled to
+     *   collect less often, and it decays back to its initial value when
+     *   the cells stay under a tenth of the budget.
+     *
+     * Disabling the tuning unfreezes the objects and restores the
+     * thresholds. All the methods require the GIL.
+     */
+    class xgc_tuner
+    {
+    public:
+
+        using clock_type = std::chrono::steady_clock;
+
+        static constexpr std::size_t generation_count = 3;
+        static constexpr std::size_t history_capacity = 1000;
+
+        void configure(bool enabled, std::int64_t freeze_blocks, double pause_budget);
+        bool enabled() const;
+
+        // Around the execution of a cell, end_cell returns the pauses of
+        // the cell.
+        void begin_cell();
+        nl::json end_cell(int execution_count);
+
+        // Freezing and threshold tuning, once the reply is sent
+        void after_reply();
+
+        // Full collection releasing the objects dropped by a soft restart
+        // or a hibernation. The frozen objects are unfrozen first, the
+        // survivors are frozen again after the next reply.
+        void collect_all();
+
+        nl::json info() const;
+
+    private:
+
+        void on_collection(const std::string& phase, std::size_t generation);
+        std::int64_t allocated_blocks() const;
+
+        std::atomic<bool> m_enabled{false};
+        std::int64_t m_freeze_blocks = 0;
+        double m_pause_budget = 0.;
+
+        py::object m_callback;
+        py::object m_initial_thresholds;
+        std::int64_t m_initial_threshold0 = 0;
+        std::int64_t m_blocks_at_freeze = 0;
+        std::size_t m_freezes = 0;
+
+        mutable std::mutex m_mutex;
+        clock_type::time_point m_collection_start;
+        std::array<std::uint64_t, generation_count> m_collections = {};
+        double m_pause = 0.;
+        double m_max_pause = 0.;
+        double m_last_cell_pause = 0.;
+        std::deque<nl::json> m_history;
+    };
+
+    xgc_tuner& get_gc_tuner();
+}
+
+#endif
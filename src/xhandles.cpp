@@ -0,0 +1,129 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+
+#include "pybind11/pybind11.h"
+
+#include "xhandles.hpp"
+#include "xthreading.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    namespace
+    {
+        using resolver_type = py::object (*)();
+
+        py::object import_attr(const char* module, const char* attr)
+        {
+            return py::module::import(module).attr(attr);
+        }
+
+        // Indexed by xhandle
+        const resolver_type resolvers[] =
+        {
+            []() -> py::object { return py::module::import("builtins"); },
+            []() -> py::object { return py::module::import("getpass"); },
+            []() { return import_attr("json", "loads"); },
+            []() -> py::object
+            {
+                py::module pathlib = py::module::import("pathlib");
+                return py::make_tuple(pathlib.attr("Path"), pathlib.attr("PurePath"));
+            },
+            []() { return import_attr("copy", "deepcopy"); },
+            []() { return import_attr("struct", "unpack"); },
+            []() { return import_attr("pygments", "highlight"); },
+            // py::module::import("pygments").attr("formatters") does NOT work due
+            // to side effects when importing pygments
+            []() { return import_attr("pygments.formatters", "TerminalFormatter")(); },
+            []() { return import_attr("pygments.lexers", "Python3Lexer")(); },
+            []() { return import_attr("traceback", "extract_tb"); },
+            []() { return import_attr("inspect", "isawaitable"); },
+            []() { return import_attr("asyncio", "get_running_loop"); },
+            []() { return import_attr("asyncio", "ensure_future"); },
+            []() -> py::object { return py::module::import("ast"); }
+        };
+        static_assert(std::size(resolvers) == static_cast<std::size_t>(xhandle::count),
+                      "a resolver is required for each xhandle");
+
+        struct handle_registry
+        {
+            xstate_mutex m_mutex;
+            std::array<py::object, static_cast<std::size_t>(xhandle::count)> m_objects;
+            std::size_t m_resolutions = 0;
+        };
+
+        handle_registry& get_registry()
+        {
+            // Leaked on purpose: the objects must not be released after the
+            // interpreter has been finalized.
+            static handle_registry* registry = new handle_registry();
+            return *registry;
+        }
+    }
+
+    py::object get_handle(xhandle handle)
+    {
+        handle_registry& registry = get_registry();
+        std::size_t index = static_cast<std::size_t>(handle);
+        {
+            xstate_lock lock(registry.m_mutex);
+            if (registry.m_objects[index])
+            {
+                return registry.m_objects[index];
+            }
+        }
+
+        // Resolved without the lock since it imports modules, concurrent
+        // resolutions return the same objects anyway.
+        py::object obj = resolvers[index]();
+        xstate_lock lock(registry.m_mutex);
+        if (!registry.m_objects[index])
+        {
+            registry.m_objects[index] = obj;
+            ++registry.m_resolutions;
+        }
+        return registry.m_objects[index];
+    }
+
+    void resolve_handles()
+    {
+        for (std::size_t i = 0; i < static_cast<std::size_t>(xhandle::count); ++i)
+        {
+            get_handle(static_cast<xhandle>(i));
+        }
+    }
+
+    void clear_handles()
+    {
+        handle_registry& registry = get_registry();
+        xstate_lock lock(registry.m_mutex);
+        for (py::object& obj : registry.m_objects)
+        {
+            obj = py::object();
+        }
+    }
+
+    std::size_t handle_resolutions()
+    {
+        handle_registry& registry = get_registry();
+        xstate_lock lock(registry.m_mutex);
+        return registry.m_resolutions;
+    }
+
+    py::object resolve_uncached_handle(xhandle handle)
+    {
+        return resolvers[static_cast<std::size_t>(handle)]();
+    }
+}
@@ -0,0 +1,71 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_HANDLES_HPP
+#define XPYT_HANDLES_HPP
+
+#include <cstddef>
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    /**
+     * Python objects used on hot paths, resolved once instead of being
+     * imported and looked up on every call.
+     *
+     * Only modules and objects that are never monkey patched are interned:
+     * builtins.input for instance is replaced during executions and must be
+     * looked up on the builtins module each time.
+     */
+    enum class xhandle : std::size_t
+    {
+        builtins,
+        getpass,
+        json_loads,
+        path_types,             // (pathlib.Path, pathlib.PurePath)
+        copy_deepcopy,
+        struct_unpack,
+        pygments_highlight,
+        pygments_formatter,     // pygments.formatters.TerminalFormatter()
+        pygments_lexer,         // pygments.lexers.Python3Lexer()
+        traceback_extract_tb,
+        inspect_isawaitable,
+        asyncio_get_running_loop,
+        asyncio_ensure_future,
+        ast,
+        count
+    };
+
+    // Returns the object, resolving it on first use. Requires the GIL.
+    py::object get_handle(xhandle handle);
+
+    // Resolves all the objects, called by the interpreters when they are
+    // configured so that the first requests do not pay for the imports.
+    // Requires the GIL.
+    void resolve_handles();
+
+    // Drops all the resolved objects, they are resolved again on their next
+    // use. Must be called with the GIL before the interpreter is restarted
+    // or finalized, since the objects belong to it.
+    void clear_handles();
+
+    // Number of resolutions since startup, for benchmarks and tests.
+    std::size_t handle_resolutions();
+
+    // Imports and looks up the object without caching it, as the hot paths
+    // did before the handles were interned. For benchmarks, requires the
+    // GIL.
+    py::object resolve_uncached_handle(xhandle handle);
+}
+
+#endif
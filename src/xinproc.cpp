@@ -0,0 +1,423 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xeus_context.hpp"
+#include "xeus/xkernel.hpp"
+#include "xeus/xkernel_configuration.hpp"
+#include "xeus/xmessage.hpp"
+#include "xeus/xserver.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xeus-python/xinproc.hpp"
+#include "xeus-python/xutils.hpp"
+
+#include "xexecution_timing.hpp"
+#include "xinproc_queue.hpp"
+#include "xruntime.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /*******************************
+     * xfd_doorbell implementation *
+     *******************************/
+
+#ifndef _WIN32
+    xfd_doorbell::xfd_doorbell()
+    {
+        if (::pipe(m_fds) != 0)
+        {
+            throw std::runtime_error("cannot create the doorbell pipe of the in-process transport");
+        }
+        for (int fd : m_fds)
+        {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    xfd_doorbell::~xfd_doorbell()
+    {
+        ::close(m_fds[0]);
+        ::close(m_fds[1]);
+    }
+
+    void xfd_doorbell::ring()
+    {
+        if (!m_signaled.exchange(true, std::memory_order_acq_rel))
+        {
+            char byte = 0;
+            // A full pipe already wakes up the loop
+            [[maybe_unused]] auto written = ::write(m_fds[1], &byte, 1);
+        }
+    }
+
+    void xfd_doorbell::reset()
+    {
+        char buffer[64];
+        while (::read(m_fds[0], buffer, sizeof(buffer)) > 0)
+        {
+        }
+        m_signaled.store(false, std::memory_order_release);
+    }
+#else
+    xfd_doorbell::xfd_doorbell()
+    {
+        throw std::runtime_error("the in-process transport is not available on Windows");
+    }
+
+    xfd_doorbell::~xfd_doorbell() = default;
+
+    void xfd_doorbell::ring()
+    {
+    }
+
+    void xfd_doorbell::reset()
+    {
+    }
+#endif
+
+    int xfd_doorbell::fd() const
+    {
+        return m_fds[0];
+    }
+
+    /***********************************
+     * xinproc_channels implementation *
+     ***********************************/
+
+    class xinproc_channels
+    {
+    public:
+
+        // Client to kernel. The shell requests are read by the asyncio
+        // loop of the kernel.
+        xmpsc_queue<xeus::xmessage> m_shell_requests;
+        xfd_doorbell m_shell_request_bell;
+        xmpsc_queue<xeus::xmessage> m_control_requests;
+        xwait_doorbell m_control_request_bell;
+        xmpsc_queue<xeus::xmessage> m_stdin_replies;
+        xwait_doorbell m_stdin_reply_bell;
+
+        // Kernel to client
+        xmpsc_queue<xeus::xmessage> m_shell_replies;
+        xwait_doorbell m_shell_reply_bell;
+        xmpsc_queue<xeus::xmessage> m_control_replies;
+        xwait_doorbell m_control_reply_bell;
+        xmpsc_queue<xeus::xmessage> m_stdin_requests;
+        xwait_doorbell m_stdin_request_bell;
+        xmpsc_queue<xeus::xpub_message> m_iopub_messages;
+        xwait_doorbell m_iopub_bell;
+
+        std::atomic<bool> m_served{false};
+        std::atomic<bool> m_stopped{false};
+
+        void stop()
+        {
+            m_stopped.store(true);
+            m_control_request_bell.ring();
+            m_stdin_reply_bell.ring();
+            m_shell_reply_bell.ring();
+            m_control_reply_bell.ring();
+            m_stdin_request_bell.ring();
+            m_iopub_bell.ring();
+        }
+    };
+
+    namespace
+    {
+        using clock_type = xwait_doorbell::clock_type;
+
+        // Returns the next message of the queue, or nothing if the timeout
+        // expired or the kernel stopped.
+        template <class T>
+        std::optional<T> receive(xmpsc_queue<T>& queue,
+                                 xwait_doorbell& doorbell,
+                                 const std::atomic<bool>& stopped,
+                                 long timeout)
+        {
+            bool forever = timeout < 0;
+            clock_type::time_point deadline = clock_type::now() + std::chrono::milliseconds(forever ? 0 : timeout);
+            while (true)
+            {
+                if (auto message = queue.pop())
+                {
+                    return message;
+                }
+                if (stopped.load())
+                {
+                    return queue.pop();
+                }
+                clock_type::time_point until = forever ? clock_type::now() + std::chrono::seconds(1) : deadline;
+                if (!doorbell.wait_until(until) && !forever)
+                {
+                    return queue.pop();
+                }
+            }
+        }
+
+        class xserver_inproc final : public xeus::xserver
+        {
+        public:
+
+            explicit xserver_inproc(std::shared_ptr<xinproc_channels> channels);
+            ~xserver_inproc() override;
+
+        private:
+
+            void send_shell_impl(xeus::xmessage message) override;
+            void send_control_impl(xeus::xmessage message) override;
+            void send_stdin_impl(xeus::xmessage message) override;
+            void publish_impl(xeus::xpub_message message, xeus::channel c) override;
+            void start_impl(xeus::xpub_message message) override;
+            void abort_queue_impl(const listener& l, long polling_interval) override;
+            void stop_impl() override;
+            void update_config_impl(xeus::xconfiguration& config) const override;
+
+            void on_shell_doorbell();
+            void run_control();
+            void join_control();
+
+            std::shared_ptr<xinproc_channels> p_channels;
+            std::thread m_control_thread;
+            py::object m_loop;
+        };
+
+        xserver_inproc::xserver_inproc(std::shared_ptr<xinproc_channels> channels)
+            : p_channels(std::move(channels))
+        {
+            if (p_channels->m_served.exchange(true))
+            {
+                throw std::runtime_error("the in-process channels already serve a kernel");
+            }
+        }
+
+        xserver_inproc::~xserver_inproc()
+        {
+            p_channels->stop();
+            join_control();
+        }
+
+        void xserver_inproc::send_shell_impl(xeus::xmessage message)
+        {
+            p_channels->m_shell_replies.push(std::move(message));
+            p_channels->m_shell_reply_bell.ring();
+        }
+
+        void xserver_inproc::send_control_impl(xeus::xmessage message)
+        {
+            p_channels->m_control_replies.push(std::move(message));
+            p_channels->m_control_reply_bell.ring();
+        }
+
+        void xserver_inproc::send_stdin_impl(xeus::xmessage message)
+        {
+            p_channels->m_stdin_requests.push(std::move(message));
+            p_channels->m_stdin_request_bell.ring();
+
+            // As the ZMQ server, waits for the reply of the client
+            auto reply = receive(p_channels->m_stdin_replies, p_channels->m_stdin_reply_bell, p_channels->m_stopped, -1);
+            if (reply)
+            {
+                notify_stdin_listener(std::move(*reply));
+            }
+        }
+
+        void xserver_inproc::publish_impl(xeus::xpub_message message, xeus::channel)
+        {
+            p_channels->m_iopub_messages.push(std::move(message));
+            p_channels->m_iopub_bell.ring();
+        }
+
+        void xserver_inproc::start_impl(xeus::xpub_message message)
+        {
+            publish_impl(std::move(message), xeus::channel::SHELL);
+
+            {
+                py::gil_scoped_acquire acquire;
+                py::module asyncio = py::module::import("asyncio");
+                m_loop = asyncio.attr("new_event_loop")();
+                asyncio.attr("set_event_loop")(m_loop);
+                int fd = p_channels->m_shell_request_bell.fd();
+                m_loop.attr("add_reader")(fd, py::cpp_function([this]()
+                {
+                    on_shell_doorbell();
+                }));
+                // Deferred startup work, see xruntime.hpp
+                m_loop.attr("call_later")(idle_task_delay(), py::cpp_function([]()
+                {
+                    run_idle_tasks();
+                }));
+
+                m_control_thread = std::thread(&xserver_inproc::run_control, this);
+                m_loop.attr("run_forever")();
+
+                m_loop.attr("remove_reader")(fd);
+                m_loop.attr("close")();
+                m_loop = py::object();
+            }
+            join_control();
+        }
+
+        void xserver_inproc::abort_queue_impl(const listener& l, long /*polling_interval*/)
+        {
+            while (auto message = p_channels->m_shell_requests.pop())
+            {
+                l(std::move(*message));
+            }
+        }
+
+        void xserver_inproc::stop_impl()
+        {
+            p_channels->stop();
+            py::gil_scoped_acquire acquire;
+            if (m_loop)
+            {
+                m_loop.attr("call_soon_threadsafe")(m_loop.attr("stop"));
+            }
+        }
+
+        void xserver_inproc::update_config_impl(xeus::xconfiguration& config) const
+        {
+            config.m_transport = "inproc";
+            config.m_ip.clear();
+            config.m_control_port.clear();
+            config.m_shell_port.clear();
+            config.m_stdin_port.clear();
+            config.m_iopub_port.clear();
+            config.m_hb_port.clear();
+        }
+
+        void xserver_inproc::on_shell_doorbell()
+        {
+            // Called by the loop with the GIL held
+            notify_shell_wakeup(true);
+            p_channels->m_shell_request_bell.reset();
+            while (auto message = p_channels->m_shell_requests.pop())
+            {
+                notify_shell_listener(std::move(*message));
+            }
+            notify_shell_wakeup(false);
+        }
+
+        void xserver_inproc::run_control()
+        {
+            while (auto message = receive(p_channels->m_control_requests,
+                                          p_channels->m_control_request_bell,
+                                          p_channels->m_stopped,
+                                          -1))
+            {
+                notify_control_listener(std::move(*message));
+            }
+        }
+
+        void xserver_inproc::join_control()
+        {
+            if (!m_control_thread.joinable() || m_control_thread.get_id() == std::this_thread::get_id())
+            {
+                return;
+            }
+            if (holding_gil())
+            {
+                py::gil_scoped_release release;
+                m_control_thread.join();
+            }
+            else
+            {
+                m_control_thread.join();
+            }
+        }
+    }
+
+    std::shared_ptr<xinproc_channels> make_inproc_channels()
+    {
+        return std::make_shared<xinproc_channels>();
+    }
+
+    xeus::xkernel::server_builder make_inproc_server_factory(std::shared_ptr<xinproc_channels> channels)
+    {
+        return [channels](xeus::xcontext& /*context*/,
+                          const xeus::xconfiguration& /*config*/,
+                          nl::json::error_handler_t /*eh*/) -> std::unique_ptr<xeus::xserver>
+        {
+            return std::make_unique<xserver_inproc>(channels);
+        };
+    }
+
+    /*********************************
+     * xinproc_client implementation *
+     *********************************/
+
+    xinproc_client::xinproc_client(std::shared_ptr<xinproc_channels> channels)
+        : p_channels(std::move(channels))
+    {
+    }
+
+    void xinproc_client::send_on_shell(xeus::xmessage message)
+    {
+        p_channels->m_shell_requests.push(std::move(message));
+        p_channels->m_shell_request_bell.ring();
+    }
+
+    void xinproc_client::send_on_control(xeus::xmessage message)
+    {
+        p_channels->m_control_requests.push(std::move(message));
+        p_channels->m_control_request_bell.ring();
+    }
+
+    void xinproc_client::send_on_stdin(xeus::xmessage message)
+    {
+        p_channels->m_stdin_replies.push(std::move(message));
+        p_channels->m_stdin_reply_bell.ring();
+    }
+
+    std::optional<xeus::xmessage> xinproc_client::receive_on_shell(long timeout)
+    {
+        return receive(p_channels->m_shell_replies, p_channels->m_shell_reply_bell, p_channels->m_stopped, timeout);
+    }
+
+    std::optional<xeus::xmessage> xinproc_client::receive_on_control(long timeout)
+    {
+        return receive(p_channels->m_control_replies, p_channels->m_control_reply_bell, p_channels->m_stopped, timeout);
+    }
+
+    std::optional<xeus::xmessage> xinproc_client::receive_on_stdin(long timeout)
+    {
+        return receive(p_channels->m_stdin_requests, p_channels->m_stdin_request_bell, p_channels->m_stopped, timeout);
+    }
+
+    std::optional<xeus::xpub_message> xinproc_client::receive_on_iopub(long timeout)
+    {
+        return receive(p_channels->m_iopub_messages, p_channels->m_iopub_bell, p_channels->m_stopped, timeout);
+    }
+
+    bool xinproc_client::kernel_stopped() const
+    {
+        return p_channels->m_stopped.load();
+    }
+}
@@ -0,0 +1,161 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_INPROC_QUEUE_HPP
+#define XPYT_INPROC_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace xpyt
+{
+    /**
+     * Unbounded multiple-producer single-consumer queue, after the
+     * node-based queue of D. Vyukov. push is wait-free, a single exchange,
+     * pop is lock-free and must only be called by one thread at a time.
+     * A push in progress may be invisible to pop for a short time, the
+     * producer rings the doorbell of the consumer once it has completed.
+     */
+    template <class T>
+    class xmpsc_queue
+    {
+    public:
+
+        xmpsc_queue()
+            : m_head(new node())
+            , m_tail(m_head.load(std::memory_order_relaxed))
+        {
+        }
+
+        ~xmpsc_queue()
+        {
+            while (pop())
+            {
+            }
+            delete m_tail;
+        }
+
+        xmpsc_queue(const xmpsc_queue&) = delete;
+        xmpsc_queue& operator=(const xmpsc_queue&) = delete;
+        xmpsc_queue(xmpsc_queue&&) = delete;
+        xmpsc_queue& operator=(xmpsc_queue&&) = delete;
+
+        void push(T value)
+        {
+            node* n = new node(std::move(value));
+            node* previous = m_head.exchange(n, std::memory_order_acq_rel);
+            previous->m_next.store(n, std::memory_order_release);
+        }
+
+        std::optional<T> pop()
+        {
+            node* tail = m_tail;
+            node* next = tail->m_next.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                return std::nullopt;
+            }
+            std::optional<T> res(std::move(next->m_value));
+            next->m_value.reset();
+            m_tail = next;
+            delete tail;
+            return res;
+        }
+
+    private:
+
+        struct node
+        {
+            node() = default;
+            explicit node(T value) : m_value(std::move(value)) {}
+
+            std::atomic<node*> m_next{nullptr};
+            std::optional<T> m_value;
+        };
+
+        alignas(64) std::atomic<node*> m_head;
+        alignas(64) node* m_tail;
+    };
+
+    /**
+     * Wakes up a consumer waiting on a thread. Ringing only takes the lock
+     * when the doorbell was not already signaled, i.e. once per wake-up of
+     * the consumer and not once per message.
+     */
+    class xwait_doorbell
+    {
+    public:
+
+        using clock_type = std::chrono::steady_clock;
+
+        void ring()
+        {
+            if (!m_signaled.exchange(true, std::memory_order_acq_rel))
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_condition.notify_one();
+            }
+        }
+
+        // Returns false if the deadline expired without signal. A signal
+        // may be spurious, the consumer polls its queue again.
+        bool wait_until(clock_type::time_point deadline)
+        {
+            if (!m_signaled.load(std::memory_order_acquire))
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                auto signaled = [this]() { return m_signaled.load(std::memory_order_acquire); };
+                if (!m_condition.wait_until(lock, deadline, signaled))
+                {
+                    return false;
+                }
+            }
+            m_signaled.store(false, std::memory_order_release);
+            return true;
+        }
+
+    private:
+
+        std::atomic<bool> m_signaled{false};
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+    };
+
+    /**
+     * Doorbell read by an event loop: ringing writes a byte to a pipe only
+     * when the doorbell was not already signaled. The consumer resets it
+     * before draining its queue. POSIX only.
+     */
+    class xfd_doorbell
+    {
+    public:
+
+        xfd_doorbell();
+        ~xfd_doorbell();
+
+        xfd_doorbell(const xfd_doorbell&) = delete;
+        xfd_doorbell& operator=(const xfd_doorbell&) = delete;
+
+        int fd() const;
+        void ring();
+        void reset();
+
+    private:
+
+        int m_fds[2] = {-1, -1};
+        std::atomic<bool> m_signaled{false};
+    };
+}
+
+#endif
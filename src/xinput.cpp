@@ -8,6 +8,8 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <atomic>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 
@@ -17,6 +19,7 @@
 #include "pybind11/functional.h"
 #include "pybind11/pybind11.h"
 
+#include "xhandles.hpp"
 #include "xinput.hpp"
 #include "xeus-python/xutils.hpp"
 
@@ -24,44 +27,92 @@ namespace py = pybind11;
 
 namespace xpyt
 {
-    std::string cpp_input(const std::string& prompt)
+    namespace
     {
-        return xeus::blocking_input_request(prompt, false);
-    }
+        // Value of the threads that have no value in their context
+        std::atomic<bool> input_allowed_fallback{false};
 
-    std::string cpp_getpass(const std::string& prompt)
-    {
-        return xeus::blocking_input_request(prompt, true);
-    }
+        // Serializes the input requests of ainput and of the hooks
+        std::mutex input_mutex;
 
-    void notimplemented(const std::string&)
-    {
-        throw std::runtime_error("This frontend does not support input requests");
+        // Leaked, it is shared by the contexts of the interpreter
+        PyObject* input_allowed_var()
+        {
+            static PyObject* var = PyContextVar_New("allow_stdin", nullptr);
+            return var;
+        }
+
+        bool input_allowed()
+        {
+            PyObject* value = nullptr;
+            if (PyContextVar_Get(input_allowed_var(), nullptr, &value) != 0)
+            {
+                PyErr_Clear();
+                return input_allowed_fallback.load();
+            }
+            if (value == nullptr)
+            {
+                return input_allowed_fallback.load();
+            }
+            bool res = value == Py_True;
+            Py_DECREF(value);
+            return res;
+        }
+
+        std::string request_input(const std::string& prompt, bool password)
+        {
+            if (!input_allowed())
+            {
+                throw std::runtime_error("This frontend does not support input requests");
+            }
+            py::gil_scoped_release release;
+            std::lock_guard<std::mutex> lock(input_mutex);
+            return xeus::blocking_input_request(prompt, password);
+        }
+
+        std::string cpp_input(const std::string& prompt)
+        {
+            return request_input(prompt, false);
+        }
+
+        std::string cpp_getpass(const std::string& prompt)
+        {
+            return request_input(prompt, true);
+        }
     }
 
-    input_redirection::input_redirection(bool allow_stdin)
+    void install_input_hooks()
     {
         // Forward input()
-        py::module builtins = py::module::import("builtins");
-        m_sys_input = builtins.attr("input");
-        builtins.attr("input") = allow_stdin ? py::cpp_function(&cpp_input, py::arg("prompt") = "")
-                                             : py::cpp_function(&notimplemented, py::arg("prompt") = "");
+        get_handle(xhandle::builtins).attr("input") = py::cpp_function(&cpp_input, py::arg("prompt") = "");
 
         // Forward getpass()
-        py::module getpass = py::module::import("getpass");
-        m_sys_getpass = getpass.attr("getpass");
-        getpass.attr("getpass") = allow_stdin ? py::cpp_function(&cpp_getpass, py::arg("prompt") = "")
-                                              : py::cpp_function(&notimplemented, py::arg("prompt") = "");
+        get_handle(xhandle::getpass).attr("getpass") = py::cpp_function(&cpp_getpass, py::arg("prompt") = "");
+    }
+
+    void set_input_allowed(bool allowed)
+    {
+        input_allowed_fallback.store(allowed);
+        set_input_allowed_in_context(allowed);
     }
 
-    input_redirection::~input_redirection()
+    void set_input_allowed_in_context(bool allowed)
     {
-        // Restore input()
-        py::module builtins = py::module::import("builtins");
-        builtins.attr("input") = m_sys_input;
+        PyObject* token = PyContextVar_Set(input_allowed_var(), allowed ? Py_True : Py_False);
+        if (token == nullptr)
+        {
+            throw py::error_already_set();
+        }
+        Py_DECREF(token);
+    }
 
-        // Restore getpass()
-        py::module getpass = py::module::import("getpass");
-        getpass.attr("getpass") = m_sys_getpass;
+    py::object ainput(const std::string& prompt, bool password)
+    {
+        // The request context and the allow_stdin flag of the caller are
+        // read from the executor thread
+        py::object loop = get_handle(xhandle::asyncio_get_running_loop)();
+        py::object context = py::module::import("contextvars").attr("copy_context")();
+        py::cpp_function request(&request_input);
+        return loop.attr("run_in_executor")(py::none(), context.attr("run"), request, prompt, password);
     }
 }
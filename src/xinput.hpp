@@ -16,6 +16,8 @@
     #pragma GCC diagnostic ignored "-Wattributes"
 #endif
 
+#include <string>
+
 #include "pybind11/pybind11.h"
 
 namespace py = pybind11;
@@ -23,24 +25,32 @@ namespace py = pybind11;
 namespace xpyt
 {
     /**
-     * Input_redirection is a scope guard implementing the redirection of
-     * input() and getpass() to the frontend through an input_request message.
+     * Redirection of input() and getpass() to the frontend through
+     * input_request messages.
+     *
+     * The hooks are installed once. Whether the frontend accepts input
+     * requests (allow_stdin of the execute request) is stored in a context
+     * variable, so that the asyncio tasks created by a cell inherit it, and
+     * in a fallback read by the threads that have no value in their context.
+     * When input requests are not allowed, the hooks raise an error.
      *
-     * For Python 2, this also redirects raw_input().
+     * The GIL is released while waiting for the reply.
      */
-    class input_redirection
-    {
-    public:
 
-        input_redirection(bool allow_stdin);
-        ~input_redirection();
+    // Called once at configuration with the GIL
+    void install_input_hooks();
+
+    // Called with the GIL when an execute request starts and ends
+    void set_input_allowed(bool allowed);
 
-    private:
+    // Sets the context variable only, for the threads running cells next
+    // to the shell. Requires the GIL.
+    void set_input_allowed_in_context(bool allowed);
 
-        py::object m_sys_input;
-        py::object m_sys_getpass;
-        py::object m_sys_raw_input;  // Only used for Python 2
-    };
+    // Awaitable requesting an input from a thread of the default executor,
+    // so that the asyncio loop of the kernel keeps running while waiting
+    // for the reply. Requires a running loop and the GIL.
+    py::object ainput(const std::string& prompt, bool password);
 }
 
 #ifdef __GNUC__
@@ -21,6 +21,7 @@
 #include "pybind11/pybind11.h"
 #include "pybind11/eval.h"
 
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
 
 #ifdef WIN32
@@ -34,7 +35,13 @@ namespace xpyt
 {
     py::module create_module(const std::string& module_name)
     {
+#ifdef Py_GIL_DISABLED
+        // The modules of xeus-python lock their own state, see xthreading.hpp
+        return py::module_::create_extension_module(module_name.c_str(), nullptr, new py::module_::module_def,
+                                                    py::mod_gil_not_used());
+#else
         return py::module_::create_extension_module(module_name.c_str(), nullptr, new py::module_::module_def);
+#endif
     }
 
     std::string red_text(const std::string& text)
@@ -54,14 +61,11 @@ namespace xpyt
 
     std::string highlight(const std::string& code)
     {
-        py::object py_highlight = py::module::import("pygments").attr("highlight");
-        // py::module::import("pygments").attr("formatters") does NOT work due
-        // to side effects when importing pygments
-        py::object formatter = py::module::import("pygments.formatters").attr("TerminalFormatter");
-
-        py::object lexer = py::module::import("pygments.lexers").attr("Python3Lexer");
+        py::object py_highlight = get_handle(xhandle::pygments_highlight);
+        py::object formatter = get_handle(xhandle::pygments_formatter);
+        py::object lexer = get_handle(xhandle::pygments_lexer);
 
-        return py::str(py_highlight(code, lexer(), formatter()));
+        return py::str(py_highlight(code, lexer, formatter));
     }
 
     xeus::binary_buffer pybytes_to_cpp_message(py::bytes bytes)
@@ -110,13 +114,18 @@ namespace xpyt
     }
 
     py::object cppmessage_to_pymessage(const xeus::xmessage& msg)
+    {
+        return cppmessage_to_pymessage(msg, msg.buffers());
+    }
+
+    py::object cppmessage_to_pymessage(const xeus::xmessage& msg, const xeus::buffer_sequence& buffers)
     {
         py::dict py_msg;
         py_msg["header"] = msg.header().get<py::object>();
         py_msg["parent_header"] = msg.parent_header().get<py::object>();
         py_msg["metadata"] = msg.metadata().get<py::object>();
         py_msg["content"] = msg.content().get<py::object>();
-        py_msg["buffers"] = cpp_buffers_to_pylist(msg.buffers());
+        py_msg["buffers"] = cpp_buffers_to_pylist(buffers);
         return py_msg;
     }
 
@@ -34,6 +34,7 @@ namespace xpyt
     xeus::buffer_sequence pylist_to_cpp_buffers(const py::object& bufferlist);
 
     py::object cppmessage_to_pymessage(const xeus::xmessage& msg);
+    py::object cppmessage_to_pymessage(const xeus::xmessage& msg, const xeus::buffer_sequence& buffers);
 
     std::string get_tmp_prefix();
     std::string get_tmp_suffix();
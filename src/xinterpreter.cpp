@@ -9,6 +9,7 @@
 ****************************************************************************/
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <memory>
 #include <string>
@@ -34,9 +35,21 @@
 #include "xcomm.hpp"
 #include "xkernel.hpp"
 #include "xdisplay.hpp"
+#include "xcheckpoint.hpp"
+#include "xexecution_timing.hpp"
+#include "xgc_tuning.hpp"
+#include "xhandles.hpp"
 #include "xinput.hpp"
 #include "xinternal_utils.hpp"
+#include "xinterrupt.hpp"
+#include "xjson.hpp"
+#include "xmemory_accounting.hpp"
+#include "xnamespace_snapshot.hpp"
+#include "xruntime.hpp"
+#include "xsoft_restart.hpp"
 #include "xstream.hpp"
+#include "xsubshell.hpp"
+#include "xthreading.hpp"
 
 namespace py = pybind11;
 namespace nl = nlohmann;
@@ -47,9 +60,12 @@ namespace xpyt
 
     interpreter::interpreter(
         py::dict globals,
-        bool redirect_output_enabled /*=true*/, bool redirect_display_enabled /*=true*/)
+        bool redirect_output_enabled /*=true*/, bool redirect_display_enabled /*=true*/,
+        bool lazy_configure /*=false*/)
         : m_global_dict{globals},
-          m_redirect_output_enabled{redirect_output_enabled}, m_redirect_display_enabled{redirect_display_enabled}
+          m_redirect_output_enabled{redirect_output_enabled}, m_redirect_display_enabled{redirect_display_enabled},
+          m_lazy_configure{lazy_configure},
+          p_snapshot{std::make_unique<xnamespace_snapshot>()}
     {
         xeus::register_interpreter(this);
     }
@@ -68,8 +84,67 @@ namespace xpyt
         }
 
         py::gil_scoped_acquire acquire;
+        auto start = std::chrono::steady_clock::now();
 
         py::module sys = py::module::import("sys");
+        py::module comm_module = get_comm_module();
+
+        // Old approach: ipykernel provides the comm
+        sys.attr("modules")["ipykernel.comm"] = comm_module;
+        // New approach: we provide our comm module
+        sys.attr("modules")["comm"] = comm_module;
+
+        sys.attr("modules")["xpython_runtime"] = get_runtime_module();
+
+        // Interrupts raise KeyboardInterrupt in the running cell instead of
+        // terminating the kernel
+        install_interrupt_handler();
+        install_input_hooks();
+
+        if (!m_lazy_configure)
+        {
+            call_once_with_gil(m_shell_state, [this]() { initialize_shell(); });
+        }
+        else
+        {
+            add_idle_task([this]()
+            {
+                py::gil_scoped_acquire acquire;
+                ensure_shell_initialized();
+            });
+        }
+
+        if (m_redirect_output_enabled)
+        {
+            redirect_output();
+        }
+
+        py::module context_module = get_request_context_module();
+        record_kernel_modules();
+
+        xstartup_timing& timing = get_startup_timing();
+        timing.m_lazy = m_lazy_configure;
+        timing.m_configure = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!m_lazy_configure)
+        {
+            mark_startup_ready();
+        }
+    }
+
+    void interpreter::ensure_shell_initialized()
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!call_once_with_gil(m_shell_state, [this]() { initialize_shell(); }))
+        {
+            return;
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        get_startup_timing().m_deferred = elapsed;
+        mark_startup_ready();
+    }
+
+    void interpreter::initialize_shell()
+    {
         py::module logging = py::module::import("logging");
 
         py::module display_module = get_display_module();
@@ -78,11 +153,6 @@ namespace xpyt
         py::module comm_module = get_comm_module();
         py::module kernel_module = get_kernel_module();
 
-        // Old approach: ipykernel provides the comm
-        sys.attr("modules")["ipykernel.comm"] = comm_module;
-        // New approach: we provide our comm module
-        sys.attr("modules")["comm"] = comm_module;
-
         instanciate_ipython_shell();
 
         m_ipython_shell_app.attr("initialize")(use_jedi_for_completion());
@@ -110,44 +180,116 @@ namespace xpyt
         m_ipython_shell.attr("compile").attr("filename_mapper") = traceback_module.attr("register_filename_mapping");
         m_ipython_shell.attr("compile").attr("get_filename") = traceback_module.attr("get_filename");
 
-        if (m_redirect_output_enabled)
+        // Triggered in the task running the cell, which an interrupt
+        // cancels while the cell awaits
+        m_ipython_shell.attr("events").attr("register")("pre_run_cell", py::cpp_function([](py::object /*info*/)
         {
-            redirect_output();
-        }
+            record_interruptible_task();
+        }));
 
-        py::module context_module = get_request_context_module();
+        resolve_handles();
+        record_kernel_modules();
+    }
+
+    void interpreter::soft_restart(const std::vector<std::string>& allow_list)
+    {
+        ensure_shell_initialized();
+        nl::json report = soft_restart_kernel(allow_list, [this]()
+        {
+            // Clears the user namespace and the output cache of the display
+            // hook, starts a new history session and resets the execution
+            // count of the shell
+            m_ipython_shell.attr("reset")("new_session"_a=true);
+        });
+        p_snapshot->update(m_ipython_shell.attr("user_ns"));
+        set_soft_restart_report(std::move(report));
     }
 
     void interpreter::execute_request_impl(send_reply_callback cb,
-                                           int /*execution_count*/,
+                                           int execution_count,
                                            const std::string& code,
                                            xeus::execute_request_config config,
                                            nl::json user_expressions)
     {
         py::gil_scoped_acquire acquire;
+        ensure_shell_initialized();
+        get_hibernation().wake();
+
+        std::string subshell = subshell_id(get_request_context());
+        if (!subshell.empty())
+        {
+            if (!execute_in_subshell(subshell, m_ipython_shell.attr("user_ns"), code, config.silent, cb))
+            {
+                cb(xeus::create_error_reply("SubshellError", "Unknown subshell " + subshell, nl::json::array()));
+            }
+            return;
+        }
+
+        // The timer is shared with the completion callback, the cell may
+        // run asynchronously. Parsing and compilation happen in the shell,
+        // they are accounted as user code.
+        auto timer = std::make_shared<xexecution_timer>();
+        timer->activate();
+        get_gc_tuner().begin_cell();
+        auto memory = std::make_shared<xmemory_probe>();
+        p_snapshot->begin_execution();
 
         // Reset traceback
         m_ipython_shell.attr("last_error") = py::none();
 
-        // Scope guard performing the temporary monkey patching of input and
-        // getpass with a function sending input_request messages.
-        auto input_guard = std::make_unique<xpyt::input_redirection>(config.allow_stdin);
+        // Inherited by the task running the cell
+        set_input_allowed(config.allow_stdin);
+        timer->mark(xphase::input_setup);
 
         std::string ename;
         std::string evalue;
         std::vector<std::string> traceback;
 
-        py::cpp_function when_done_callback([this, cb, config, user_expressions, input_guard = std::move(input_guard)](){
+        auto send_reply = [this, cb, timer, memory, execution_count](nl::json reply)
+        {
+            end_interruptible_execution();
+            set_input_allowed(false);
+            p_snapshot->end_execution(m_ipython_shell.attr("user_ns"));
+            timer->mark(xphase::finalize);
+            timer->deactivate();
+            if (execution_timing_enabled())
+            {
+                reply["execution_timing"] = timer->to_json();
+            }
+            if (memory->active())
+            {
+                reply["memory"] = memory->stop(execution_count);
+            }
+            if (get_gc_tuner().enabled())
+            {
+                reply["gc"] = get_gc_tuner().end_cell(execution_count);
+            }
+            cb(std::move(reply));
+            timer->mark(xphase::reply);
+            timer->record();
+            get_gc_tuner().after_reply();
+
+            std::vector<std::string> allow_list;
+            if (take_soft_restart_request(allow_list))
+            {
+                soft_restart(allow_list);
+            }
+            get_hibernation().arm(m_ipython_shell.attr("user_ns"));
+        };
+
+        py::cpp_function when_done_callback([this, send_reply, timer, config, user_expressions](){
             py::gil_scoped_acquire acquire;
+            end_interruptible_execution();
+            timer->mark(xphase::user_code);
                 
             // Get payload
-            nl::json payload = this->m_ipython_shell.attr("payload_manager").attr("read_payload")();
+            nl::json payload = pyobject_to_json(this->m_ipython_shell.attr("payload_manager").attr("read_payload")());
             this->m_ipython_shell.attr("payload_manager").attr("clear_payload")();
 
             if (this->m_ipython_shell.attr("last_error").is_none())
             {
-                nl::json user_exprs = this->m_ipython_shell.attr("user_expressions")(user_expressions);
-                cb(xeus::create_successful_reply(payload, user_exprs));
+                nl::json user_exprs = pyobject_to_json(this->m_ipython_shell.attr("user_expressions")(user_expressions));
+                send_reply(xeus::create_successful_reply(payload, user_exprs));
             }
             else
             {
@@ -158,43 +300,55 @@ namespace xpyt
                 {
                     publish_execution_error(error.m_ename, error.m_evalue, error.m_traceback);
                 }
-                cb(xeus::create_error_reply(error.m_ename, error.m_evalue, error.m_traceback));
+                send_reply(xeus::create_error_reply(error.m_ename, error.m_evalue, error.m_traceback));
             }
         });
 
         try
         {
+            begin_interruptible_task();
             m_ipython_shell.attr("run_cell_async")(code, std::move(when_done_callback), "store_history"_a=config.store_history, "silent"_a=config.silent);
         }
         catch(std::runtime_error& e)
         {
+            timer->mark(xphase::user_code);
             const std::string error_msg = e.what();
             if(!config.silent)
             {
                 publish_execution_error("RuntimeError", error_msg, std::vector<std::string>());
             }
+            send_reply(xeus::create_error_reply("RuntimeError", error_msg, std::vector<std::string>()));
         }
         catch (py::error_already_set& e)
         {
+            timer->mark(xphase::user_code);
             xerror error = extract_already_set_error(e);
             if (!config.silent)
             {
                 publish_execution_error(error.m_ename, error.m_evalue, error.m_traceback);
             }
-            cb(xeus::create_error_reply(error.m_ename, error.m_evalue, error.m_traceback));
+            send_reply(xeus::create_error_reply(error.m_ename, error.m_evalue, error.m_traceback));
         }
         catch(...)
         {
+            timer->mark(xphase::user_code);
             if(!config.silent)
             {
                 publish_execution_error("unknown_error", "", std::vector<std::string>());
             }
-            cb(xeus::create_error_reply("UnknownError", "", std::vector<std::string>()));
+            send_reply(xeus::create_error_reply("UnknownError", "", std::vector<std::string>()));
         }
     }
 
     nl::json interpreter::shutdown_request_impl(bool /*restart*/)
     {
+        {
+            // The interned handles belong to the interpreter that is
+            // going away
+            py::gil_scoped_acquire acquire;
+            stop_subshells();
+            clear_handles();
+        }
         return xeus::create_shutdown_reply(false);
     }
 
@@ -203,7 +357,14 @@ namespace xpyt
         const std::string& code,
         int cursor_pos)
     {
+        if (p_snapshot->busy())
+        {
+            py::gil_scoped_acquire acquire;
+            return p_snapshot->complete(code, cursor_pos);
+        }
         py::gil_scoped_acquire acquire;
+        ensure_shell_initialized();
+        get_hibernation().wake();
 
         py::list completion = m_ipython_shell.attr("complete_code")(code, cursor_pos);
 
@@ -218,7 +379,14 @@ namespace xpyt
                                                int cursor_pos,
                                                int detail_level)
     {
+        if (p_snapshot->busy())
+        {
+            py::gil_scoped_acquire acquire;
+            return p_snapshot->inspect(code, cursor_pos);
+        }
         py::gil_scoped_acquire acquire;
+        ensure_shell_initialized();
+        get_hibernation().wake();
         nl::json data = nl::json::object();
         bool found = false;
 
@@ -244,6 +412,7 @@ namespace xpyt
     nl::json interpreter::is_complete_request_impl(const std::string& code)
     {
         py::gil_scoped_acquire acquire;
+        ensure_shell_initialized();
 
         py::object transformer_manager = py::getattr(m_ipython_shell, "input_transformer_manager", py::none());
         if (transformer_manager.is_none())
@@ -325,12 +494,15 @@ namespace xpyt
 
     nl::json interpreter::interrupt_request_impl()
     {
+        interrupt_execution();
         return xeus::create_interrupt_reply();
     }
 
     nl::json interpreter::internal_request_impl(const nl::json& content)
     {
         py::gil_scoped_acquire acquire;
+        ensure_shell_initialized();
+        get_hibernation().wake();
         std::string code = content.value("code", "");
 
         // Reset traceback
@@ -384,35 +556,23 @@ namespace xpyt
     void interpreter::set_request_context(xeus::xrequest_context context)
     {
         py::gil_scoped_acquire acquire;
-        py::module context_module = get_request_context_module();
-        context_module.attr("set_request_context")(context);
+        store_request_context(std::move(context));
     }
 
     namespace
     {
-        xeus::xrequest_context empty_request_context{};
+        const xeus::xrequest_context empty_request_context{};
     }
 
     const xeus::xrequest_context& interpreter::get_request_context() const noexcept
     {
         py::gil_scoped_acquire acquire;
-        py::module context_module = get_request_context_module();
-        // When the debugger is started, it send some python code to execute, that triggers
-        // a call to publish_stream, and ultimately to this function. However:
-        // - we are out of the handling of an execute_request, therefore set_request_context
-        // has not been called
-        // - we cannot set it from another thread (the context of the context variable would
-        // be different)
-        // Therefore, we have to catch the exception thrown when the context variable is empty.
-        try
-        {
-            py::object res = context_module.attr("get_request_context")();
-            return *(res.cast<xeus::xrequest_context*>());
-        }
-        catch (py::error_already_set& e)
-        {
-            return empty_request_context;
-        }
+        // The context is not set when the output does not come from a
+        // request, e.g. the code sent by the debugger when it starts, or
+        // when it comes from a thread started by the user, whose context
+        // is empty.
+        const xeus::xrequest_context* context = load_request_context();
+        return context != nullptr ? *context : empty_request_context;
     }
 
     void interpreter::redirect_output()
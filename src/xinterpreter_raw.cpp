@@ -9,6 +9,7 @@
 ****************************************************************************/
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <memory>
 #include <string>
@@ -30,13 +31,25 @@
 #include "xeus-python/xtraceback.hpp"
 #include "xeus-python/xutils.hpp"
 
+#include "xcheckpoint.hpp"
+#include "xcode_cache.hpp"
 #include "xcomm.hpp"
 #include "xkernel.hpp"
 #include "xdisplay.hpp"
+#include "xexecution_timing.hpp"
+#include "xgc_tuning.hpp"
+#include "xhandles.hpp"
 #include "xinput.hpp"
 #include "xinternal_utils.hpp"
+#include "xinterrupt.hpp"
+#include "xmemory_accounting.hpp"
+#include "xnamespace_snapshot.hpp"
 #include "xstream.hpp"
 #include "xinspect.hpp"
+#include "xruntime.hpp"
+#include "xsoft_restart.hpp"
+#include "xsubshell.hpp"
+#include "xthreading.hpp"
 
 namespace py = pybind11;
 namespace nl = nlohmann;
@@ -47,10 +60,13 @@ namespace xpyt
 
     raw_interpreter::raw_interpreter(
         py::dict globals,
-        bool redirect_output_enabled /*=true*/, bool redirect_display_enabled /*=true*/)
+        bool redirect_output_enabled /*=true*/, bool redirect_display_enabled /*=true*/,
+        bool lazy_configure /*=false*/)
         
         : m_redirect_display_enabled{ redirect_display_enabled },
-         m_global_dict{globals}
+         m_lazy_configure{ lazy_configure },
+         m_global_dict{globals},
+         p_snapshot{std::make_unique<xnamespace_snapshot>()}
     {
         xeus::register_interpreter(this);
         if (redirect_output_enabled)
@@ -74,12 +90,14 @@ namespace xpyt
         }
 
         py::gil_scoped_acquire acquire;
+        auto start = std::chrono::steady_clock::now();
 
         py::module sys = py::module::import("sys");
-        py::module jedi = py::module::import("jedi");
-        jedi.attr("api").attr("environment").attr("get_default_environment") = py::cpp_function([jedi]() {
-            jedi.attr("api").attr("environment").attr("SameEnvironment")();
-        });
+        if (!m_lazy_configure)
+        {
+            ensure_jedi_configured();
+            resolve_handles();
+        }
 
         py::module display_module = get_display_module(true);
         m_displayhook = display_module.attr("DisplayHook")();
@@ -89,9 +107,6 @@ namespace xpyt
             sys.attr("displayhook") = m_displayhook;
         }
 
-        // Expose display functions to Python
-       m_global_dict["display"] = display_module.attr("display");
-       m_global_dict["update_display"] = display_module.attr("update_display");
         // Monkey patching "import IPython.core.display"
         sys.attr("modules")["IPython.core.display"] = display_module;
 
@@ -102,14 +117,81 @@ namespace xpyt
         // Monkey patching "from IPython import get_ipython"
         sys.attr("modules")["IPython.core.getipython"] = kernel_module;
 
-        // Add get_ipython to global namespace
-        m_global_dict["get_ipython"] = kernel_module.attr("get_ipython");
+        sys.attr("modules")["xpython_runtime"] = get_runtime_module();
+
+        // Interrupts raise KeyboardInterrupt in the running cell instead of
+        // terminating the kernel
+        install_interrupt_handler();
+        install_input_hooks();
+
+        init_namespace();
         kernel_module.attr("get_ipython")();
 
+        py::module context_module = get_request_context_module();
+        record_kernel_modules();
+
+        xstartup_timing& timing = get_startup_timing();
+        timing.m_lazy = m_lazy_configure;
+        timing.m_configure = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!m_lazy_configure)
+        {
+            mark_startup_ready();
+        }
+    }
+
+    void raw_interpreter::init_namespace()
+    {
+        // Expose display functions to Python
+        py::module display_module = get_display_module(true);
+        m_global_dict["display"] = display_module.attr("display");
+        m_global_dict["update_display"] = display_module.attr("update_display");
+
+        // Add get_ipython to global namespace
+        m_global_dict["get_ipython"] = get_kernel_module(true).attr("get_ipython");
+
         m_global_dict["_i"] = "";
         m_global_dict["_ii"] = "";
         m_global_dict["_iii"] = "";
-        py::module context_module = get_request_context_module();
+    }
+
+    void raw_interpreter::soft_restart(const std::vector<std::string>& allow_list)
+    {
+        nl::json report = soft_restart_kernel(allow_list, [this]()
+        {
+            clear_namespace(m_global_dict);
+            init_namespace();
+            if (m_redirect_display_enabled)
+            {
+                py::module::import("sys").attr("displayhook") = m_displayhook;
+            }
+        });
+        p_snapshot->update(m_global_dict);
+        set_soft_restart_report(std::move(report));
+    }
+
+    void raw_interpreter::ensure_jedi_configured()
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool configured = call_once_with_gil(m_jedi_state, []()
+        {
+            py::module jedi = py::module::import("jedi");
+            jedi.attr("api").attr("environment").attr("get_default_environment") = py::cpp_function([jedi]() {
+                jedi.attr("api").attr("environment").attr("SameEnvironment")();
+            });
+        });
+        if (!configured)
+        {
+            return;
+        }
+
+        if (m_lazy_configure)
+        {
+            resolve_handles();
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            get_startup_timing().m_deferred = elapsed;
+            mark_startup_ready();
+            record_kernel_modules();
+        }
     }
 
     namespace
@@ -143,38 +225,24 @@ namespace xpyt
         };
     }
 
-    void raw_interpreter::execute_request_impl(
-        send_reply_callback cb,
-        int execution_count,
-        const std::string& code,
-        xeus::execute_request_config config,
-        nl::json /*user_expressions*/)
+    namespace
     {
-        std::cout<<"execute_request_impl()"<<std::endl;
-        py::gil_scoped_acquire acquire;
-        py::str code_copy;
-        // Scope guard performing the temporary monkey patching of input and
-        // getpass with a function sending input_request messages.
-        auto input_guard = input_redirection(config.allow_stdin);
-        code_copy = code;
-        try
+        xcode_cache::entry compile_cell(const py::str& code, const std::string& filename, bool silent)
         {
-            // Import modules
-            py::module ast = py::module::import("ast");
-            py::module builtins = py::module::import("builtins");
+            py::object ast = get_handle(xhandle::ast);
+            py::object builtins = get_handle(xhandle::builtins);
 
             // Parse code to AST
-            py::object code_ast = ast.attr("parse")(code_copy, "<string>", "exec");
+            py::object code_ast = ast.attr("parse")(code, "<string>", "exec");
             py::list expressions = code_ast.attr("body");
 
-            std::string filename = get_cell_tmp_file(code);
-            register_filename_mapping(filename, execution_count);
-
+            xcode_cache::entry res;
+            res.m_interactive = py::none();
 
             // If the last statement is an expression, we compile it separately
             // in an interactive mode (This will trigger the display hook)
             py::object last_stmt = expressions[py::len(expressions) - 1];
-            if (py::isinstance(last_stmt, ast.attr("Expr")) && !config.silent)
+            if (py::isinstance(last_stmt, ast.attr("Expr")) && !silent)
             {
                 code_ast.attr("body").attr("pop")();
 
@@ -183,28 +251,119 @@ namespace xpyt
 
                 py::object interactive_ast = ast.attr("Interactive")(interactive_nodes);
 
-                py::object compiled_code = builtins.attr("compile")(code_ast, filename, "exec");
+                res.m_interactive = builtins.attr("compile")(interactive_ast, filename, "single");
+            }
+            res.m_body = builtins.attr("compile")(code_ast, filename, "exec");
+            return res;
+        }
+    }
 
-                py::object compiled_interactive_code = builtins.attr("compile")(interactive_ast, filename, "single");
+    void raw_interpreter::execute_request_impl(
+        send_reply_callback cb,
+        int execution_count,
+        const std::string& code,
+        xeus::execute_request_config config,
+        nl::json /*user_expressions*/)
+    {
+        std::cout<<"execute_request_impl()"<<std::endl;
+        py::gil_scoped_acquire acquire;
+        get_hibernation().wake();
+
+        std::string subshell = subshell_id(get_request_context());
+        if (!subshell.empty())
+        {
+            if (!execute_in_subshell(subshell, m_global_dict, code, config.silent, cb))
+            {
+                cb(xeus::create_error_reply("SubshellError", "Unknown subshell " + subshell, nl::json::array()));
+            }
+            return;
+        }
+
+        xexecution_timer timer;
+        timer.activate();
+        get_gc_tuner().begin_cell();
+        xmemory_probe memory;
+        p_snapshot->begin_execution();
+
+        auto send_reply = [this, &cb, &timer, &memory, execution_count](nl::json reply)
+        {
+            set_input_allowed(false);
+            p_snapshot->end_execution(m_global_dict);
+            timer.mark(xphase::finalize);
+            timer.deactivate();
+            if (execution_timing_enabled())
+            {
+                reply["execution_timing"] = timer.to_json();
+            }
+            if (memory.active())
+            {
+                reply["memory"] = memory.stop(execution_count);
+            }
+            if (get_gc_tuner().enabled())
+            {
+                reply["gc"] = get_gc_tuner().end_cell(execution_count);
+            }
+            cb(std::move(reply));
+            timer.mark(xphase::reply);
+            timer.record();
+            get_gc_tuner().after_reply();
+
+            std::vector<std::string> allow_list;
+            if (take_soft_restart_request(allow_list))
+            {
+                soft_restart(allow_list);
+            }
+            get_hibernation().arm(m_global_dict);
+        };
+
+        py::str code_copy;
+        set_input_allowed(config.allow_stdin);
+        code_copy = code;
+        timer.mark(xphase::input_setup);
+        try
+        {
+            std::string filename = get_cell_tmp_file(code);
+            register_filename_mapping(filename, execution_count);
+
+            // The split of the cell and its compilation only depend on the
+            // code and on the silent flag, identical cells are compiled once.
+            // The entry is copied since the cell may clear the cache.
+            const int flags = config.silent ? 1 : 0;
+            xcode_cache& cache = get_code_cache();
+            xcode_cache::entry compiled;
+            if (!cache.find(code, flags, compiled))
+            {
+                compiled = compile_cell(code_copy, filename, config.silent);
+                cache.insert(code, flags, compiled);
+            }
+            timer.mark(xphase::compile);
 
+            begin_interruptible_execution();
+
+            // If the last statement is an expression, it has been compiled
+            // separately in interactive mode (This will trigger the display hook)
+            if (!compiled.m_interactive.is_none())
+            {
                 if (m_displayhook.ptr() != nullptr)
                 {
                     m_displayhook.attr("set_execution_count")(execution_count);
                 }
 
-                exec(compiled_code, m_global_dict);
-                exec(compiled_interactive_code, m_global_dict   );
+                exec(compiled.m_body, m_global_dict);
+                exec(compiled.m_interactive, m_global_dict);
             }
             else
             {
                 splinter_cell guard;
-                py::object compiled_code = builtins.attr("compile")(code_ast, filename, "exec");
-                exec(compiled_code, m_global_dict);
+                exec(compiled.m_body, m_global_dict);
             }
-
+            end_interruptible_execution();
+            timer.mark(xphase::user_code);
         }
         catch (py::error_already_set& e)
         {
+            end_interruptible_execution();
+            timer.mark(xphase::user_code);
             xerror error = extract_already_set_error(e);
 
             if (error.m_ename == "SyntaxError")
@@ -220,7 +379,7 @@ namespace xpyt
                 publish_execution_error(error.m_ename, error.m_evalue, error.m_traceback);
             }
 
-            cb(xeus::create_error_reply(error.m_ename, error.m_evalue, error.m_traceback));
+            send_reply(xeus::create_error_reply(error.m_ename, error.m_evalue, error.m_traceback));
             return;
         }
 
@@ -229,14 +388,21 @@ namespace xpyt
         m_global_dict["_ii"] = m_global_dict["_i"];
         m_global_dict["_i"] = code;
 
-        cb(xeus::create_successful_reply(nl::json::array(), nl::json::object()));
+        send_reply(xeus::create_successful_reply(nl::json::array(), nl::json::object()));
     }
 
     nl::json raw_interpreter::complete_request_impl(
         const std::string& code,
         int cursor_pos)
     {
+        if (p_snapshot->busy())
+        {
+            py::gil_scoped_acquire acquire;
+            return p_snapshot->complete(code, cursor_pos);
+        }
         py::gil_scoped_acquire acquire;
+        ensure_jedi_configured();
+        get_hibernation().wake();
         std::vector<std::string> matches;
         int cursor_start = cursor_pos;
 
@@ -258,8 +424,14 @@ namespace xpyt
         int cursor_pos,
         int /*detail_level*/)
     {
-
+        if (p_snapshot->busy())
+        {
+            py::gil_scoped_acquire acquire;
+            return p_snapshot->inspect(code, cursor_pos);
+        }
         py::gil_scoped_acquire acquire;
+        ensure_jedi_configured();
+        get_hibernation().wake();
         nl::json kernel_res;
         nl::json pub_data;
 
@@ -331,47 +503,44 @@ namespace xpyt
 
     nl::json raw_interpreter::shutdown_request_impl(bool /*restart*/)
     {
+        {
+            // The interned handles belong to the interpreter that is
+            // going away
+            py::gil_scoped_acquire acquire;
+            stop_subshells();
+            clear_handles();
+        }
         return xeus::create_shutdown_reply(false);
     }
 
     nl::json raw_interpreter::interrupt_request_impl()
     {
+        interrupt_execution();
         return xeus::create_interrupt_reply();
     }
 
     void raw_interpreter::set_request_context(xeus::xrequest_context context)
     {
         py::gil_scoped_acquire acquire;
-        py::module context_module = get_request_context_module();
-        context_module.attr("set_request_context")(context);
+        store_request_context(std::move(context));
     }
 
     namespace
     {
-        xeus::xrequest_context empty_request_context{};     
+        const xeus::xrequest_context empty_request_context{};
     }
 
     const xeus::xrequest_context& raw_interpreter::get_request_context() const noexcept
     {
         py::gil_scoped_acquire acquire;
-        py::module context_module = get_request_context_module();
-        // When the debugger is started, it send some python code to execute, that triggers
-        // a call to publish_stream, and ultimately to this function. However:
-        // - we are out of the handling of an execute_request, therefore set_request_context
-        // has not been called
-        // - we cannot set it from another thread (the context of the context variable would
-        // be different)
-        // Therefore, we have to catch the exception thrown when the context variable is empty.
-        try
-        {
-            py::object res = context_module.attr("get_request_context")();
-            return *(res.cast<xeus::xrequest_context*>());
-        }
-        catch (py::error_already_set& e)
-        {
-            return empty_request_context;
-        }
+        // The context is not set when the output does not come from a
+        // request, e.g. the code sent by the debugger when it starts, or
+        // when it comes from a thread started by the user, whose context
+        // is empty.
+        const xeus::xrequest_context* context = load_request_context();
+        return context != nullptr ? *context : empty_request_context;
     }
+
     void raw_interpreter::redirect_output()
     {
         py::module sys = py::module::import("sys");
@@ -0,0 +1,213 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <atomic>
+#include <csignal>
+#include <iostream>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define XPYT_HAS_PTHREAD_KILL
+#include <pthread.h>
+#endif
+
+#include "pybind11/pybind11.h"
+
+#include "xinterrupt.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    namespace
+    {
+        std::atomic<bool> executing{false};
+        std::atomic<unsigned long> executing_thread{0};
+        // Whether the cell runs as an asyncio task, and whether an interrupt
+        // is waiting for this task to start
+        std::atomic<bool> executing_task{false};
+        std::atomic<bool> deferred_interrupt{false};
+
+        // Set once the SIGINT handler is installed
+        std::atomic<bool> handler_installed{false};
+        unsigned long main_thread = 0;
+#ifdef XPYT_HAS_PTHREAD_KILL
+        pthread_t main_pthread;
+#endif
+
+        // Task running the current cell, if any. Guarded by the GIL, never
+        // destroyed since it may be referenced at exit.
+        py::object& cell_task()
+        {
+            static py::object* task = new py::object();
+            return *task;
+        }
+
+        bool cell_task_pending()
+        {
+            py::object& task = cell_task();
+            return task && !task.attr("done")().cast<bool>();
+        }
+
+        void raise_async_interrupt(unsigned long thread_id)
+        {
+            py::gil_scoped_acquire acquire;
+            if (executing_task.load() && !cell_task())
+            {
+                deferred_interrupt.store(true);
+                return;
+            }
+            if (cell_task_pending())
+            {
+                py::object task = cell_task();
+                task.attr("get_loop")().attr("call_soon_threadsafe")(task.attr("cancel"));
+                return;
+            }
+            PyThreadState_SetAsyncExc(thread_id, PyExc_KeyboardInterrupt);
+        }
+
+        // Called in the main thread when a cell is executing
+        void on_interrupt()
+        {
+            py::module asyncio = py::module::import("asyncio");
+            py::object loop = asyncio.attr("_get_running_loop")();
+            if (loop.is_none() || !executing_task.load())
+            {
+                // The cell runs outside of the loop, or synchronously in
+                // the callback of the loop being run
+                PyErr_SetNone(PyExc_KeyboardInterrupt);
+                throw py::error_already_set();
+            }
+
+            // Raising outside of the task of the cell, e.g. in another
+            // callback of the loop, would stop the loop
+            py::object task = cell_task();
+            if (!task)
+            {
+                // The task of the cell has not started yet, it is cancelled
+                // by record_interruptible_task
+                deferred_interrupt.store(true);
+                return;
+            }
+            if (asyncio.attr("current_task")(loop).is(task))
+            {
+                PyErr_SetNone(PyExc_KeyboardInterrupt);
+                throw py::error_already_set();
+            }
+            if (!task.attr("done")().cast<bool>())
+            {
+                // The cell awaits
+                task.attr("cancel")();
+            }
+        }
+    }
+
+    bool install_interrupt_handler()
+    {
+#ifdef __EMSCRIPTEN__
+        // No signal can be sent to the kernel
+        return false;
+#else
+        // Called by Python in the main thread when it processes the signal
+        py::cpp_function handler([](py::object /*signum*/, py::object /*frame*/)
+        {
+            if (executing.load())
+            {
+                on_interrupt();
+            }
+        });
+
+        try
+        {
+            py::module signal_module = py::module::import("signal");
+            signal_module.attr("signal")(signal_module.attr("SIGINT"), handler);
+        }
+        catch (py::error_already_set& e)
+        {
+            std::clog << "cannot install the interrupt handler: " << e.what() << std::endl;
+            return false;
+        }
+
+        main_thread = PyThread_get_thread_ident();
+#ifdef XPYT_HAS_PTHREAD_KILL
+        main_pthread = pthread_self();
+#endif
+        handler_installed.store(true);
+        return true;
+#endif
+    }
+
+    void begin_interruptible_execution()
+    {
+        executing_task.store(false);
+        deferred_interrupt.store(false);
+        executing_thread.store(PyThread_get_thread_ident());
+        executing.store(true);
+    }
+
+    void begin_interruptible_task()
+    {
+        executing_task.store(true);
+        deferred_interrupt.store(false);
+        executing_thread.store(PyThread_get_thread_ident());
+        executing.store(true);
+    }
+
+    void end_interruptible_execution()
+    {
+        executing.store(false);
+        executing_task.store(false);
+        deferred_interrupt.store(false);
+        cell_task() = py::object();
+    }
+
+    void record_interruptible_task()
+    {
+        py::module asyncio = py::module::import("asyncio");
+        py::object loop = asyncio.attr("_get_running_loop")();
+        cell_task() = loop.is_none() ? py::object() : asyncio.attr("current_task")(loop);
+        if (cell_task().is_none())
+        {
+            cell_task() = py::object();
+        }
+        else if (deferred_interrupt.exchange(false))
+        {
+            // Interrupted before it started: raising here would be caught
+            // by the caller of the hook, the task is cancelled instead
+            cell_task().attr("cancel")();
+        }
+    }
+
+    bool interruptible_execution_running()
+    {
+        return executing.load();
+    }
+
+    void interrupt_execution()
+    {
+        if (!executing.load())
+        {
+            return;
+        }
+
+        unsigned long thread_id = executing_thread.load();
+        if (handler_installed.load() && thread_id == main_thread)
+        {
+#ifdef XPYT_HAS_PTHREAD_KILL
+            // Delivered to the main thread, a blocking system call returns
+            // with EINTR and the handler runs right away.
+            pthread_kill(main_pthread, SIGINT);
+#else
+            PyErr_SetInterrupt();
+#endif
+            return;
+        }
+        raise_async_interrupt(thread_id);
+    }
+}
@@ -0,0 +1,64 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_INTERRUPT_HPP
+#define XPYT_INTERRUPT_HPP
+
+namespace xpyt
+{
+    /**
+     * Interruption of the cell being executed.
+     *
+     * Both kinds of interrupts of the Jupyter protocol raise a
+     * KeyboardInterrupt in the code of the cell and leave the kernel
+     * alive:
+     *
+     * - signal: SIGINT is handled by a Python signal handler which raises
+     *   KeyboardInterrupt when the code of a cell is running and is ignored
+     *   otherwise, so that the asyncio loop of the kernel is never
+     *   interrupted. A cell run as an asyncio task which is awaiting, while
+     *   the loop waits for events or runs other callbacks, is cancelled
+     *   instead: CancelledError is raised at its await. An interrupt
+     *   received before the task of the cell has started is deferred, the
+     *   task is cancelled when it starts.
+     * - message: interrupt_request, handled by the control thread, sends
+     *   SIGINT to the main thread so that blocking calls such as sleep
+     *   return early. When the cell does not run in the main thread, or
+     *   when the signal handler is not installed, a KeyboardInterrupt is
+     *   set as an asynchronous exception of the executing thread, which
+     *   raises it at its next bytecode boundary.
+     */
+
+    // Replaces the Python handler of SIGINT. Must be called from the main
+    // thread with the GIL held, returns false if it cannot be installed.
+    bool install_interrupt_handler();
+
+    // Called by the thread executing a cell, around the code of the user.
+    // begin_interruptible_task is called instead when the code runs in an
+    // asyncio task which calls record_interruptible_task. The thread must
+    // hold the GIL.
+    void begin_interruptible_execution();
+    void begin_interruptible_task();
+    void end_interruptible_execution();
+
+    // Called by the task running the cell, once it has started. Records
+    // the task to cancel when the cell is interrupted while it awaits.
+    // Requires the GIL.
+    void record_interruptible_task();
+
+    // Whether a cell can be interrupted
+    bool interruptible_execution_running();
+
+    // Interrupts the cell being executed, if any. Can be called from any
+    // thread, acquires the GIL when needed.
+    void interrupt_execution();
+}
+
+#endif
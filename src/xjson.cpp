@@ -0,0 +1,178 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "pybind11_json/pybind11_json.hpp"
+
+#include "xjson.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        nl::json::string_t to_json_string(PyObject* obj)
+        {
+            Py_ssize_t size = 0;
+            const char* data = PyUnicode_AsUTF8AndSize(obj, &size);
+            if (data == nullptr)
+            {
+                throw py::error_already_set();
+            }
+            return nl::json::string_t(data, static_cast<std::size_t>(size));
+        }
+
+        // Guards the recursion on self-referencing containers
+        class recursion_guard
+        {
+        public:
+
+            recursion_guard()
+            {
+                if (Py_EnterRecursiveCall(" while converting an object to JSON") != 0)
+                {
+                    throw py::error_already_set();
+                }
+            }
+
+            ~recursion_guard()
+            {
+                Py_LeaveRecursiveCall();
+            }
+
+            recursion_guard(const recursion_guard&) = delete;
+            recursion_guard& operator=(const recursion_guard&) = delete;
+        };
+
+        nl::json convert(PyObject* obj);
+
+        nl::json convert_sequence(PyObject* obj)
+        {
+            recursion_guard guard;
+            // Lists may be resized by the conversion of their items
+            py::object items = py::reinterpret_steal<py::object>(PySequence_Fast(obj, ""));
+            if (!items)
+            {
+                throw py::error_already_set();
+            }
+            Py_ssize_t size = PySequence_Fast_GET_SIZE(items.ptr());
+            nl::json res = nl::json::array();
+            auto& array = res.get_ref<nl::json::array_t&>();
+            array.reserve(static_cast<std::size_t>(size));
+            for (Py_ssize_t i = 0; i < size; ++i)
+            {
+                array.push_back(convert(PySequence_Fast_GET_ITEM(items.ptr(), i)));
+            }
+            return res;
+        }
+
+        nl::json convert_dict(PyObject* obj)
+        {
+            recursion_guard guard;
+            nl::json res = nl::json::object();
+            auto& object = res.get_ref<nl::json::object_t&>();
+            PyObject* key;
+            PyObject* value;
+            Py_ssize_t pos = 0;
+            while (PyDict_Next(obj, &pos, &key, &value))
+            {
+                // The references are borrowed, the conversion of a value
+                // must not release them
+                py::object key_ref = py::reinterpret_borrow<py::object>(key);
+                py::object value_ref = py::reinterpret_borrow<py::object>(value);
+                nl::json::string_t name = PyUnicode_CheckExact(key)
+                    ? to_json_string(key)
+                    : py::str(key).cast<std::string>();
+
+                // Mime bundles mostly map strings to strings
+                if (PyUnicode_CheckExact(value))
+                {
+                    object[std::move(name)] = to_json_string(value);
+                }
+                else
+                {
+                    object[std::move(name)] = convert(value);
+                }
+            }
+            return res;
+        }
+
+        nl::json convert(PyObject* obj)
+        {
+            if (obj == Py_None)
+            {
+                return nullptr;
+            }
+            if (PyUnicode_CheckExact(obj))
+            {
+                return to_json_string(obj);
+            }
+            if (PyDict_CheckExact(obj))
+            {
+                return convert_dict(obj);
+            }
+            if (PyList_CheckExact(obj) || PyTuple_CheckExact(obj))
+            {
+                return convert_sequence(obj);
+            }
+            if (PyBool_Check(obj))
+            {
+                return obj == Py_True;
+            }
+            if (PyLong_CheckExact(obj))
+            {
+                int overflow = 0;
+                long long value = PyLong_AsLongLongAndOverflow(obj, &overflow);
+                if (overflow == 0)
+                {
+                    if (value == -1 && PyErr_Occurred())
+                    {
+                        throw py::error_already_set();
+                    }
+                    return static_cast<nl::json::number_integer_t>(value);
+                }
+                if (overflow > 0)
+                {
+                    unsigned long long unsigned_value = PyLong_AsUnsignedLongLong(obj);
+                    if (!PyErr_Occurred())
+                    {
+                        return static_cast<nl::json::number_unsigned_t>(unsigned_value);
+                    }
+                    PyErr_Clear();
+                }
+            }
+            else if (PyFloat_CheckExact(obj))
+            {
+                return PyFloat_AS_DOUBLE(obj);
+            }
+            // Bytes, subclasses and errors
+            return nl::json(py::reinterpret_borrow<py::object>(obj));
+        }
+    }
+
+    nl::json pyobject_to_json(py::handle obj)
+    {
+        return obj.ptr() == nullptr ? nl::json(nullptr) : convert(obj.ptr());
+    }
+
+    nl::json pyobject_to_json_object(py::handle obj)
+    {
+        return obj.ptr() == nullptr || obj.is_none() ? nl::json::object() : convert(obj.ptr());
+    }
+}
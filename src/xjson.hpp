@@ -0,0 +1,42 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_JSON_HPP
+#define XPYT_JSON_HPP
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Conversion of the Python objects published by the kernel (mime
+     * bundles, metadata, comm data, payloads) to JSON.
+     *
+     * Same result as the conversion of pybind11_json, but the builtin types
+     * are read with the C API, without creating intermediate Python or C++
+     * objects: strings are copied once from their UTF-8 representation,
+     * which CPython caches, straight into the JSON value, and containers
+     * are reserved to their final size. Subclasses and other types go
+     * through pybind11_json. A null handle or None gives null.
+     *
+     * Requires the GIL.
+     */
+    nl::json pyobject_to_json(py::handle obj);
+
+    // Same as above, None gives an empty object (transient, metadata)
+    nl::json pyobject_to_json_object(py::handle obj);
+}
+
+#endif
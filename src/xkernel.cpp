@@ -172,11 +172,18 @@ namespace xpyt_raw
             .def("on_msg", &xpyt::xcomm::on_msg)
             .def("on_close", &xpyt::xcomm::on_close)
             .def_property_readonly("comm_id", &xpyt::xcomm::comm_id)
-            .def_property_readonly("kernel", &xpyt::xcomm::kernel);
+            .def_property_readonly("kernel", &xpyt::xcomm::kernel)
+            .def_property_readonly("compression", &xpyt::xcomm::compression)
+            .def_property_readonly("shared_memory", &xpyt::xcomm::shared_memory)
+            .def_property_readonly("conflation_stats", &xpyt::xcomm::conflation_stats)
+            .def_property("conflate", &xpyt::xcomm::conflate, &xpyt::xcomm::set_conflate)
+            .def_property("max_concurrency", &xpyt::xcomm::max_concurrency, &xpyt::xcomm::set_max_concurrency)
+            .def_property("ordered", &xpyt::xcomm::ordered, &xpyt::xcomm::set_ordered);
 
         py::class_<xpyt::xcomm_manager>(kernel_module, "CommManager")
             .def(py::init<>())
-            .def("register_target", &xpyt::xcomm_manager::register_target);
+            .def("register_target", &xpyt::xcomm_manager::register_target)
+            .def("get_comm", &xpyt::xcomm_manager::get_comm);
     }
 
     void bind_mock_objects(py::module& kernel_module)
@@ -266,6 +273,79 @@ namespace xpyt
         return kernel_module;
     }
 
+    namespace
+    {
+        constexpr const char* request_context_capsule = "xeus_python.request_context";
+
+        // Leaked, it is shared by the contexts of the interpreter
+        PyObject* request_context_var()
+        {
+            static PyObject* var = PyContextVar_New("request_context", nullptr);
+            return var;
+        }
+
+        void release_request_context(PyObject* capsule)
+        {
+            delete static_cast<xeus::xrequest_context*>(PyCapsule_GetPointer(capsule, request_context_capsule));
+        }
+
+        // Last capsule read by the thread, see load_request_context. A
+        // raw pointer since threads exit without the GIL: the last capsule
+        // of each thread is leaked.
+        thread_local PyObject* pinned_capsule = nullptr;
+    }
+
+    void store_request_context(xeus::xrequest_context context)
+    {
+        auto* ptr = new xeus::xrequest_context(std::move(context));
+        PyObject* capsule = PyCapsule_New(ptr, request_context_capsule, release_request_context);
+        if (capsule == nullptr)
+        {
+            delete ptr;
+            throw py::error_already_set();
+        }
+        PyObject* token = PyContextVar_Set(request_context_var(), capsule);
+        Py_DECREF(capsule);
+        if (token == nullptr)
+        {
+            throw py::error_already_set();
+        }
+        Py_DECREF(token);
+    }
+
+    const xeus::xrequest_context* load_request_context() noexcept
+    {
+        PyObject* capsule = nullptr;
+        if (PyContextVar_Get(request_context_var(), nullptr, &capsule) != 0)
+        {
+            PyErr_Clear();
+            return nullptr;
+        }
+        if (capsule == nullptr)
+        {
+            return nullptr;
+        }
+        // The new reference replaces the one of the previous call, the
+        // context of the previous capsule is deleted if it was the last
+        // reference on it.
+        if (capsule == pinned_capsule)
+        {
+            Py_DECREF(capsule);
+        }
+        else
+        {
+            PyObject* previous = pinned_capsule;
+            pinned_capsule = capsule;
+            Py_XDECREF(previous);
+        }
+        void* ptr = PyCapsule_GetPointer(capsule, request_context_capsule);
+        if (ptr == nullptr)
+        {
+            PyErr_Clear();
+        }
+        return static_cast<const xeus::xrequest_context*>(ptr);
+    }
+
     py::module make_request_context_module()
     {
         py::module context_module = create_module("request_context_module");
@@ -274,16 +354,22 @@ namespace xpyt
             .def(py::init<>())
             .def_property_readonly("header", &xeus::xrequest_context::header);
 
-        exec(py::str(R"(
-import contextvars as cv
-request_context = cv.ContextVar('request_context')
-
-def set_request_context(ctx):
-    request_context.set(ctx)
-
-def get_request_context():
-    return request_context.get()
-        )"), context_module.attr("__dict__"));
+        // The values of the variable are capsules, Python code goes through
+        // set_request_context and get_request_context to use RequestContext
+        context_module.attr("request_context") = py::reinterpret_borrow<py::object>(request_context_var());
+        context_module.def("set_request_context", [](const xeus::xrequest_context& context)
+        {
+            store_request_context(context);
+        });
+        context_module.def("get_request_context", []()
+        {
+            const xeus::xrequest_context* context = load_request_context();
+            if (context == nullptr)
+            {
+                throw py::key_error("request_context");
+            }
+            return *context;
+        });
 
         return context_module;
     }
@@ -11,6 +11,8 @@
 #ifndef XPYT_KERNEL_HPP
 #define XPYT_KERNEL_HPP
 
+#include "xeus/xrequest_context.hpp"
+
 #include "pybind11/pybind11.h"
 
 namespace py = pybind11;
@@ -20,6 +22,26 @@ namespace xpyt
     py::module get_kernel_module(bool raw_mode = false);
 
     py::module get_request_context_module();
+
+    /**
+     * Context of the request being handled, stored in a context variable
+     * so that it follows the asyncio tasks and the contexts copied by the
+     * code of the user. The variable is created with the C API and holds a
+     * capsule owning the context: reading it is a lookup in the current
+     * context, without Python call, cast nor copy. request_context_module
+     * exposes the same variable to the Python code; its values are these
+     * capsules and no longer RequestContext objects, set_request_context
+     * and get_request_context convert from and to RequestContext.
+     *
+     * Both functions require the GIL.
+     */
+    void store_request_context(xeus::xrequest_context context);
+
+    // nullptr if no request context is set in the current context. The
+    // thread keeps a reference on the capsule holding the returned
+    // context, which remains valid until the next call on this thread,
+    // even if the variable is set again meanwhile.
+    const xeus::xrequest_context* load_request_context() noexcept;
 }
 
 #endif
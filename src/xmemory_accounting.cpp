@@ -0,0 +1,300 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define XPYT_HAS_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xmemory_accounting.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        constexpr std::int64_t unavailable = -1;
+
+        std::atomic<bool> accounting_enabled{false};
+        std::atomic<std::size_t> top_allocations{0};
+        std::atomic<bool> peak_reset_enabled{false};
+        // Whether tracemalloc was started by the accounting, a tracing
+        // started by the user is left running
+        std::atomic<bool> tracemalloc_started{false};
+
+        struct rss_sample
+        {
+            std::int64_t m_rss = unavailable;
+            std::int64_t m_peak = unavailable;
+        };
+
+        // VmRSS and VmHWM, in kB in /proc/self/status
+        rss_sample read_proc_status()
+        {
+            rss_sample res;
+            std::ifstream status("/proc/self/status");
+            std::string line;
+            while (std::getline(status, line))
+            {
+                if (line.compare(0, 6, "VmRSS:") == 0)
+                {
+                    res.m_rss = std::stoll(line.substr(6)) * 1024;
+                }
+                else if (line.compare(0, 6, "VmHWM:") == 0)
+                {
+                    res.m_peak = std::stoll(line.substr(6)) * 1024;
+                }
+            }
+            return res;
+        }
+
+        // Resets VmHWM to the current RSS, Linux only. Writing clear_refs
+        // affects the whole process: it also clears the soft-dirty bits of
+        // its pages.
+        bool reset_peak_rss()
+        {
+            std::ofstream clear_refs("/proc/self/clear_refs");
+            clear_refs << "5";
+            clear_refs.close();
+            return static_cast<bool>(clear_refs);
+        }
+
+        struct usage_sample
+        {
+            std::int64_t m_peak = unavailable;
+            std::int64_t m_minor_faults = unavailable;
+            std::int64_t m_major_faults = unavailable;
+        };
+
+        usage_sample read_usage()
+        {
+            usage_sample res;
+#ifdef XPYT_HAS_GETRUSAGE
+            struct rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) == 0)
+            {
+#ifdef __APPLE__
+                res.m_peak = static_cast<std::int64_t>(usage.ru_maxrss);
+#else
+                res.m_peak = static_cast<std::int64_t>(usage.ru_maxrss) * 1024;
+#endif
+                res.m_minor_faults = static_cast<std::int64_t>(usage.ru_minflt);
+                res.m_major_faults = static_cast<std::int64_t>(usage.ru_majflt);
+            }
+#endif
+            return res;
+        }
+
+        nl::json difference(std::int64_t after, std::int64_t before)
+        {
+            if (after == unavailable || before == unavailable)
+            {
+                return nullptr;
+            }
+            return after - before;
+        }
+
+        nl::json value_or_null(std::int64_t value)
+        {
+            return value == unavailable ? nl::json(nullptr) : nl::json(value);
+        }
+
+        std::int64_t allocated_blocks()
+        {
+            return py::module::import("sys").attr("getallocatedblocks")().cast<std::int64_t>();
+        }
+
+        py::object take_tracemalloc_snapshot()
+        {
+            py::module tracemalloc = py::module::import("tracemalloc");
+            if (!tracemalloc.attr("is_tracing")().cast<bool>())
+            {
+                return py::none();
+            }
+            py::tuple filters = py::make_tuple(
+                tracemalloc.attr("Filter")(false, tracemalloc.attr("__file__"))
+            );
+            return tracemalloc.attr("take_snapshot")().attr("filter_traces")(filters);
+        }
+
+        nl::json top_allocation_sites(const py::object& before, std::size_t count)
+        {
+            py::object after = take_tracemalloc_snapshot();
+            if (after.is_none() || before.is_none())
+            {
+                return nullptr;
+            }
+            nl::json res = nl::json::array();
+            for (py::handle stat : after.attr("compare_to")(before, "lineno"))
+            {
+                if (res.size() == count)
+                {
+                    break;
+                }
+                res.push_back({
+                    {"site", py::str(stat.attr("traceback")[py::int_(0)]).cast<std::string>()},
+                    {"size_diff", stat.attr("size_diff").cast<std::int64_t>()},
+                    {"count_diff", stat.attr("count_diff").cast<std::int64_t>()}
+                });
+            }
+            return res;
+        }
+    }
+
+    bool memory_accounting_enabled()
+    {
+        return accounting_enabled.load(std::memory_order_relaxed);
+    }
+
+    void set_memory_accounting(bool enabled, std::size_t top, bool reset_peak)
+    {
+        std::size_t new_top = enabled ? top : 0;
+        std::size_t old_top = top_allocations.exchange(new_top);
+        py::module tracemalloc = py::module::import("tracemalloc");
+        if (old_top == 0 && new_top != 0 && !tracemalloc.attr("is_tracing")().cast<bool>())
+        {
+            tracemalloc.attr("start")();
+            tracemalloc_started.store(true);
+        }
+        else if (old_top != 0 && new_top == 0 && tracemalloc_started.exchange(false))
+        {
+            tracemalloc.attr("stop")();
+        }
+        peak_reset_enabled.store(enabled && reset_peak, std::memory_order_relaxed);
+        accounting_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    /********************************
+     * xmemory_probe implementation *
+     ********************************/
+
+    xmemory_probe::xmemory_probe()
+        : m_active(memory_accounting_enabled())
+        , m_peak_reset(false)
+        , m_rss(unavailable)
+        , m_peak_rss(unavailable)
+        , m_minor_faults(unavailable)
+        , m_major_faults(unavailable)
+        , m_allocated_blocks(0)
+        , m_top(0)
+    {
+        if (!m_active)
+        {
+            return;
+        }
+
+        m_top = top_allocations.load();
+        if (m_top != 0)
+        {
+            m_snapshot = take_tracemalloc_snapshot();
+        }
+        m_allocated_blocks = allocated_blocks();
+
+        m_peak_reset = peak_reset_enabled.load(std::memory_order_relaxed) && reset_peak_rss();
+        rss_sample rss = read_proc_status();
+        usage_sample usage = read_usage();
+        m_rss = rss.m_rss;
+        m_peak_rss = m_peak_reset ? rss.m_rss : (rss.m_peak != unavailable ? rss.m_peak : usage.m_peak);
+        m_minor_faults = usage.m_minor_faults;
+        m_major_faults = usage.m_major_faults;
+    }
+
+    bool xmemory_probe::active() const
+    {
+        return m_active;
+    }
+
+    nl::json xmemory_probe::stop(int execution_count)
+    {
+        rss_sample rss = read_proc_status();
+        usage_sample usage = read_usage();
+        std::int64_t peak = rss.m_peak != unavailable ? rss.m_peak : usage.m_peak;
+        std::int64_t blocks = allocated_blocks();
+
+        // Growth of the peak of the process when it could not be reset
+        nl::json peak_delta = nullptr;
+        if (m_peak_reset && peak != unavailable && m_rss != unavailable)
+        {
+            peak_delta = peak - m_rss;
+        }
+        else if (peak != unavailable && m_peak_rss != unavailable)
+        {
+            peak_delta = std::max<std::int64_t>(peak - m_peak_rss, 0);
+        }
+
+        nl::json res = {
+            {"execution_count", execution_count},
+            {"rss", value_or_null(rss.m_rss)},
+            {"rss_delta", difference(rss.m_rss, m_rss)},
+            {"peak_rss_delta", std::move(peak_delta)},
+            {"peak_reset", m_peak_reset},
+            {"page_faults", {
+                {"minor", difference(usage.m_minor_faults, m_minor_faults)},
+                {"major", difference(usage.m_major_faults, m_major_faults)}
+            }},
+            {"allocated_blocks", blocks - m_allocated_blocks}
+        };
+        if (m_top != 0)
+        {
+            res["top_allocations"] = top_allocation_sites(m_snapshot, m_top);
+            m_snapshot = py::object();
+        }
+
+        get_memory_history().add(res);
+        return res;
+    }
+
+    /**********************************
+     * xmemory_history implementation *
+     **********************************/
+
+    void xmemory_history::add(nl::json entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_entries.size() == capacity)
+        {
+            m_entries.pop_front();
+        }
+        m_entries.push_back(std::move(entry));
+    }
+
+    nl::json xmemory_history::to_json() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return nl::json(m_entries);
+    }
+
+    void xmemory_history::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+    }
+
+    xmemory_history& get_memory_history()
+    {
+        static xmemory_history history;
+        return history;
+    }
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_MEMORY_ACCOUNTING_HPP
+#define XPYT_MEMORY_ACCOUNTING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Memory used by the execution of a cell, off by default.
+     *
+     * - rss: resident set size after the cell, and its change
+     * - peak_rss_delta: peak resident set size during the cell minus the
+     *   size before it. When requested, on Linux, the peak of the process
+     *   is reset before each cell by writing /proc/self/clear_refs, which
+     *   also clears the soft-dirty bits of all the pages of the process.
+     *   Otherwise (or when the reset is not permitted) it is the growth of
+     *   the peak of the process, and peak_reset is false.
+     * - page_faults: minor and major page faults of the process
+     * - allocated_blocks: change of the number of blocks allocated by the
+     *   Python allocator
+     * - top_allocations: when requested, the source lines which allocated
+     *   the most memory according to tracemalloc, which is then started.
+     *   tracemalloc slows down all the allocations. It is stopped with the
+     *   accounting only if the accounting started it.
+     *
+     * Sizes are in bytes, unavailable measures are null.
+     */
+
+    bool memory_accounting_enabled();
+
+    // Requires the GIL, starts or stops tracemalloc when top_allocations
+    // changes from or to 0.
+    void set_memory_accounting(bool enabled, std::size_t top_allocations, bool reset_peak = false);
+
+    /**
+     * Measure of an execute request. Does nothing, and has no cost, when
+     * the accounting is disabled. Requires the GIL.
+     */
+    class xmemory_probe
+    {
+    public:
+
+        xmemory_probe();
+
+        xmemory_probe(const xmemory_probe&) = delete;
+        xmemory_probe& operator=(const xmemory_probe&) = delete;
+
+        bool active() const;
+
+        // Returns the measures and adds them to the session history
+        nl::json stop(int execution_count);
+
+    private:
+
+        bool m_active;
+        bool m_peak_reset;
+        std::int64_t m_rss;
+        std::int64_t m_peak_rss;
+        std::int64_t m_minor_faults;
+        std::int64_t m_major_faults;
+        std::int64_t m_allocated_blocks;
+        std::size_t m_top;
+        py::object m_snapshot;
+    };
+
+    /**
+     * Measures of the last cells of the session.
+     */
+    class xmemory_history
+    {
+    public:
+
+        static constexpr std::size_t capacity = 1000;
+
+        void add(nl::json entry);
+        nl::json to_json() const;
+        void clear();
+
+    private:
+
+        mutable std::mutex m_mutex;
+        std::deque<nl::json> m_entries;
+    };
+
+    xmemory_history& get_memory_history();
+}
+
+#endif
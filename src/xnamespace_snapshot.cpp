@@ -0,0 +1,140 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xhelper.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xinspect.hpp"
+#include "xnamespace_snapshot.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        // Objects that can stand for themselves in the snapshot: they are
+        // shared by the cells and rarely mutated.
+        bool is_static_object(py::handle value)
+        {
+            PyObject* obj = value.ptr();
+            return PyModule_Check(obj) || PyType_Check(obj) || PyFunction_Check(obj) || PyCFunction_Check(obj);
+        }
+
+        nl::json approximate_metadata()
+        {
+            return nl::json{{"approximate", true}};
+        }
+    }
+
+    void xnamespace_snapshot::begin_execution()
+    {
+        m_busy.store(true);
+    }
+
+    void xnamespace_snapshot::end_execution(const py::dict& ns)
+    {
+        update(ns);
+        m_busy.store(false);
+    }
+
+    bool xnamespace_snapshot::busy() const
+    {
+        return m_busy.load();
+    }
+
+    void xnamespace_snapshot::update(const py::dict& ns)
+    {
+        py::dict res;
+        std::size_t count = 0;
+        for (auto item : ns)
+        {
+            if (!PyUnicode_Check(item.first.ptr()))
+            {
+                continue;
+            }
+            // Private names and the IPython history (_, _i1, _oh...)
+            std::string name = item.first.cast<std::string>();
+            if (name.empty() || name[0] == '_')
+            {
+                continue;
+            }
+            if (count++ == max_entries)
+            {
+                break;
+            }
+            py::handle value = item.second;
+            if (!is_static_object(value))
+            {
+                value = reinterpret_cast<PyObject*>(Py_TYPE(value.ptr()));
+            }
+            res[item.first] = value;
+        }
+
+        xstate_lock lock(m_mutex);
+        m_stubs = std::move(res);
+    }
+
+    py::dict xnamespace_snapshot::stubs() const
+    {
+        xstate_lock lock(m_mutex);
+        return m_stubs ? py::dict(m_stubs) : py::dict();
+    }
+
+    nl::json xnamespace_snapshot::complete(const std::string& code, int cursor_pos) const
+    {
+        std::vector<std::string> matches;
+        int cursor_start = cursor_pos;
+        try
+        {
+            py::list completions = get_completions(code, cursor_pos, stubs());
+            if (py::len(completions) != 0)
+            {
+                cursor_start -= py::len(completions[0].attr("name_with_symbols")) - py::len(completions[0].attr("complete"));
+                for (py::handle completion : completions)
+                {
+                    matches.push_back(completion.attr("name_with_symbols").cast<std::string>());
+                }
+            }
+        }
+        catch (py::error_already_set&)
+        {
+            // An approximate reply with no match rather than an error
+        }
+        return xeus::create_complete_reply(matches, cursor_start, cursor_pos, approximate_metadata());
+    }
+
+    nl::json xnamespace_snapshot::inspect(const std::string& code, int cursor_pos) const
+    {
+        nl::json data = nl::json::object();
+        bool found = false;
+        try
+        {
+            std::string docstring = formatted_docstring(code, cursor_pos, stubs());
+            if (!docstring.empty())
+            {
+                data["text/plain"] = docstring;
+                found = true;
+            }
+        }
+        catch (py::error_already_set&)
+        {
+        }
+        return xeus::create_inspect_reply(found, data, approximate_metadata());
+    }
+}
@@ -0,0 +1,78 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_NAMESPACE_SNAPSHOT_HPP
+#define XPYT_NAMESPACE_SNAPSHOT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xthreading.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Read-only view of the user namespace, taken at the end of each cell,
+     * used to answer completion and inspection requests received while a
+     * cell is running: on the control thread, or on the shell while the
+     * cell awaits.
+     *
+     * The snapshot maps the names of the namespace to their type, except
+     * for modules, classes and functions which are kept as they are. The
+     * objects of the user are never referenced, so completing from the
+     * snapshot cannot observe a namespace being modified by the cell nor
+     * run code of the user. Completions are computed by jedi on this
+     * snapshot and marked as approximate in the reply metadata.
+     *
+     * Methods taking Python objects require the GIL.
+     */
+    class xnamespace_snapshot
+    {
+    public:
+
+        static constexpr std::size_t max_entries = 10000;
+
+        xnamespace_snapshot() = default;
+
+        xnamespace_snapshot(const xnamespace_snapshot&) = delete;
+        xnamespace_snapshot& operator=(const xnamespace_snapshot&) = delete;
+
+        // Called by the thread executing a cell
+        void begin_execution();
+        void end_execution(const py::dict& ns);
+
+        // Whether a cell is being executed, in which case the namespace
+        // must not be used. Does not require the GIL.
+        bool busy() const;
+
+        void update(const py::dict& ns);
+
+        nl::json complete(const std::string& code, int cursor_pos) const;
+        nl::json inspect(const std::string& code, int cursor_pos) const;
+
+    private:
+
+        py::dict stubs() const;
+
+        mutable xstate_mutex m_mutex;
+        py::object m_stubs;
+        std::atomic<bool> m_busy{false};
+    };
+}
+
+#endif
@@ -0,0 +1,126 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "xeus/xcomm.hpp"
+#include "xeus/xinterpreter.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xeus-python/xnative_comm.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    namespace
+    {
+        struct native_target_registry
+        {
+            std::mutex m_mutex;
+            std::set<std::string> m_targets;
+        };
+
+        native_target_registry& get_registry()
+        {
+            static native_target_registry registry;
+            return registry;
+        }
+
+        // The shell thread dispatches the messages with the GIL held, it
+        // is only released for the native handlers.
+        template <class F>
+        void call_without_gil(F&& f)
+        {
+            if (PyGILState_Check())
+            {
+                py::gil_scoped_release release;
+                f();
+            }
+            else
+            {
+                f();
+            }
+        }
+
+        native_message_callback without_gil(const native_message_callback& callback)
+        {
+            return [callback](const xeus::xmessage& msg)
+            {
+                call_without_gil([&callback, &msg]() { callback(msg); });
+            };
+        }
+    }
+
+    void register_native_comm_target(const std::string& target_name, const native_target_callback& callback)
+    {
+        {
+            native_target_registry& registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            registry.m_targets.insert(target_name);
+        }
+
+        xeus::get_interpreter().comm_manager().register_comm_target(target_name,
+            [callback](xeus::xcomm&& comm, const xeus::xmessage& msg)
+            {
+                call_without_gil([&callback, &comm, &msg]() { callback(std::move(comm), msg); });
+            });
+    }
+
+    void unregister_native_comm_target(const std::string& target_name)
+    {
+        {
+            native_target_registry& registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            registry.m_targets.erase(target_name);
+        }
+        xeus::get_interpreter().comm_manager().unregister_comm_target(target_name);
+    }
+
+    bool is_native_comm_target(const std::string& target_name)
+    {
+        native_target_registry& registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        return registry.m_targets.count(target_name) != 0;
+    }
+
+    std::vector<std::string> native_comm_targets()
+    {
+        native_target_registry& registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        return std::vector<std::string>(registry.m_targets.cbegin(), registry.m_targets.cend());
+    }
+
+    xeus::xcomm make_native_comm(const std::string& target_name)
+    {
+        if (!is_native_comm_target(target_name))
+        {
+            throw std::runtime_error("no native comm target registered under the name " + target_name);
+        }
+        xeus::xtarget* target = xeus::get_interpreter().comm_manager().target(target_name);
+        return xeus::xcomm(target, xeus::new_xguid());
+    }
+
+    void on_native_message(xeus::xcomm& comm, const native_message_callback& callback)
+    {
+        comm.on_message(without_gil(callback));
+    }
+
+    void on_native_close(xeus::xcomm& comm, const native_message_callback& callback)
+    {
+        comm.on_close(without_gil(callback));
+    }
+}
@@ -0,0 +1,473 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xcomm.hpp"
+#include "xeus/xguid.hpp"
+#include "xeus/xinterpreter.hpp"
+#include "xeus/xmessage.hpp"
+#include "xeus/xrequest_context.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xcomm.hpp"
+#include "xnotebook_runner.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    bool extract_notebook_run_options(int& argc, char* argv[], xnotebook_run_options& options)
+    {
+        // argv is left untouched unless the runner is requested, the other
+        // options may belong to the kernel
+        int position = 0;
+        while (position + 1 < argc && std::string(argv[position]) != "--run-notebook")
+        {
+            ++position;
+        }
+        if (position + 1 >= argc)
+        {
+            return false;
+        }
+
+        int kept = 0;
+        for (int i = 0; i < argc; ++i)
+        {
+            std::string arg(argv[i]);
+            if (arg == "--run-notebook" && i + 1 < argc)
+            {
+                options.m_input = argv[++i];
+            }
+            else if (arg == "--output" && i + 1 < argc)
+            {
+                options.m_output = argv[++i];
+            }
+            else if ((arg == "-p" || arg == "--parameter") && i + 2 < argc)
+            {
+                options.m_parameters.emplace_back(argv[i + 1], argv[i + 2]);
+                i += 2;
+            }
+            else if (arg == "--allow-errors")
+            {
+                options.m_allow_errors = true;
+            }
+            else
+            {
+                argv[kept++] = argv[i];
+            }
+        }
+        argc = kept;
+        if (options.m_output.empty())
+        {
+            // The input is never overwritten, a failed run keeps it intact
+            const std::string extension = ".ipynb";
+            std::string stem = options.m_input;
+            if (stem.size() > extension.size() && stem.compare(stem.size() - extension.size(), extension.size(), extension) == 0)
+            {
+                stem.erase(stem.size() - extension.size());
+            }
+            options.m_output = stem + ".out" + extension;
+        }
+        return true;
+    }
+
+    namespace
+    {
+        // Throws nl::json::type_error if the source is neither a string nor
+        // a list of strings
+        std::string cell_source(const nl::json& cell)
+        {
+            const nl::json& source = cell.value("source", nl::json(""));
+            if (source.is_string())
+            {
+                return source.get<std::string>();
+            }
+            std::string res;
+            for (const auto& line : source)
+            {
+                res += line.get<std::string>();
+            }
+            return res;
+        }
+
+        // Throws if the notebook has no list of cells, or if the source of
+        // a code cell cannot be read
+        void check_notebook(const nl::json& notebook)
+        {
+            auto cells = notebook.find("cells");
+            if (!notebook.is_object() || cells == notebook.end() || !cells->is_array())
+            {
+                throw std::runtime_error("no list of cells");
+            }
+            for (const auto& cell : *cells)
+            {
+                if (cell.is_object() && cell.value("cell_type", "") == "code")
+                {
+                    cell_source(cell);
+                }
+            }
+        }
+
+        bool has_tag(const nl::json& cell, const std::string& tag)
+        {
+            auto metadata = cell.find("metadata");
+            if (metadata == cell.end() || !metadata->contains("tags"))
+            {
+                return false;
+            }
+            for (const auto& t : (*metadata)["tags"])
+            {
+                if (t == tag)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Assignments of the parameters, with the values as Python literals
+        std::string parameters_source(const std::vector<std::pair<std::string, std::string>>& parameters)
+        {
+            py::module json = py::module::import("json");
+            std::string res = "# Parameters\n";
+            for (const auto& parameter : parameters)
+            {
+                py::object value;
+                try
+                {
+                    value = json.attr("loads")(parameter.second);
+                }
+                catch (py::error_already_set&)
+                {
+                    value = py::str(parameter.second);
+                }
+                res += parameter.first + " = " + py::repr(value).cast<std::string>() + "\n";
+            }
+            return res;
+        }
+
+        void inject_parameters(nl::json& cells, const std::vector<std::pair<std::string, std::string>>& parameters)
+        {
+            std::size_t position = 0;
+            for (std::size_t i = 0; i < cells.size(); ++i)
+            {
+                if (has_tag(cells[i], "injected-parameters"))
+                {
+                    cells.erase(cells.begin() + static_cast<std::ptrdiff_t>(i));
+                    --i;
+                }
+                else if (has_tag(cells[i], "parameters"))
+                {
+                    position = i + 1;
+                }
+            }
+            nl::json cell = {
+                {"cell_type", "code"},
+                {"execution_count", nullptr},
+                {"id", xeus::new_xguid()},
+                {"metadata", {{"tags", {"injected-parameters"}}}},
+                {"outputs", nl::json::array()},
+                {"source", parameters_source(parameters)}
+            };
+            cells.insert(cells.begin() + static_cast<std::ptrdiff_t>(position), std::move(cell));
+        }
+
+        /**
+         * Converts the iopub messages of the interpreter to the outputs of
+         * the cells, following nbformat.
+         */
+        class xoutput_recorder
+        {
+        public:
+
+            explicit xoutput_recorder(nl::json& cells)
+                : m_cells(cells)
+            {
+            }
+
+            void begin_cell(std::size_t index)
+            {
+                m_index = index;
+                m_clear_pending = false;
+                m_cells[m_index]["outputs"] = nl::json::array();
+            }
+
+            void publish(const std::string& msg_type, const nl::json& content)
+            {
+                if (msg_type == "clear_output")
+                {
+                    if (content.value("wait", false))
+                    {
+                        m_clear_pending = true;
+                    }
+                    else
+                    {
+                        clear();
+                    }
+                }
+                else if (msg_type == "update_display_data")
+                {
+                    update_display(content);
+                }
+                else if (msg_type == "stream")
+                {
+                    add_stream(content);
+                }
+                else if (msg_type == "display_data")
+                {
+                    add_output({
+                        {"output_type", "display_data"},
+                        {"data", content.value("data", nl::json::object())},
+                        {"metadata", content.value("metadata", nl::json::object())}
+                    }, content);
+                }
+                else if (msg_type == "execute_result")
+                {
+                    add_output({
+                        {"output_type", "execute_result"},
+                        {"execution_count", content.value("execution_count", nl::json(nullptr))},
+                        {"data", content.value("data", nl::json::object())},
+                        {"metadata", content.value("metadata", nl::json::object())}
+                    }, content);
+                }
+                else if (msg_type == "error")
+                {
+                    add_output({
+                        {"output_type", "error"},
+                        {"ename", content.value("ename", "")},
+                        {"evalue", content.value("evalue", "")},
+                        {"traceback", content.value("traceback", nl::json::array())}
+                    }, content);
+                }
+            }
+
+        private:
+
+            using output_location = std::pair<std::size_t, std::size_t>;
+
+            nl::json& outputs()
+            {
+                return m_cells[m_index]["outputs"];
+            }
+
+            void clear()
+            {
+                m_clear_pending = false;
+                outputs() = nl::json::array();
+                for (auto& display : m_displays)
+                {
+                    auto& locations = display.second;
+                    locations.erase(std::remove_if(locations.begin(), locations.end(), [this](const output_location& l)
+                    {
+                        return l.first == m_index;
+                    }), locations.end());
+                }
+            }
+
+            void add_output(nl::json output, const nl::json& content)
+            {
+                if (m_clear_pending)
+                {
+                    clear();
+                }
+                nl::json& cell_outputs = outputs();
+                auto transient = content.find("transient");
+                if (transient != content.end() && transient->contains("display_id"))
+                {
+                    std::string display_id = (*transient)["display_id"].get<std::string>();
+                    m_displays[display_id].emplace_back(m_index, cell_outputs.size());
+                }
+                cell_outputs.push_back(std::move(output));
+            }
+
+            void add_stream(const nl::json& content)
+            {
+                if (m_clear_pending)
+                {
+                    clear();
+                }
+                std::string name = content.value("name", "stdout");
+                std::string text = content.value("text", "");
+                nl::json& cell_outputs = outputs();
+                if (!cell_outputs.empty())
+                {
+                    nl::json& last = cell_outputs.back();
+                    if (last["output_type"] == "stream" && last["name"] == name)
+                    {
+                        last["text"] = last["text"].get<std::string>() + text;
+                        return;
+                    }
+                }
+                cell_outputs.push_back({{"output_type", "stream"}, {"name", name}, {"text", text}});
+            }
+
+            void update_display(const nl::json& content)
+            {
+                auto transient = content.find("transient");
+                if (transient == content.end() || !transient->contains("display_id"))
+                {
+                    return;
+                }
+                auto it = m_displays.find((*transient)["display_id"].get<std::string>());
+                if (it == m_displays.end())
+                {
+                    return;
+                }
+                for (const auto& location : it->second)
+                {
+                    nl::json& output = m_cells[location.first]["outputs"][location.second];
+                    output["data"] = content.value("data", nl::json::object());
+                    output["metadata"] = content.value("metadata", nl::json::object());
+                }
+            }
+
+            nl::json& m_cells;
+            std::size_t m_index = 0;
+            bool m_clear_pending = false;
+            std::map<std::string, std::vector<output_location>> m_displays;
+        };
+
+        // Executes the code on the running asyncio loop, the cells of the
+        // IPython interpreter may complete asynchronously.
+        nl::json execute_cell(xeus::xinterpreter& interpreter,
+                              py::object& loop,
+                              const std::string& session_id,
+                              const std::string& code)
+        {
+            nl::json reply;
+            py::object done = loop.attr("create_future")();
+            auto start = [&interpreter, &reply, &session_id, &code, done]()
+            {
+                xeus::xrequest_context context(xeus::make_header("execute_request", "xpython", session_id),
+                                               xeus::channel::SHELL,
+                                               xeus::xrequest_context::guid_list());
+                xeus::execute_request_config config;
+                config.silent = false;
+                config.store_history = true;
+                config.allow_stdin = false;
+                interpreter.execute_request(std::move(context), [&reply, done](nl::json r)
+                {
+                    reply = std::move(r);
+                    done.attr("set_result")(py::none());
+                }, code, config, nl::json::object());
+            };
+            loop.attr("call_soon")(py::cpp_function(start));
+            loop.attr("run_until_complete")(done);
+            return reply;
+        }
+    }
+
+    int run_notebook(xeus::xinterpreter& interpreter, const xnotebook_run_options& options)
+    {
+        nl::json notebook;
+        try
+        {
+            std::ifstream input(options.m_input);
+            notebook = nl::json::parse(input);
+            check_notebook(notebook);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Cannot read the notebook " << options.m_input << ": " << e.what() << std::endl;
+            return 2;
+        }
+        nl::json& cells = notebook["cells"];
+
+        xoutput_recorder recorder(cells);
+        interpreter.register_publisher(
+            [&recorder](const std::string& msg_type, nl::json /*metadata*/, nl::json content, xeus::buffer_sequence /*buffers*/)
+            {
+                recorder.publish(msg_type, content);
+            }
+        );
+        // Without kernel, the comm manager can register targets but cannot
+        // publish: opening a comm (e.g. displaying a widget) raises an
+        // error in the cell instead. Outlives the interpreter.
+        static xeus::xcomm_manager comm_manager(nullptr);
+        interpreter.register_comm_manager(&comm_manager);
+        // Releases the GIL, the cells acquire it again
+        interpreter.configure();
+
+        py::gil_scoped_acquire acquire;
+        disable_comms("comms are not available when running a notebook with --run-notebook");
+        if (!options.m_parameters.empty())
+        {
+            inject_parameters(cells, options.m_parameters);
+        }
+
+        py::module asyncio = py::module::import("asyncio");
+        py::object loop = asyncio.attr("new_event_loop")();
+        asyncio.attr("set_event_loop")(loop);
+
+        std::string session_id = xeus::new_xguid();
+        int status = 0;
+        int execution_count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < cells.size(); ++i)
+        {
+            nl::json& cell = cells[i];
+            if (cell.value("cell_type", "") != "code")
+            {
+                continue;
+            }
+            recorder.begin_cell(i);
+            std::string code = cell_source(cell);
+            nl::json reply = execute_cell(interpreter, loop, session_id, code);
+            ++execution_count;
+            cell["execution_count"] = reply.value("execution_count", execution_count);
+            if (reply.value("status", "") == "error")
+            {
+                status = 1;
+                std::clog << "Cell " << i << " raised " << reply.value("ename", "") << ": "
+                          << reply.value("evalue", "") << std::endl;
+                if (!options.m_allow_errors)
+                {
+                    break;
+                }
+            }
+        }
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        nl::json parameters = nl::json::object();
+        for (const auto& parameter : options.m_parameters)
+        {
+            parameters[parameter.first] = parameter.second;
+        }
+        notebook["metadata"]["xpython"] = {
+            {"parameters", std::move(parameters)},
+            {"duration", duration.count()},
+            {"status", status == 0 ? "completed" : "failed"}
+        };
+
+        loop.attr("close")();
+
+        std::ofstream output(options.m_output);
+        output << notebook.dump(1) << std::endl;
+        if (!output)
+        {
+            std::cerr << "Cannot write the notebook " << options.m_output << std::endl;
+            return 2;
+        }
+        return options.m_allow_errors ? 0 : status;
+    }
+}
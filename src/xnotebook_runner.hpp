@@ -0,0 +1,60 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_NOTEBOOK_RUNNER_HPP
+#define XPYT_NOTEBOOK_RUNNER_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "xeus/xinterpreter.hpp"
+
+namespace xpyt
+{
+    /**
+     * Headless notebook runner of the xpython executable:
+     *
+     *   xpython --run-notebook in.ipynb --output out.ipynb [-p name value]... [--allow-errors]
+     *
+     * The code cells are executed in order by the interpreter of this
+     * process, without ZMQ nor kernel: the messages it publishes on iopub
+     * are converted to the outputs of the cells, and the executed notebook
+     * is written to the output file.
+     *
+     * Parameters are injected as in papermill, in a cell tagged
+     * "injected-parameters" inserted after the cell tagged "parameters", or
+     * at the top of the notebook. A value is parsed as JSON, and used as a
+     * string when it is not valid JSON.
+     *
+     * The execution stops at the first cell raising an error, unless errors
+     * are allowed. The notebook is written in both cases, to in.out.ipynb
+     * when no output is given; the input file is never overwritten.
+     */
+    struct xnotebook_run_options
+    {
+        std::string m_input;
+        std::string m_output;
+        std::vector<std::pair<std::string, std::string>> m_parameters;
+        bool m_allow_errors = false;
+    };
+
+    // Removes the options of the runner from argv. Returns false if
+    // --run-notebook is absent.
+    bool extract_notebook_run_options(int& argc, char* argv[], xnotebook_run_options& options);
+
+    // Returns the exit status of the process: 0 on success, 1 if a cell
+    // raised an error and errors are not allowed, 2 if the notebook could
+    // not be read or written. Configures the interpreter, which must not
+    // be served by a kernel. Requires the GIL.
+    int run_notebook(xeus::xinterpreter& interpreter, const xnotebook_run_options& options);
+}
+
+#endif
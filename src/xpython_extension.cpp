@@ -8,9 +8,14 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <atomic>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <signal.h>
 
@@ -24,21 +29,60 @@
 #include "xeus/xkernel.hpp"
 #include "xeus/xkernel_configuration.hpp"
 #include "xeus/xhelper.hpp"
+#include "xeus/xeus_context.hpp"
+#include "xeus/xguid.hpp"
+#include "xeus/xmessage.hpp"
 
 #include "xeus-zmq/xserver_zmq_split.hpp"
 #include "xeus-zmq/xzmq_context.hpp"
 
 #include "pybind11/pybind11.h"
 
+#include "pybind11_json/pybind11_json.hpp"
+
 #include "xeus-python/xinterpreter.hpp"
 #include "xeus-python/xinterpreter_raw.hpp"
 #include "xeus-python/xdebugger.hpp"
 #include "xeus-python/xutils.hpp"
 
 #include "xeus-python/xaserver.hpp"
+#include "xeus-python/xinproc.hpp"
 
 namespace py = pybind11;
 
+namespace
+{
+    // A kernel relies on process-wide state: the interpreter returned by
+    // xeus::get_interpreter(), the signal handlers, and the module and
+    // handle caches of xeus-python. Hence a single kernel can run in a
+    // process, and it must run in the main interpreter.
+    std::atomic<bool> kernel_running(false);
+
+    class kernel_guard
+    {
+    public:
+
+        kernel_guard()
+        {
+            if (PyInterpreterState_Get() != PyInterpreterState_Main())
+            {
+                throw std::runtime_error("xeus-python kernels cannot be launched from a subinterpreter");
+            }
+            if (kernel_running.exchange(true))
+            {
+                throw std::runtime_error("a xeus-python kernel is already running in this process");
+            }
+        }
+
+        ~kernel_guard()
+        {
+            kernel_running.store(false);
+        }
+
+        kernel_guard(const kernel_guard&) = delete;
+        kernel_guard& operator=(const kernel_guard&) = delete;
+    };
+}
 
 void launch(const py::list args_list)
 {
@@ -57,6 +101,8 @@ void launch(const py::list args_list)
         return;
     }
 
+    kernel_guard guard;
+
     // Registering SIGSEGV handler
 #ifdef __GNUC__
     std::clog << "registering handler for SIGSEGV" << std::endl;
@@ -65,9 +111,13 @@ void launch(const py::list args_list)
     // Registering SIGINT and SIGKILL handlers
     signal(SIGKILL, xpyt::sigkill_handler);
 #endif
+    // Until the interpreter is configured, it then installs a Python
+    // handler of SIGINT interrupting the running cell.
     signal(SIGINT, xpyt::sigkill_handler);
 
     bool raw_mode = xpyt::extract_option("-r", "--raw", argc, argv.data());
+    // Answers kernel_info before importing IPython or jedi
+    bool lazy_configure = xpyt::extract_option("--lazy", "--lazy", argc, argv.data());
     std::string connection_filename = xeus::extract_filename(argc, argv.data());
 
     std::unique_ptr<xeus::xcontext> context = xeus::make_zmq_context();
@@ -80,11 +130,11 @@ void launch(const py::list args_list)
     interpreter_ptr interpreter;
     if (raw_mode)
     {
-        interpreter = interpreter_ptr(new xpyt::raw_interpreter(globals));
+        interpreter = interpreter_ptr(new xpyt::raw_interpreter(globals, true, true, lazy_configure));
     }
     else
     {
-        interpreter = interpreter_ptr(new xpyt::interpreter(globals));
+        interpreter = interpreter_ptr(new xpyt::interpreter(globals, true, true, lazy_configure));
     }
     
     auto make_the_debugger = [&globals](
@@ -168,8 +218,281 @@ void launch(const py::list args_list)
     }
 }
 
+namespace
+{
+    py::object to_pymessage(const xeus::xmessage_base& message)
+    {
+        py::list buffers;
+        for (const auto& buffer : message.buffers())
+        {
+            buffers.append(py::bytes(buffer.data(), buffer.size()));
+        }
+        const nl::json& header = message.header();
+        py::dict res(
+            py::arg("header") = header,
+            py::arg("parent_header") = message.parent_header(),
+            py::arg("metadata") = message.metadata(),
+            py::arg("content") = message.content(),
+            py::arg("buffers") = buffers,
+            py::arg("msg_id") = header.value("msg_id", ""),
+            py::arg("msg_type") = header.value("msg_type", "")
+        );
+        return res;
+    }
+
+    long to_milliseconds(const py::object& timeout)
+    {
+        return timeout.is_none() ? -1 : static_cast<long>(timeout.cast<double>() * 1000);
+    }
+
+    [[noreturn]] void raise_empty()
+    {
+        PyErr_SetNone(py::module::import("queue").attr("Empty").ptr());
+        throw py::error_already_set();
+    }
+
+    /**
+     * Kernel running on a thread of the process, with a client using the
+     * in-process transport. The methods mirror the blocking client of
+     * jupyter_client; messages are dictionaries with the same keys.
+     *
+     * While the kernel runs, sys.stdout, sys.stderr and sys.displayhook of
+     * the process are redirected to it, like in a launched kernel. They are
+     * restored once it is shut down, and another kernel can then be created.
+     */
+    class inproc_kernel
+    {
+    public:
+
+        explicit inproc_kernel(const py::list& args_list)
+            : m_guard(std::in_place)
+            , p_channels(xpyt::make_inproc_channels())
+            , m_client(p_channels)
+            , m_session_id(xeus::new_xguid())
+        {
+            py::module sys = py::module::import("sys");
+            m_host_streams = py::make_tuple(sys.attr("stdout"), sys.attr("stderr"), sys.attr("displayhook"));
+
+            int argc = args_list.size();
+            std::vector<std::string> args;
+            std::vector<char*> argv;
+            for (const auto& arg : args_list)
+            {
+                args.push_back(arg.cast<std::string>());
+            }
+            for (auto& arg : args)
+            {
+                argv.push_back(arg.data());
+            }
+
+            bool raw_mode = xpyt::extract_option("-r", "--raw", argc, argv.data());
+            bool lazy_configure = xpyt::extract_option("--lazy", "--lazy", argc, argv.data());
+
+            py::dict globals = py::globals();
+            using interpreter_ptr = std::unique_ptr<xeus::xinterpreter>;
+            interpreter_ptr interpreter;
+            if (raw_mode)
+            {
+                interpreter = interpreter_ptr(new xpyt::raw_interpreter(globals, true, true, lazy_configure));
+            }
+            else
+            {
+                interpreter = interpreter_ptr(new xpyt::interpreter(globals, true, true, lazy_configure));
+            }
+
+            p_kernel = std::make_unique<xeus::xkernel>(xeus::get_user_name(),
+                                                       xeus::make_empty_context(),
+                                                       std::move(interpreter),
+                                                       xpyt::make_inproc_server_factory(p_channels),
+                                                       xeus::make_in_memory_history_manager(),
+                                                       nullptr);
+            // The kernel acquires the GIL to configure the interpreter and
+            // to run its event loop.
+            m_thread = std::thread([this]()
+            {
+                p_kernel->start();
+            });
+        }
+
+        ~inproc_kernel()
+        {
+            shutdown();
+        }
+
+        std::string send(const std::string& channel,
+                         const std::string& msg_type,
+                         const nl::json& content,
+                         const nl::json& metadata)
+        {
+            nl::json header = xeus::make_header(msg_type, xeus::get_user_name(), m_session_id);
+            std::string msg_id = header["msg_id"];
+            xeus::xmessage message(xeus::xmessage::guid_list(),
+                                   std::move(header),
+                                   nl::json::object(),
+                                   metadata.is_null() ? nl::json::object() : metadata,
+                                   content,
+                                   xeus::buffer_sequence());
+            if (channel == "shell")
+            {
+                m_client.send_on_shell(std::move(message));
+            }
+            else if (channel == "control")
+            {
+                m_client.send_on_control(std::move(message));
+            }
+            else if (channel == "stdin")
+            {
+                m_client.send_on_stdin(std::move(message));
+            }
+            else
+            {
+                throw std::invalid_argument("unknown channel " + channel);
+            }
+            return msg_id;
+        }
+
+        std::string execute(const std::string& code,
+                            bool silent,
+                            bool store_history,
+                            const nl::json& user_expressions,
+                            bool allow_stdin,
+                            bool stop_on_error)
+        {
+            return send("shell", "execute_request", {
+                {"code", code},
+                {"silent", silent},
+                {"store_history", store_history},
+                {"user_expressions", user_expressions.is_null() ? nl::json::object() : user_expressions},
+                {"allow_stdin", allow_stdin},
+                {"stop_on_error", stop_on_error}
+            }, nl::json::object());
+        }
+
+        std::string input(const std::string& value)
+        {
+            return send("stdin", "input_reply", {{"value", value}}, nl::json::object());
+        }
+
+        py::object get_msg(const std::string& channel, const py::object& timeout)
+        {
+            long ms = to_milliseconds(timeout);
+            if (channel == "iopub")
+            {
+                std::optional<xeus::xpub_message> message;
+                {
+                    py::gil_scoped_release release;
+                    message = m_client.receive_on_iopub(ms);
+                }
+                if (!message)
+                {
+                    raise_empty();
+                }
+                return to_pymessage(*message);
+            }
+
+            std::optional<xeus::xmessage> message;
+            {
+                py::gil_scoped_release release;
+                if (channel == "shell")
+                {
+                    message = m_client.receive_on_shell(ms);
+                }
+                else if (channel == "control")
+                {
+                    message = m_client.receive_on_control(ms);
+                }
+                else if (channel == "stdin")
+                {
+                    message = m_client.receive_on_stdin(ms);
+                }
+                else
+                {
+                    throw std::invalid_argument("unknown channel " + channel);
+                }
+            }
+            if (!message)
+            {
+                raise_empty();
+            }
+            return to_pymessage(*message);
+        }
+
+        // Stops the kernel and waits for its thread
+        void shutdown()
+        {
+            if (!m_thread.joinable())
+            {
+                return;
+            }
+            if (!m_client.kernel_stopped())
+            {
+                send("control", "shutdown_request", {{"restart", false}}, nl::json::object());
+            }
+            {
+                py::gil_scoped_release release;
+                m_thread.join();
+            }
+            p_kernel.reset();
+
+            py::module sys = py::module::import("sys");
+            sys.attr("stdout") = m_host_streams[0];
+            sys.attr("stderr") = m_host_streams[1];
+            sys.attr("displayhook") = m_host_streams[2];
+            m_guard.reset();
+        }
+
+    private:
+
+        std::optional<kernel_guard> m_guard;
+        py::tuple m_host_streams;
+
+        std::shared_ptr<xpyt::xinproc_channels> p_channels;
+        xpyt::xinproc_client m_client;
+        std::string m_session_id;
+        std::unique_ptr<xeus::xkernel> p_kernel;
+        std::thread m_thread;
+    };
+}
+
+#ifdef Py_GIL_DISABLED
+PYBIND11_MODULE(xpython_extension, m, pybind11::mod_gil_not_used())
+#else
 PYBIND11_MODULE(xpython_extension, m)
+#endif
 {
     m.doc() = "Xeus-python kernel launcher";
     m.def("launch", launch, py::arg("args_list"), "Launch the Jupyter kernel");
+
+    py::class_<inproc_kernel>(m, "InProcessKernel",
+        "Kernel running on a thread of this process, reached through in-process queues instead of ZMQ.")
+        .def(py::init<const py::list&>(), py::arg("args_list") = py::list())
+        .def("send", &inproc_kernel::send,
+             py::arg("channel"), py::arg("msg_type"), py::arg("content"), py::arg("metadata") = nl::json(),
+             "Sends a request on the shell, control or stdin channel and returns its msg_id.")
+        .def("execute", &inproc_kernel::execute,
+             py::arg("code"), py::arg("silent") = false, py::arg("store_history") = true,
+             py::arg("user_expressions") = nl::json(), py::arg("allow_stdin") = false,
+             py::arg("stop_on_error") = true)
+        .def("input", &inproc_kernel::input, py::arg("value"))
+        .def("kernel_info", [](inproc_kernel& self)
+        {
+            return self.send("shell", "kernel_info_request", nl::json::object(), nl::json::object());
+        })
+        .def("get_shell_msg", [](inproc_kernel& self, const py::object& timeout)
+        {
+            return self.get_msg("shell", timeout);
+        }, py::arg("timeout") = py::none())
+        .def("get_iopub_msg", [](inproc_kernel& self, const py::object& timeout)
+        {
+            return self.get_msg("iopub", timeout);
+        }, py::arg("timeout") = py::none())
+        .def("get_control_msg", [](inproc_kernel& self, const py::object& timeout)
+        {
+            return self.get_msg("control", timeout);
+        }, py::arg("timeout") = py::none())
+        .def("get_stdin_msg", [](inproc_kernel& self, const py::object& timeout)
+        {
+            return self.get_msg("stdin", timeout);
+        }, py::arg("timeout") = py::none())
+        .def("shutdown", &inproc_kernel::shutdown, "Stops the kernel and waits for its thread.");
 }
@@ -0,0 +1,319 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xinterpreter.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "pybind11_json/pybind11_json.hpp"
+
+#include "xcheckpoint.hpp"
+#include "xcode_cache.hpp"
+#include "xexecution_timing.hpp"
+#include "xgc_tuning.hpp"
+#include "xhandles.hpp"
+#include "xinput.hpp"
+#include "xinternal_utils.hpp"
+#include "xjson.hpp"
+#include "xmemory_accounting.hpp"
+#include "xruntime.hpp"
+#include "xsoft_restart.hpp"
+#include "xsubshell.hpp"
+#include "xthreading.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /******************
+     * runtime module *
+     ******************/
+
+    namespace
+    {
+        py::dict cache_info(const xcode_cache& cache)
+        {
+            py::dict res;
+            res["hits"] = cache.hits();
+            res["misses"] = cache.misses();
+            res["size"] = cache.size();
+            res["capacity"] = cache.capacity();
+            return res;
+        }
+    }
+
+    py::module get_runtime_module_impl()
+    {
+        py::module runtime_module = create_module("xpython_runtime");
+
+        runtime_module.def("code_cache_info", []()
+        {
+            return cache_info(get_code_cache());
+        }, "Returns the hits, misses, size and capacity of the cell code cache.");
+        runtime_module.def("snippet_cache_info", []()
+        {
+            return cache_info(get_snippet_cache());
+        }, "Returns the hits, misses, size and capacity of the internal snippet cache.");
+        runtime_module.def("set_code_cache_capacity", [](std::size_t capacity)
+        {
+            get_code_cache().set_capacity(capacity);
+        }, "Sets the maximum number of cells kept in the code cache, 0 disables it.");
+        runtime_module.def("clear_code_cache", []()
+        {
+            get_code_cache().clear();
+        }, "Removes all the entries of the code cache and resets its counters.");
+        runtime_module.def("handle_resolutions", []()
+        {
+            return handle_resolutions();
+        }, "Returns how many times the interned Python handles have been resolved.");
+
+        runtime_module.def("startup_info", []()
+        {
+            const xstartup_timing& timing = get_startup_timing();
+            py::dict res;
+            res["lazy"] = timing.m_lazy;
+            res["configure"] = timing.m_configure;
+            res["deferred"] = timing.m_deferred;
+            res["ready_at"] = timing.m_ready_at;
+            return res;
+        }, "Returns the time spent configuring the interpreter before and after the kernel started answering.");
+        runtime_module.def("set_execution_timing", [](bool enabled)
+        {
+            set_execution_timing_enabled(enabled);
+        }, "Adds the duration of each execution phase to the execute replies, under execution_timing, and to the histograms.");
+        runtime_module.def("execution_timing_enabled", []()
+        {
+            return execution_timing_enabled();
+        }, "Returns whether the execute replies hold the execution timings.");
+        runtime_module.def("execution_timing_histograms", []()
+        {
+            return get_timing_histograms().to_json();
+        }, "Returns the count, total, min, max and log2 microsecond buckets of each execution phase.");
+        runtime_module.def("reset_execution_timing", []()
+        {
+            get_timing_histograms().clear();
+        }, "Resets the execution phase histograms.");
+        runtime_module.def("set_memory_accounting", [](bool enabled, std::size_t top_allocations, bool reset_peak)
+        {
+            set_memory_accounting(enabled, top_allocations, reset_peak);
+        }, py::arg("enabled"), py::arg("top_allocations") = 0, py::arg("reset_peak") = false,
+        "Adds the memory used by each cell to the execute replies, under memory. top_allocations > 0 starts tracemalloc, unless it is already tracing, and reports the source lines which allocated the most. On Linux, reset_peak measures the peak of each cell by writing /proc/self/clear_refs before it, which also clears the soft-dirty bits of the pages of the process.");
+        runtime_module.def("memory_accounting_enabled", []()
+        {
+            return memory_accounting_enabled();
+        }, "Returns whether the memory used by the cells is measured.");
+        runtime_module.def("memory_history", []()
+        {
+            return get_memory_history().to_json();
+        }, "Returns the memory measures of the last 1000 cells measured in the session.");
+        runtime_module.def("clear_memory_history", []()
+        {
+            get_memory_history().clear();
+        }, "Removes the memory measures of the session.");
+        runtime_module.def("set_gc_tuning", [](bool enabled, std::int64_t freeze_blocks, double pause_budget)
+        {
+            get_gc_tuner().configure(enabled, freeze_blocks, pause_budget);
+        }, py::arg("enabled"), py::arg("freeze_blocks") = 1000000, py::arg("pause_budget") = 0.05,
+        "Times the garbage collections of each cell, freezes the objects after cells allocating more than freeze_blocks blocks, and raises the collection threshold when a cell pauses longer than pause_budget seconds.");
+        runtime_module.def("gc_info", []()
+        {
+            return get_gc_tuner().info();
+        }, "Returns the thresholds, the frozen objects and the collection pauses of the last cells.");
+
+        runtime_module.def("ainput", [](const std::string& prompt, bool password)
+        {
+            return ainput(prompt, password);
+        }, py::arg("prompt") = "", py::arg("password") = false,
+        "Awaitable requesting an input from the frontend without blocking the event loop, e.g. await ainput('name: ').");
+
+        runtime_module.def("create_subshell", []()
+        {
+            return create_subshell();
+        }, "Creates a subshell running the execute requests whose header holds its id as subshell_id, on its own thread.");
+
+        runtime_module.def("delete_subshell", [](const std::string& id)
+        {
+            return delete_subshell(id);
+        }, py::arg("id"), "Deletes a subshell once its queued requests have run, returns False if it does not exist.");
+
+        runtime_module.def("list_subshells", []()
+        {
+            return list_subshells();
+        }, "Returns the ids of the subshells.");
+
+        runtime_module.def("soft_restart", [](const py::object& keep_modules)
+        {
+            std::vector<std::string> allow_list = default_soft_restart_allow_list();
+            if (!keep_modules.is_none())
+            {
+                allow_list.clear();
+                for (py::handle name : keep_modules)
+                {
+                    allow_list.push_back(name.cast<std::string>());
+                }
+            }
+            if (subshell_execution_running())
+            {
+                throw std::runtime_error("cannot restart while subshells are running cells");
+            }
+            request_soft_restart(std::move(allow_list));
+        }, py::arg("keep_modules") = py::none(),
+        "Restarts the kernel in-process once the current cell has replied. keep_modules replaces the default allow-list of packages kept in sys.modules.");
+        runtime_module.def("soft_restart_allow_list", []()
+        {
+            return nl::json(default_soft_restart_allow_list());
+        }, "Returns the default allow-list of packages kept by the soft restarts.");
+        runtime_module.def("soft_restart_info", []()
+        {
+            return soft_restart_report();
+        }, "Returns the comms closed and the modules removed or kept by the last soft restart.");
+
+        runtime_module.def("checkpoint", [](const std::string& path)
+        {
+            py::dict ns = py::module::import("__main__").attr("__dict__");
+            return checkpoint_namespace(ns, path);
+        }, py::arg("path"),
+        "Saves the variables of the user namespace to a file and returns the saved names and the ones that could not be saved.");
+        runtime_module.def("restore", [](const std::string& path)
+        {
+            py::dict ns = py::module::import("__main__").attr("__dict__");
+            return restore_namespace(ns, path);
+        }, py::arg("path"),
+        "Loads the variables of a checkpoint in the user namespace, the buffers of arrays are mapped from the file.");
+        runtime_module.def("set_idle_hibernation", [](double seconds, const py::object& path)
+        {
+            get_hibernation().configure(seconds, path.is_none() ? std::string() : path.cast<std::string>());
+        }, py::arg("seconds"), py::arg("path") = py::none(),
+        "Checkpoints the user namespace and releases its memory after seconds of inactivity, 0 disables it.");
+        runtime_module.def("hibernation_info", []()
+        {
+            return get_hibernation().info();
+        }, "Returns the configuration and the state of the idle hibernation, and the reports of the last checkpoint and restore.");
+
+        // Resolves all the handles, through the cache or with the imports
+        // and lookups it replaces, to benchmark the hot paths.
+        runtime_module.def("_resolve_handles", [](bool interned)
+        {
+            for (std::size_t i = 0; i < static_cast<std::size_t>(xhandle::count); ++i)
+            {
+                xhandle handle = static_cast<xhandle>(i);
+                py::object obj = interned ? get_handle(handle) : resolve_uncached_handle(handle);
+            }
+        }, py::arg("interned") = true);
+
+        // Converts an object to JSON with the conversion of the publish
+        // paths, or with pybind11_json, for the benchmarks.
+        runtime_module.def("_to_json", [](const py::object& obj, bool direct)
+        {
+            nl::json res = direct ? pyobject_to_json(obj) : nl::json(obj);
+            return res.size();
+        }, py::arg("obj"), py::arg("direct") = true);
+
+        // Runs code the way the debugger does, mainly useful to benchmark
+        // the internal request path.
+        runtime_module.def("_internal_request", [](const std::string& code)
+        {
+            return xeus::get_interpreter().internal_request(nl::json::object({{"code", code}}));
+        });
+
+        return runtime_module;
+    }
+
+    py::module get_runtime_module()
+    {
+        static py::module runtime_module = get_runtime_module_impl();
+        return runtime_module;
+    }
+
+    /**************
+     * idle tasks *
+     **************/
+
+    namespace
+    {
+        struct idle_tasks
+        {
+            xstate_mutex m_mutex;
+            std::vector<std::function<void()>> m_tasks;
+        };
+
+        idle_tasks& get_idle_tasks()
+        {
+            static idle_tasks tasks;
+            return tasks;
+        }
+    }
+
+    void add_idle_task(std::function<void()> task)
+    {
+        idle_tasks& registry = get_idle_tasks();
+        xstate_lock lock(registry.m_mutex);
+        registry.m_tasks.push_back(std::move(task));
+    }
+
+    void run_idle_tasks()
+    {
+        // Tasks may add new tasks
+        std::vector<std::function<void()>> tasks;
+        {
+            idle_tasks& registry = get_idle_tasks();
+            xstate_lock lock(registry.m_mutex);
+            std::swap(tasks, registry.m_tasks);
+        }
+        for (auto& task : tasks)
+        {
+            task();
+        }
+    }
+
+    namespace
+    {
+        std::atomic<double>& idle_delay()
+        {
+            static std::atomic<double> delay(0.1);
+            return delay;
+        }
+    }
+
+    void set_idle_task_delay(double seconds)
+    {
+        idle_delay().store(seconds);
+    }
+
+    double idle_task_delay()
+    {
+        return idle_delay().load();
+    }
+
+    xstartup_timing& get_startup_timing()
+    {
+        static xstartup_timing timing;
+        return timing;
+    }
+
+    void mark_startup_ready()
+    {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        get_startup_timing().m_ready_at = std::chrono::duration<double>(now).count();
+    }
+}
@@ -0,0 +1,56 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_RUNTIME_HPP
+#define XPYT_RUNTIME_HPP
+
+#include <functional>
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    // The xpython_runtime module gives access to the statistics and the
+    // settings of the kernel runtime from Python code.
+    py::module get_runtime_module();
+
+    // Startup work deferred by the lazy configuration of the interpreters.
+    // The shell loop runs the tasks once, idle_task_delay() seconds after
+    // it has started and answered the first requests. Both functions
+    // require the GIL.
+    void add_idle_task(std::function<void()> task);
+    void run_idle_tasks();
+
+    // Set from the --lazy-delay option before the loop starts, 0.1 by
+    // default.
+    void set_idle_task_delay(double seconds);
+    double idle_task_delay();
+
+    // Time spent configuring the interpreter, in seconds: m_configure
+    // before the kernel answers requests, m_deferred in the lazy part.
+    // m_ready_at is the time since the epoch at which the configuration
+    // completed, 0 while the lazy part is pending.
+    struct xstartup_timing
+    {
+        bool m_lazy = false;
+        double m_configure = 0.;
+        double m_deferred = 0.;
+        double m_ready_at = 0.;
+    };
+
+    // Records the completion of the configuration in m_ready_at
+    void mark_startup_ready();
+
+    xstartup_timing& get_startup_timing();
+}
+
+#endif
@@ -0,0 +1,212 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define XPYT_HAS_SHM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "nlohmann/json.hpp"
+
+#include "xshm_ring.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        // Blocks are aligned on cache lines so that consumers can map them
+        // directly as arrays of any element type.
+        constexpr std::uint64_t block_alignment = 64;
+
+        std::uint64_t align(std::uint64_t size)
+        {
+            return std::max(block_alignment, (size + block_alignment - 1) / block_alignment * block_alignment);
+        }
+    }
+
+    /****************************
+     * xshm_ring implementation *
+     ****************************/
+
+    std::unique_ptr<xshm_ring> xshm_ring::create(std::size_t capacity)
+    {
+#ifdef XPYT_HAS_SHM
+        static std::atomic<unsigned int> counter{0};
+        // Short names, macOS limits them to 31 characters.
+        std::string name = "xpyt-" + std::to_string(::getpid()) + "-" + std::to_string(counter++);
+        std::string path = "/" + name;
+        std::size_t size = static_cast<std::size_t>(align(capacity));
+
+        int fd = ::shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd == -1)
+        {
+            return nullptr;
+        }
+        if (::ftruncate(fd, static_cast<off_t>(size)) == -1)
+        {
+            ::close(fd);
+            ::shm_unlink(path.c_str());
+            return nullptr;
+        }
+        void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+        {
+            ::shm_unlink(path.c_str());
+            return nullptr;
+        }
+        return std::unique_ptr<xshm_ring>(new xshm_ring(std::move(name), size, static_cast<char*>(addr)));
+#else
+        (void)capacity;
+        return nullptr;
+#endif
+    }
+
+    xshm_ring::xshm_ring(std::string name, std::size_t capacity, char* data)
+        : m_name(std::move(name))
+        , m_capacity(capacity)
+        , p_data(data)
+        , m_head(0)
+        , m_tail(0)
+    {
+    }
+
+    xshm_ring::~xshm_ring()
+    {
+#ifdef XPYT_HAS_SHM
+        // Consumers that still map the segment keep access to it, the name
+        // is removed so that the memory is freed once they unmap it.
+        ::munmap(p_data, m_capacity);
+        ::shm_unlink(("/" + m_name).c_str());
+#endif
+    }
+
+    const std::string& xshm_ring::segment_name() const
+    {
+        return m_name;
+    }
+
+    std::size_t xshm_ring::capacity() const
+    {
+        return m_capacity;
+    }
+
+    std::size_t xshm_ring::used() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<std::size_t>(m_head - m_tail);
+    }
+
+    std::size_t xshm_ring::outstanding() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<std::size_t>(std::count_if(m_blocks.cbegin(), m_blocks.cend(), [](const auto& b)
+        {
+            return !b.second.m_consumers.empty();
+        }));
+    }
+
+    nl::json xshm_ring::write(const xeus::binary_buffer& buffer, const std::set<std::string>& consumers)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        reclaim();
+
+        std::uint64_t length = align(buffer.size());
+        if (length > m_capacity)
+        {
+            return nl::json();
+        }
+
+        // A block never wraps around the end of the segment, the remaining
+        // space is added to the block as padding instead.
+        std::uint64_t offset = m_head % m_capacity;
+        std::uint64_t padding = offset + length > m_capacity ? m_capacity - offset : 0;
+        if (m_head - m_tail + padding + length > m_capacity)
+        {
+            return nl::json();
+        }
+
+        std::uint64_t id = m_head;
+        std::uint64_t data_offset = (m_head + padding) % m_capacity;
+        std::memcpy(p_data + data_offset, buffer.data(), buffer.size());
+        m_blocks.emplace(id, block{padding + length, consumers});
+        m_head += padding + length;
+
+        return nl::json{
+            {"segment", m_name},
+            {"offset", data_offset},
+            {"size", buffer.size()},
+            {"id", id}
+        };
+    }
+
+    void xshm_ring::release(std::uint64_t id, const std::string& consumer)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_blocks.find(id);
+        if (it != m_blocks.end() && it->second.m_consumers.erase(consumer) != 0)
+        {
+            reclaim();
+        }
+    }
+
+    void xshm_ring::release_all(const std::string& consumer)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& b : m_blocks)
+        {
+            b.second.m_consumers.erase(consumer);
+        }
+        reclaim();
+    }
+
+    void xshm_ring::reclaim()
+    {
+        while (!m_blocks.empty() && m_blocks.begin()->second.m_consumers.empty())
+        {
+            auto it = m_blocks.begin();
+            m_tail = it->first + it->second.m_length;
+            m_blocks.erase(it);
+        }
+    }
+
+    nl::json write_shm_buffers(xshm_ring& ring,
+                               xeus::buffer_sequence& buffers,
+                               std::size_t threshold,
+                               const std::set<std::string>& consumers)
+    {
+        nl::json handles(buffers.size(), nullptr);
+        bool written = false;
+        for (std::size_t i = 0; i < buffers.size(); ++i)
+        {
+            if (buffers[i].size() >= threshold)
+            {
+                nl::json handle = ring.write(buffers[i], consumers);
+                if (!handle.is_null())
+                {
+                    handles[i] = std::move(handle);
+                    xeus::binary_buffer().swap(buffers[i]);
+                    written = true;
+                }
+            }
+        }
+        return written ? handles : nl::json();
+    }
+}
@@ -0,0 +1,127 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_SHM_RING_HPP
+#define XPYT_SHM_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xcomm.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Metadata keys of the shared-memory buffer transport.
+     *
+     * - buffer_transports: list of transports a peer supports. The kernel
+     *   advertises "shm" in comm_open, local consumers enable it by sending
+     *   it back in any comm message. Comm messages are broadcast on iopub:
+     *   the transport is used only while every peer which sent a message
+     *   on the comm enabled it. A frontend which never sends a message on
+     *   the comm is not known by the kernel, the transport assumes that
+     *   all the frontends of such a comm are its consumers.
+     * - buffer_handles: list with one entry per buffer of the message. An
+     *   entry is null for an inline buffer, or an object {segment, offset,
+     *   size, id} locating the buffer in shared memory, in which case the
+     *   inline buffer is empty.
+     * - buffer_release: list of handle ids a consumer is done with. A
+     *   consumer releases each handle once, further releases and unknown
+     *   ids are ignored.
+     */
+    constexpr const char* buffer_transports_key = "buffer_transports";
+    constexpr const char* buffer_handles_key = "buffer_handles";
+    constexpr const char* buffer_release_key = "buffer_release";
+    constexpr const char* shm_transport_name = "shm";
+
+    constexpr std::size_t default_shm_capacity = 64 * 1024 * 1024;
+    constexpr std::size_t default_shm_threshold = 1024 * 1024;
+
+    // Ring of buffers in a POSIX shared-memory segment, written by the kernel
+    // and read by consumers on the same host. Each block holds the sessions
+    // of the consumers at writing time, and is reclaimed once all of them
+    // have released it. Blocks are reclaimed in allocation order.
+    // All the methods are thread-safe.
+    class xshm_ring
+    {
+    public:
+
+        // Returns nullptr if shared memory is not available on this platform
+        // or if the segment cannot be created.
+        static std::unique_ptr<xshm_ring> create(std::size_t capacity);
+
+        ~xshm_ring();
+
+        xshm_ring(const xshm_ring&) = delete;
+        xshm_ring& operator=(const xshm_ring&) = delete;
+        xshm_ring(xshm_ring&&) = delete;
+        xshm_ring& operator=(xshm_ring&&) = delete;
+
+        const std::string& segment_name() const;
+        std::size_t capacity() const;
+        std::size_t used() const;
+        std::size_t outstanding() const;
+
+        // Copies buffer into the ring and returns its handle, or null if the
+        // ring does not have enough free space.
+        nl::json write(const xeus::binary_buffer& buffer, const std::set<std::string>& consumers);
+
+        // Ignored if the id is unknown or if the consumer does not hold the
+        // block, e.g. released it already.
+        void release(std::uint64_t id, const std::string& consumer);
+
+        // Releases all the blocks held by a consumer leaving the transport
+        void release_all(const std::string& consumer);
+
+    private:
+
+        struct block
+        {
+            std::uint64_t m_length;
+            std::set<std::string> m_consumers;
+        };
+
+        xshm_ring(std::string name, std::size_t capacity, char* data);
+
+        void reclaim();
+
+        mutable std::mutex m_mutex;
+        std::string m_name;
+        std::size_t m_capacity;
+        char* p_data;
+
+        // Blocks indexed by their start position, which is also their id.
+        // Positions grow monotonically, the offset in the segment is the
+        // position modulo the capacity.
+        std::map<std::uint64_t, block> m_blocks;
+        std::uint64_t m_head;
+        std::uint64_t m_tail;
+    };
+
+    // Moves the buffers whose size is above threshold to the ring, leaving
+    // empty buffers in their place. Buffers that do not fit in the ring are
+    // kept inline. Returns the buffer_handles annotation, or null if no
+    // buffer has been moved.
+    nl::json write_shm_buffers(xshm_ring& ring,
+                               xeus::buffer_sequence& buffers,
+                               std::size_t threshold,
+                               const std::set<std::string>& consumers);
+}
+
+#endif
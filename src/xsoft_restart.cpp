@@ -0,0 +1,247 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xcomm.hpp"
+#include "xeus/xinterpreter.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xcode_cache.hpp"
+#include "xgc_tuning.hpp"
+#include "xhandles.hpp"
+#include "xsoft_restart.hpp"
+#include "xsubshell.hpp"
+#include "xthreading.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        struct soft_restart_state
+        {
+            xstate_mutex m_mutex;
+            // Top-level packages imported by the kernel
+            std::set<std::string> m_kernel_packages;
+            bool m_requested = false;
+            std::vector<std::string> m_allow_list;
+            nl::json m_report = nl::json::object();
+        };
+
+        soft_restart_state& get_state()
+        {
+            static soft_restart_state state;
+            return state;
+        }
+
+        std::string top_level_name(const std::string& module_name)
+        {
+            return module_name.substr(0, module_name.find('.'));
+        }
+
+        bool is_extension_module(py::handle module, const std::vector<std::string>& suffixes)
+        {
+            py::object file = py::getattr(module, "__file__", py::none());
+            if (!py::isinstance<py::str>(file))
+            {
+                return false;
+            }
+            std::string path = file.cast<std::string>();
+            return std::any_of(suffixes.cbegin(), suffixes.cend(), [&path](const std::string& suffix)
+            {
+                return path.size() >= suffix.size()
+                    && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+            });
+        }
+
+        std::size_t close_comms()
+        {
+            auto& comm_manager = xeus::get_interpreter().comm_manager();
+            std::vector<xeus::xguid> ids;
+            for (const auto& comm : comm_manager.comms())
+            {
+                ids.push_back(comm.first);
+            }
+
+            // Closing a comm may run handlers that close others
+            std::size_t closed = 0;
+            for (const auto& id : ids)
+            {
+                const auto& comms = comm_manager.comms();
+                auto it = comms.find(id);
+                if (it != comms.end())
+                {
+                    it->second->close(nl::json::object(), nl::json::object(), xeus::buffer_sequence());
+                    ++closed;
+                }
+            }
+            return closed;
+        }
+    }
+
+    void record_kernel_modules()
+    {
+        py::dict modules = py::module::import("sys").attr("modules");
+        soft_restart_state& state = get_state();
+        xstate_lock lock(state.m_mutex);
+        for (auto item : modules)
+        {
+            state.m_kernel_packages.insert(top_level_name(item.first.cast<std::string>()));
+        }
+    }
+
+    std::vector<std::string> default_soft_restart_allow_list()
+    {
+        return {
+            "numpy", "scipy", "pandas", "pyarrow", "polars", "sklearn", "torch", "jax", "jaxlib",
+            "tensorflow", "numba", "llvmlite", "dateutil", "pytz", "tzdata", "six", "packaging",
+            "typing_extensions"
+        };
+    }
+
+    void request_soft_restart(std::vector<std::string> allow_list)
+    {
+        soft_restart_state& state = get_state();
+        xstate_lock lock(state.m_mutex);
+        state.m_requested = true;
+        state.m_allow_list = std::move(allow_list);
+    }
+
+    bool take_soft_restart_request(std::vector<std::string>& allow_list)
+    {
+        soft_restart_state& state = get_state();
+        xstate_lock lock(state.m_mutex);
+        if (!state.m_requested)
+        {
+            return false;
+        }
+        state.m_requested = false;
+        if (subshell_execution_running())
+        {
+            // The namespace would be reset under the cells of the subshells
+            state.m_report = {{"error", "subshells are running cells"}};
+            return false;
+        }
+        allow_list = std::move(state.m_allow_list);
+        return true;
+    }
+
+    nl::json soft_restart_kernel(const std::vector<std::string>& allow_list,
+                                 const std::function<void()>& reset_namespace)
+    {
+        // Comms are closed before their Python objects are released with
+        // the namespace, so that the frontend is notified
+        nl::json report = nl::json::object();
+        report["closed_comms"] = close_comms();
+        reset_namespace();
+
+        std::set<std::string> kept;
+        {
+            soft_restart_state& state = get_state();
+            xstate_lock lock(state.m_mutex);
+            kept = state.m_kernel_packages;
+        }
+        kept.insert(allow_list.cbegin(), allow_list.cend());
+
+        // Modules imported since startup, by top-level package
+        py::dict modules = py::module::import("sys").attr("modules");
+        std::map<std::string, std::vector<std::string>> packages;
+        for (auto item : modules)
+        {
+            std::string name = item.first.cast<std::string>();
+            std::string top_level = top_level_name(name);
+            if (kept.find(top_level) == kept.end())
+            {
+                packages[top_level].push_back(std::move(name));
+            }
+        }
+
+        std::vector<std::string> suffixes;
+        for (py::handle suffix : py::module::import("importlib.machinery").attr("EXTENSION_SUFFIXES"))
+        {
+            suffixes.push_back(suffix.cast<std::string>());
+        }
+
+        std::vector<std::string> removed;
+        std::vector<std::string> kept_extensions;
+        for (const auto& package : packages)
+        {
+            bool extension = std::any_of(package.second.cbegin(), package.second.cend(), [&](const std::string& name)
+            {
+                py::object module = modules[py::str(name)];
+                return is_extension_module(module, suffixes);
+            });
+            if (extension)
+            {
+                kept_extensions.push_back(package.first);
+                continue;
+            }
+            for (const std::string& name : package.second)
+            {
+                modules.attr("pop")(name, py::none());
+            }
+            removed.push_back(package.first);
+        }
+        report["removed_modules"] = removed;
+        report["kept_extension_modules"] = kept_extensions;
+
+        // The interned handles and the compiled snippets may belong to the
+        // removed modules
+        clear_handles();
+        get_code_cache().clear();
+        get_snippet_cache().clear();
+        get_gc_tuner().collect_all();
+
+        return report;
+    }
+
+    void clear_namespace(py::dict ns)
+    {
+        std::vector<py::object> keys;
+        for (auto item : ns)
+        {
+            std::string name = py::str(item.first).cast<std::string>();
+            if (name.size() < 4 || name.compare(0, 2, "__") != 0 || name.compare(name.size() - 2, 2, "__") != 0)
+            {
+                keys.push_back(py::reinterpret_borrow<py::object>(item.first));
+            }
+        }
+        for (const auto& key : keys)
+        {
+            PyDict_DelItem(ns.ptr(), key.ptr());
+        }
+    }
+
+    void set_soft_restart_report(nl::json report)
+    {
+        soft_restart_state& state = get_state();
+        xstate_lock lock(state.m_mutex);
+        state.m_report = std::move(report);
+    }
+
+    nl::json soft_restart_report()
+    {
+        soft_restart_state& state = get_state();
+        xstate_lock lock(state.m_mutex);
+        return state.m_report;
+    }
+}
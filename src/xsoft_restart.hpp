@@ -0,0 +1,81 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_SOFT_RESTART_HPP
+#define XPYT_SOFT_RESTART_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * In-process restart of the kernel, requested with
+     * xpython_runtime.soft_restart() and performed by the interpreter once
+     * the reply of the current request has been sent.
+     *
+     * What is reset:
+     * - the user namespace, and the shell state in IPython mode (history
+     *   session, execution count of the shell, output cache)
+     * - the display hook
+     * - the open comms, which are closed
+     * - the modules imported since startup, removed from sys.modules,
+     *   except the ones listed below
+     * - the interned handles and the code caches
+     *
+     * Which modules are kept:
+     * - the modules imported by the kernel itself (at startup or by its
+     *   lazy configuration)
+     * - the packages of the allow-list, which must be stateless: a kept
+     *   package keeps the state it had before the restart
+     * - the packages holding an extension module, which cannot be loaded
+     *   twice in a process; they are reported since their state is kept
+     * Objects of the kept packages may still refer to the removed modules
+     * they imported, such dependencies should be allow-listed too.
+     *
+     * The execution counter and the history of xeus are not reset.
+     */
+
+    // Adds the modules currently imported to the ones kept by the soft
+    // restarts. Requires the GIL.
+    void record_kernel_modules();
+
+    std::vector<std::string> default_soft_restart_allow_list();
+
+    // Called from Python, with the GIL
+    void request_soft_restart(std::vector<std::string> allow_list);
+
+    // Returns true and the allow-list if a soft restart was requested since
+    // the last call.
+    bool take_soft_restart_request(std::vector<std::string>& allow_list);
+
+    // Closes the comms, resets the namespace with the function given by the
+    // interpreter, removes the modules, clears the caches and returns the
+    // report of the restart. Requires the GIL.
+    nl::json soft_restart_kernel(const std::vector<std::string>& allow_list,
+                                 const std::function<void()>& reset_namespace);
+
+    // Removes the entries of a namespace except the module attributes
+    // (__name__, __builtins__...)
+    void clear_namespace(py::dict ns);
+
+    void set_soft_restart_report(nl::json report);
+    nl::json soft_restart_report();
+}
+
+#endif
@@ -0,0 +1,322 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xguid.hpp"
+#include "xeus/xhelper.hpp"
+#include "xeus/xinterpreter.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xeus-python/xtraceback.hpp"
+
+#include "xcheckpoint.hpp"
+#include "xhandles.hpp"
+#include "xinput.hpp"
+#include "xkernel.hpp"
+#include "xsubshell.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        using task_type = std::function<void()>;
+
+        // Shared by the subshell thread and the registry, the thread keeps
+        // it alive once the subshell is deleted.
+        struct subshell_queue
+        {
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::deque<task_type> m_tasks;
+            bool m_stopped = false;
+            // Python id of the thread while it runs a cell, 0 otherwise
+            std::atomic<unsigned long> m_thread_id{0};
+        };
+
+        void run_subshell(std::shared_ptr<subshell_queue> queue)
+        {
+            while (true)
+            {
+                task_type task;
+                {
+                    std::unique_lock<std::mutex> lock(queue->m_mutex);
+                    queue->m_condition.wait(lock, [&queue]() { return queue->m_stopped || !queue->m_tasks.empty(); });
+                    if (queue->m_tasks.empty())
+                    {
+                        return;
+                    }
+                    task = std::move(queue->m_tasks.front());
+                    queue->m_tasks.pop_front();
+                }
+                // The tasks report their errors in their reply, only the
+                // scheduling of the reply may throw here, e.g. bad_alloc.
+                // The thread must not terminate the process.
+                try
+                {
+                    task();
+                }
+                catch (...)
+                {
+                }
+            }
+        }
+
+        struct subshell
+        {
+            std::shared_ptr<subshell_queue> m_queue;
+            std::thread m_thread;
+        };
+
+        struct subshell_registry
+        {
+            std::mutex m_mutex;
+            std::map<std::string, subshell> m_subshells;
+            // Deleted subshells, joined on shutdown
+            std::vector<subshell> m_deleted;
+            // Tasks queued or running on the subshells
+            std::atomic<std::size_t> m_pending{0};
+        };
+
+        subshell_registry& get_registry()
+        {
+            // Leaked, the threads are joined by stop_subshells
+            static subshell_registry* registry = new subshell_registry();
+            return *registry;
+        }
+
+        void stop(subshell_queue& queue)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queue.m_mutex);
+                queue.m_stopped = true;
+            }
+            queue.m_condition.notify_one();
+        }
+
+        std::shared_ptr<subshell_queue> find_subshell(const std::string& id)
+        {
+            subshell_registry& registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            auto it = registry.m_subshells.find(id);
+            return it == registry.m_subshells.end() ? nullptr : it->second.m_queue;
+        }
+
+        nl::json run_code(const py::object& ns, const std::string& code, bool silent)
+        {
+            try
+            {
+                py::object compiled = get_handle(xhandle::builtins).attr("compile")(code, "<subshell>", "exec");
+                exec(compiled, ns);
+                return xeus::create_successful_reply();
+            }
+            catch (py::error_already_set& e)
+            {
+                xerror error = extract_already_set_error(e);
+                if (!silent)
+                {
+                    xeus::get_interpreter().publish_execution_error(error.m_ename, error.m_evalue, error.m_traceback);
+                }
+                return xeus::create_error_reply(error.m_ename, error.m_evalue, error.m_traceback);
+            }
+        }
+    }
+
+    std::string create_subshell()
+    {
+        std::string id = xeus::new_xguid();
+        auto queue = std::make_shared<subshell_queue>();
+        std::thread thread(run_subshell, queue);
+
+        subshell_registry& registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        registry.m_subshells[id] = subshell{std::move(queue), std::move(thread)};
+        return id;
+    }
+
+    bool delete_subshell(const std::string& id)
+    {
+        subshell_registry& registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        auto it = registry.m_subshells.find(id);
+        if (it == registry.m_subshells.end())
+        {
+            return false;
+        }
+        stop(*(it->second.m_queue));
+        registry.m_deleted.push_back(std::move(it->second));
+        registry.m_subshells.erase(it);
+        return true;
+    }
+
+    nl::json list_subshells()
+    {
+        subshell_registry& registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        nl::json res = nl::json::array();
+        for (const auto& subshell : registry.m_subshells)
+        {
+            res.push_back(subshell.first);
+        }
+        return res;
+    }
+
+    bool subshell_execution_running()
+    {
+        return get_registry().m_pending.load() != 0;
+    }
+
+    void stop_subshells()
+    {
+        subshell_registry& registry = get_registry();
+        std::vector<subshell> subshells;
+        {
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            for (auto& subshell : registry.m_subshells)
+            {
+                subshells.push_back(std::move(subshell.second));
+            }
+            registry.m_subshells.clear();
+            for (auto& subshell : registry.m_deleted)
+            {
+                subshells.push_back(std::move(subshell));
+            }
+            registry.m_deleted.clear();
+        }
+
+        for (auto& subshell : subshells)
+        {
+            // The queued tasks are dropped with the GIL held, the running
+            // ones are interrupted
+            std::deque<task_type> tasks;
+            {
+                std::lock_guard<std::mutex> lock(subshell.m_queue->m_mutex);
+                std::swap(tasks, subshell.m_queue->m_tasks);
+            }
+            registry.m_pending -= tasks.size();
+            tasks.clear();
+            stop(*(subshell.m_queue));
+            unsigned long thread_id = subshell.m_queue->m_thread_id.load();
+            if (thread_id != 0)
+            {
+                PyThreadState_SetAsyncExc(thread_id, PyExc_KeyboardInterrupt);
+            }
+        }
+
+        py::gil_scoped_release release;
+        for (auto& subshell : subshells)
+        {
+            if (subshell.m_thread.joinable())
+            {
+                subshell.m_thread.join();
+            }
+        }
+    }
+
+    std::string subshell_id(const xeus::xrequest_context& context)
+    {
+        const nl::json& header = context.header();
+        auto it = header.find("subshell_id");
+        return it != header.end() && it->is_string() ? it->get<std::string>() : std::string();
+    }
+
+    bool execute_in_subshell(const std::string& id,
+                             py::dict ns,
+                             const std::string& code,
+                             bool silent,
+                             xeus::xinterpreter::send_reply_callback cb)
+    {
+        std::shared_ptr<subshell_queue> queue = find_subshell(id);
+        if (!queue)
+        {
+            return false;
+        }
+
+        // The replies are sent on the shell socket, by the thread of the
+        // event loop
+        py::object loop = get_handle(xhandle::asyncio_get_running_loop)();
+        const xeus::xrequest_context* current = load_request_context();
+        if (current == nullptr)
+        {
+            return false;
+        }
+        xeus::xrequest_context context = *current;
+        auto state = std::make_shared<std::pair<py::object, py::object>>(std::move(ns), std::move(loop));
+        auto task = [code, silent, cb, context, state, queue]()
+        {
+            py::gil_scoped_acquire acquire;
+            nl::json reply;
+            try
+            {
+                queue->m_thread_id.store(PyThread_get_thread_ident());
+                // Outputs are attributed to the request
+                store_request_context(context);
+                set_input_allowed_in_context(false);
+                reply = run_code(state->first, code, silent);
+            }
+            catch (py::error_already_set& e)
+            {
+                // The KeyboardInterrupt of stop_subshells may be raised
+                // outside of the cell
+                xerror error = extract_already_set_error(e);
+                reply = xeus::create_error_reply(error.m_ename, error.m_evalue, error.m_traceback);
+            }
+            catch (std::exception& e)
+            {
+                reply = xeus::create_error_reply("SubshellError", e.what(), nl::json::array());
+            }
+            queue->m_thread_id.store(0);
+            // The namespace may hibernate again once the reply is sent
+            --get_registry().m_pending;
+
+            py::cpp_function send_reply([cb, reply]()
+            {
+                cb(reply);
+                get_hibernation().arm();
+            });
+            try
+            {
+                state->second.attr("call_soon_threadsafe")(send_reply);
+            }
+            catch (py::error_already_set&)
+            {
+                // The loop is closed, the kernel is shutting down
+            }
+            // Released with the GIL held
+            *state = std::make_pair(py::object(), py::object());
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(queue->m_mutex);
+            queue->m_tasks.push_back(std::move(task));
+            ++get_registry().m_pending;
+        }
+        queue->m_condition.notify_one();
+        return true;
+    }
+}
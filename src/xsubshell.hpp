@@ -0,0 +1,87 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_SUBSHELL_HPP
+#define XPYT_SUBSHELL_HPP
+
+#include <functional>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xinterpreter.hpp"
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Subshells, after the kernel subshells proposal of Jupyter.
+     *
+     * Each subshell has its own queue and thread. The execute requests
+     * whose header holds the id of a subshell (subshell_id) are queued on
+     * it instead of being run by the shell, which can handle other requests
+     * meanwhile. The code of the cells is run in the user namespace, with
+     * the GIL (or in parallel on free-threaded builds); their outputs are
+     * attributed to their request, and their replies are sent by the event
+     * loop of the shell.
+     *
+     * Differences with the main shell: the value of the last expression is
+     * not displayed, the cells cannot be interrupted and cannot request
+     * inputs.
+     *
+     * Only the execution side of the proposal is implemented: the shell
+     * socket is still read by the thread of the main shell, so a request
+     * sent to a subshell waits while a cell runs on the main shell. Long
+     * cells are sent to a subshell to keep the main shell responsive.
+     * Subshells are created from Python, the create_subshell_request,
+     * delete_subshell_request and list_subshell_request messages of the
+     * control channel are not handled, and kernel_info does not advertise
+     * the feature, since xeus dispatches the control messages itself.
+     *
+     * While a subshell has queued or running cells, the namespace does not
+     * hibernate and soft restarts are refused. The threads are stopped and
+     * joined on shutdown.
+     */
+
+    // Returns the id of the new subshell
+    std::string create_subshell();
+
+    // The subshell stops once its queued requests have been run, returns
+    // false if the id is unknown.
+    bool delete_subshell(const std::string& id);
+
+    nl::json list_subshells();
+
+    // Whether cells are queued or running on subshells
+    bool subshell_execution_running();
+
+    // Drops the queued cells, interrupts the running ones and joins the
+    // threads of the subshells. Requires the GIL, which is released while
+    // joining.
+    void stop_subshells();
+
+    // Id of the subshell targeted by a request, empty for the main shell
+    std::string subshell_id(const xeus::xrequest_context& context);
+
+    // Queues the execution of the code in the namespace ns on the subshell.
+    // cb is called from the event loop of the shell. Returns false if the
+    // subshell does not exist. Requires the GIL.
+    bool execute_in_subshell(const std::string& id,
+                             py::dict ns,
+                             const std::string& code,
+                             bool silent,
+                             xeus::xinterpreter::send_reply_callback cb);
+}
+
+#endif
@@ -0,0 +1,128 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_THREADING_HPP
+#define XPYT_THREADING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "pybind11/pybind11.h"
+
+namespace xpyt
+{
+    /**
+     * Lock of the state of xeus-python that the GIL protects on regular
+     * CPython builds: code caches, interned handles, traceback filename
+     * mapping, idle tasks and the mutable state of comms.
+     *
+     * On free-threaded builds (Py_GIL_DISABLED) it is a PyMutex, which
+     * detaches the thread state while blocking so that a waiting thread
+     * never stalls a stop-the-world pause of the interpreter. It is not
+     * recursive, critical sections must not call back into user code.
+     * On regular builds the GIL is enough and the lock is a no-op.
+     *
+     * The static module caches (get_display_module and siblings) do not
+     * need it. Most of them are filled by configure_impl before any request
+     * is handled. With --lazy, the IPython interpreter fills the display,
+     * traceback and kernel modules later, when it initializes its shell;
+     * this runs once under call_once_with_gil, the other threads wait for
+     * it, and the modules are not modified afterwards.
+     */
+#ifdef Py_GIL_DISABLED
+    class xstate_mutex
+    {
+    public:
+
+        void lock() { PyMutex_Lock(&m_mutex); }
+        void unlock() { PyMutex_Unlock(&m_mutex); }
+
+    private:
+
+        PyMutex m_mutex = {0};
+    };
+
+    constexpr bool free_threaded_build = true;
+#else
+    class xstate_mutex
+    {
+    public:
+
+        void lock() {}
+        void unlock() {}
+    };
+
+    constexpr bool free_threaded_build = false;
+#endif
+
+    using xstate_lock = std::lock_guard<xstate_mutex>;
+
+    // States of call_once_with_gil whose function runs on this thread
+    inline std::vector<const std::atomic<int>*>& running_once_states()
+    {
+        thread_local std::vector<const std::atomic<int>*> states;
+        return states;
+    }
+
+    /**
+     * Runs f once for a given state, initially 0, with the GIL held.
+     * Returns true in the call that ran f. Unlike std::call_once, a thread
+     * waiting for another one to complete f releases the GIL, which f may
+     * release and acquire again while it runs. If f throws, the state is
+     * reset and the next call runs it again. If f calls back into the same
+     * initialization, the inner call throws std::logic_error instead of
+     * waiting for itself.
+     */
+    template <class F>
+    bool call_once_with_gil(std::atomic<int>& state, F&& f)
+    {
+        constexpr int pending = 0;
+        constexpr int running = 1;
+        constexpr int done = 2;
+        std::vector<const std::atomic<int>*>& running_here = running_once_states();
+        while (true)
+        {
+            int expected = pending;
+            if (state.compare_exchange_strong(expected, running, std::memory_order_acq_rel))
+            {
+                running_here.push_back(&state);
+                try
+                {
+                    f();
+                }
+                catch (...)
+                {
+                    running_here.pop_back();
+                    state.store(pending, std::memory_order_release);
+                    throw;
+                }
+                running_here.pop_back();
+                state.store(done, std::memory_order_release);
+                return true;
+            }
+            if (expected == done)
+            {
+                return false;
+            }
+            if (std::find(running_here.cbegin(), running_here.cend(), &state) != running_here.cend())
+            {
+                throw std::logic_error("call_once_with_gil: the initialization calls itself back");
+            }
+            pybind11::gil_scoped_release release;
+            std::this_thread::yield();
+        }
+    }
+}
+
+#endif
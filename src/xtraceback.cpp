@@ -18,7 +18,9 @@
 
 #include "pybind11/pybind11.h"
 
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
+#include "xthreading.hpp"
 
 namespace py = pybind11;
 
@@ -29,17 +31,38 @@ namespace xpyt
         return get_cell_tmp_file(raw_code);
     }
 
-    using filename_map = std::map<std::string, int>;
-
-    filename_map& get_filename_map()
+    namespace
     {
-        static filename_map fnm;
-        return fnm;
+        using filename_map = std::map<std::string, int>;
+
+        struct filename_registry
+        {
+            xstate_mutex m_mutex;
+            filename_map m_map;
+        };
+
+        filename_registry& get_filename_registry()
+        {
+            static filename_registry registry;
+            return registry;
+        }
+
+        // Returns the execution count of the cell stored in filename, -1
+        // if it is not a cell file
+        int find_execution_count(const std::string& filename)
+        {
+            filename_registry& registry = get_filename_registry();
+            xstate_lock lock(registry.m_mutex);
+            auto it = registry.m_map.find(filename);
+            return it != registry.m_map.end() ? it->second : -1;
+        }
     }
 
     void register_filename_mapping(const std::string& filename, int execution_count)
     {
-        get_filename_map()[filename] = execution_count;
+        filename_registry& registry = get_filename_registry();
+        xstate_lock lock(registry.m_mutex);
+        registry.m_map[filename] = execution_count;
     }
 
     xerror extract_error(const py::list& error)
@@ -95,7 +118,7 @@ namespace xpyt
 
             if (py_tb.ptr() != nullptr && !py_tb.is_none())
             {
-                for (py::handle py_frame : py::module::import("traceback").attr("extract_tb")(py_tb))
+                for (py::handle py_frame : get_handle(xhandle::traceback_extract_tb)(py_tb))
                 {
                     std::string filename;
                     std::string lineno;
@@ -123,10 +146,10 @@ namespace xpyt
                     if(!filename.empty() && !filename.compare(0, prefix.size(), prefix.c_str(), prefix.size()))
                     {
                         file_prefix = "In  ";
-                        auto it = get_filename_map().find(filename);
-                        if(it != get_filename_map().end())
+                        int execution_count = find_execution_count(filename);
+                        if(execution_count != -1)
                         {
-                            filename = '[' + std::to_string(it->second) + ']';
+                            filename = '[' + std::to_string(execution_count) + ']';
                         }
                     }
                     else
@@ -37,10 +37,12 @@
 #include "pybind11_json/pybind11_json.hpp"
 
 #include "pybind11/pybind11.h"
-#include "pybind11/eval.h"
 
 #include "xeus-python/xutils.hpp"
 
+#include "xcode_cache.hpp"
+#include "xhandles.hpp"
+
 namespace py = pybind11;
 namespace nl = nlohmann;
 
@@ -56,14 +58,91 @@ namespace xpyt
         return PyGILState_Check();
     }
 
+    namespace
+    {
+        // Compiled snippets are kept in the snippet cache when cached is true
+        py::object compile_string(const py::str& source, int start, bool cached)
+        {
+            Py_ssize_t size = 0;
+            const char* buffer = PyUnicode_AsUTF8AndSize(source.ptr(), &size);
+            if (buffer == nullptr)
+            {
+                throw py::error_already_set();
+            }
+            std::string code(buffer, static_cast<std::size_t>(size));
+
+            xcode_cache& cache = get_snippet_cache();
+            xcode_cache::entry entry;
+            if (cached && cache.find(code, start, entry))
+            {
+                return entry.m_body;
+            }
+
+            PyObject* compiled = Py_CompileString(code.c_str(), "<string>", start);
+            if (compiled == nullptr)
+            {
+                throw py::error_already_set();
+            }
+            py::object res = py::reinterpret_steal<py::object>(compiled);
+            if (cached)
+            {
+                cache.insert(code, start, xcode_cache::entry{res, py::none()});
+            }
+            return res;
+        }
+
+        py::object eval_code(const py::object& code, const py::object& scope, int start, bool cached = false)
+        {
+            // Only dictionaries can be used as globals by PyEval_EvalCode
+            if (!PyDict_Check(scope.ptr()))
+            {
+                py::object builtins = get_handle(xhandle::builtins);
+                return builtins.attr(start == Py_eval_input ? "eval" : "exec")(code, scope, scope);
+            }
+
+            py::object compiled;
+            if (PyCode_Check(code.ptr()))
+            {
+                compiled = code;
+            }
+            else if (py::isinstance<py::str>(code))
+            {
+                compiled = compile_string(code, start, cached);
+            }
+            else
+            {
+                compiled = get_handle(xhandle::builtins).attr("compile")(code, "<string>", start == Py_eval_input ? "eval" : "exec");
+            }
+
+            // Same as the exec and eval builtins
+            if (PyDict_GetItemString(scope.ptr(), "__builtins__") == nullptr
+                && PyDict_SetItemString(scope.ptr(), "__builtins__", PyEval_GetBuiltins()) != 0)
+            {
+                throw py::error_already_set();
+            }
+
+            PyObject* res = PyEval_EvalCode(compiled.ptr(), scope.ptr(), scope.ptr());
+            if (res == nullptr)
+            {
+                throw py::error_already_set();
+            }
+            return py::reinterpret_steal<py::object>(res);
+        }
+    }
+
     void exec(const py::object& code, const py::object& scope)
     {
-        py::exec("exec(_code_, _scope_, _scope_)", py::globals(), py::dict(py::arg("_code_") = code, py::arg("_scope_") = scope));
+        eval_code(code, scope, Py_file_input);
     }
 
     py::object eval(const py::object& code, const py::object& scope)
     {
-        return py::eval(code, scope);
+        return eval_code(code, scope, Py_eval_input);
+    }
+
+    void exec_snippet(const py::str& code, const py::object& scope)
+    {
+        eval_code(code, scope, Py_file_input, true);
     }
 
     bool extract_option(std::string short_opt, std::string long_opt, int argc, char* argv[])
@@ -0,0 +1,49 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Measures the round trip of small cells executed repeatedly in raw mode,
+# with and without the cell code cache.
+
+from bench_utils import execute, report, start_kernel, timeit
+
+CELLS = {
+    'assignment': "x = 1",
+    'expression': "x + 1",
+    'loop': "total = 0\nfor i in range(10):\n    total += i\ntotal",
+    'function': "def f(a, b=2):\n    return a * b\nf(21)",
+}
+
+
+def run(capacity, repeat=200):
+    km, kc = start_kernel(raw=True)
+    try:
+        execute(kc, f"import xpython_runtime; xpython_runtime.set_code_cache_capacity({capacity}); x = 0")
+        timings = {}
+        for name, code in CELLS.items():
+            execute(kc, code)
+            timings[name] = timeit(lambda: execute(kc, code), repeat=repeat)
+        return timings
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+
+
+def main():
+    uncached = run(0)
+    cached = run(256)
+    rows = []
+    for name in CELLS:
+        (median_off, _), (median_on, _) = uncached[name], cached[name]
+        rows.append([name, f"{median_off * 1e6:.0f}", f"{median_on * 1e6:.0f}", f"{median_off / median_on:.2f}"])
+    report("Repeated cell round trip, raw mode", ["cell", "no cache (us)", "cache (us)", "speedup"], rows)
+
+
+if __name__ == '__main__':
+    main()
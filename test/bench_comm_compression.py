@@ -0,0 +1,100 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Compares the size on the wire and the kernel-side cost of Comm.send for
+# typical widget payloads, with and without buffer compression. Requires a
+# kernel built with XPYT_WITH_ZSTD and/or XPYT_WITH_LZ4, and numpy.
+
+import json
+import textwrap
+
+from bench_utils import execute, report, start_kernel
+
+SETUP = textwrap.dedent("""
+    import json, time
+    import numpy as np
+    from comm import create_comm
+
+    rng = np.random.default_rng(42)
+
+    def point_cloud(n=1_000_000):
+        u, v = rng.random((2, n), dtype=np.float32) * 2 * np.pi
+        xyz = np.stack([np.cos(u) * (2 + np.cos(v)), np.sin(u) * (2 + np.cos(v)), np.sin(v)], axis=1)
+        return np.round(xyz, 3).astype(np.float32)
+
+    def image_tile(size=1024):
+        x = np.linspace(0, 8, size)
+        img = np.sin(x)[:, None] * np.cos(x)[None, :]
+        rgb = np.stack([img, img ** 2, 1 - img], axis=2)
+        return ((rgb - rgb.min()) / np.ptp(rgb) * 255).astype(np.uint8)
+
+    def volume(size=128):
+        g = np.linspace(-1, 1, size)
+        x, y, z = np.meshgrid(g, g, g, indexing='ij')
+        return (np.exp(-4 * (x ** 2 + y ** 2 + z ** 2)) * 4096).astype(np.int16)
+
+    payloads = {'point_cloud': point_cloud(), 'image_tile': image_tile(), 'volume': volume()}
+""")
+
+SEND = textwrap.dedent("""
+    timings = {{}}
+    for name, array in payloads.items():
+        durations = []
+        for _ in range({repeat}):
+            start = time.perf_counter()
+            c.send(data={{'name': name}}, buffers=[memoryview(array)])
+            durations.append(time.perf_counter() - start)
+        timings[name] = min(durations)
+    print(json.dumps({{'codec': c.compression, 'timings': timings}}))
+""")
+
+
+def run(codec, repeat=5):
+    km, kc = start_kernel()
+    try:
+        execute(kc, SETUP, timeout=120)
+        _, outputs = execute(kc, f"c = create_comm(target_name='xpython.bench', compression={codec!r})")
+        comm_id = next(m['content']['comm_id'] for m in outputs if m['msg_type'] == 'comm_open')
+
+        if codec is not None:
+            # Act as a frontend accepting the codec advertised in comm_open
+            msg = kc.session.msg('comm_msg', {'comm_id': comm_id, 'data': {}},
+                                 metadata={'buffer_codecs': [codec]})
+            kc.shell_channel.send(msg)
+
+        _, outputs = execute(kc, SEND.format(repeat=repeat), timeout=300)
+        stream = ''.join(m['content']['text'] for m in outputs if m['msg_type'] == 'stream')
+        result = json.loads(stream.strip().splitlines()[-1])
+
+        sizes = {}
+        for m in outputs:
+            if m['msg_type'] == 'comm_msg':
+                sizes[m['content']['data']['name']] = sum(len(b) for b in m['buffers'])
+        return result, sizes
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+
+
+def main():
+    baseline, raw_sizes = run(None)
+    rows = [[name, 'none', raw_sizes[name], '1.00', f"{t * 1e3:.2f}"] for name, t in baseline['timings'].items()]
+    for codec in ['zstd', 'lz4']:
+        result, sizes = run(codec)
+        if result['codec'] != codec:
+            print(f"{codec}: not available in this build, skipped")
+            continue
+        for name, t in result['timings'].items():
+            rows.append([name, codec, sizes[name], f"{raw_sizes[name] / sizes[name]:.2f}", f"{t * 1e3:.2f}"])
+    report("Comm.send buffer compression", ["payload", "codec", "bytes on wire", "ratio", "send (ms)"], rows)
+
+
+if __name__ == '__main__':
+    main()
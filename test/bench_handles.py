@@ -0,0 +1,88 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Compares the resolution of the interned Python handles with the per-call
+# import and lookup they replace, in the kernel, then measures the round
+# trip of cells going through the hot paths that use them (display objects,
+# tracebacks) and checks that the handles are not resolved again once the
+# kernel is warm.
+
+from bench_utils import execute, report, start_kernel, timeit
+
+SETUP = """\
+import time, xpython_runtime
+from IPython.core.display import JSON, Math, Markdown, display
+
+def measure(interned, number):
+    start = time.perf_counter()
+    for _ in range(number):
+        xpython_runtime._resolve_handles(interned)
+    return (time.perf_counter() - start) / number
+"""
+
+CELLS = {
+    'empty': "pass",
+    'json': "display(JSON('{\"a\": [1, 2, 3]}', metadata={'expanded': True}))",
+    'math': "display(Math('x^2', metadata={'key': 1}))",
+    'markdown': "display(Markdown('# title'))",
+    'traceback': "def f():\n    raise ValueError('bench')\nf()",
+}
+
+
+def resolutions(kc):
+    _, outputs = execute(kc, "print(xpython_runtime.handle_resolutions())")
+    return int(outputs[-1]['content']['text'])
+
+
+def resolution(kc, interned, number=1000):
+    _, outputs = execute(kc, f"print(measure({interned}, {number}), end='')")
+    return float(outputs[-1]['content']['text'])
+
+
+def run_resolution():
+    km, kc = start_kernel()
+    try:
+        execute(kc, SETUP)
+        uncached = resolution(kc, False)
+        interned = resolution(kc, True)
+        return [["all handles", f"{uncached * 1e6:.2f}", f"{interned * 1e6:.2f}", f"{uncached / interned:.1f}x"]]
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+
+
+def run(raw, repeat=200):
+    km, kc = start_kernel(raw=raw)
+    try:
+        execute(kc, SETUP)
+        timings = {}
+        for name, code in CELLS.items():
+            execute(kc, code)
+            before = resolutions(kc)
+            median, _ = timeit(lambda: execute(kc, code), repeat=repeat)
+            timings[name] = (median, resolutions(kc) - before)
+        return timings
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+
+
+def main():
+    report("Handle resolution", ["handles", "import and lookup (us)", "interned (us)", "speedup"], run_resolution())
+    for raw in (False, True):
+        rows = []
+        for name, (median, delta) in run(raw).items():
+            rows.append([name, f"{median * 1e6:.0f}", str(delta)])
+        mode = "raw" if raw else "ipython"
+        report(f"Hot path round trip, {mode} mode", ["cell", "median (us)", "new resolutions"], rows)
+
+
+if __name__ == '__main__':
+    main()
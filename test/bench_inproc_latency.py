@@ -0,0 +1,54 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Round trip of a kernel_info request over loopback ZMQ and over the
+# in-process transport. Requires the xpython extension.
+
+import xpython_extension
+
+from bench_utils import report, start_kernel, timeit
+
+
+def zmq_round_trip(number):
+    km, kc = start_kernel(raw=True)
+    try:
+        def request():
+            kc.kernel_info()
+            kc.get_shell_msg(timeout=10)
+        return timeit(request, repeat=5, number=number)
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+
+
+def inproc_round_trip(number):
+    kernel = xpython_extension.InProcessKernel(['--raw'])
+    try:
+        def request():
+            kernel.kernel_info()
+            kernel.get_shell_msg(timeout=10)
+        return timeit(request, repeat=5, number=number)
+    finally:
+        kernel.shutdown()
+
+
+def main():
+    number = 1000
+    zmq_median, zmq_min = zmq_round_trip(number)
+    inproc_median, inproc_min = inproc_round_trip(number)
+    rows = [
+        ["zmq", f"{zmq_median * 1e6:.1f}", f"{zmq_min * 1e6:.1f}"],
+        ["inproc", f"{inproc_median * 1e6:.1f}", f"{inproc_min * 1e6:.1f}"],
+    ]
+    report("kernel_info round trip", ["transport", "median (us)", "min (us)"], rows)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,63 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Measures, inside the kernel, the cost of the internal request path used by
+# the debugger, against the former string-wrapper trampoline of xpyt::exec
+# and a plain exec call.
+
+import json
+import textwrap
+
+from bench_utils import execute, report, start_kernel
+
+BENCH = textwrap.dedent("""
+    import json, time
+    import xpython_runtime
+
+    def bench(func, number={number}):
+        start = time.perf_counter()
+        for _ in range(number):
+            func()
+        return (time.perf_counter() - start) / number
+
+    snippet = {snippet!r}
+    scope = {{}}
+    results = {{
+        'internal request': bench(lambda: xpython_runtime._internal_request(snippet)),
+        'exec trampoline': bench(lambda: exec("exec(_code_, _scope_, _scope_)", {{}},
+                                              {{'_code_': snippet, '_scope_': scope}})),
+        'plain exec': bench(lambda: exec(snippet, scope)),
+    }}
+    print(json.dumps(results))
+""")
+
+SNIPPETS = {
+    'assignment': "x = 1",
+    'copy to globals': "import sys; globals()['copied'] = sys.modules",
+}
+
+
+def main():
+    km, kc = start_kernel()
+    try:
+        rows = []
+        for name, snippet in SNIPPETS.items():
+            _, outputs = execute(kc, BENCH.format(number=20000, snippet=snippet), timeout=300)
+            stream = ''.join(m['content']['text'] for m in outputs if m['msg_type'] == 'stream')
+            for path, duration in json.loads(stream.strip().splitlines()[-1]).items():
+                rows.append([name, path, f"{duration * 1e6:.2f}"])
+        report("Internal snippet execution", ["snippet", "path", "per call (us)"], rows)
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,64 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Measures the time from the kernel launch to the first kernel_info_reply,
+# for a regular launch, a lazy configuration and a launch through a
+# forkserver template.
+
+import os
+import subprocess
+import tempfile
+import time
+
+from bench_utils import report, start_kernel, timeit
+
+
+def time_to_kernel_info(raw, extra_arguments=None):
+    def launch():
+        km, kc = start_kernel(raw=raw, extra_arguments=extra_arguments)
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+    return timeit(launch, repeat=10)
+
+
+def start_template(socket_path, raw):
+    arguments = ['xpython', '--forkserver', socket_path]
+    if raw:
+        arguments.append('--raw')
+    template = subprocess.Popen(arguments, stderr=subprocess.DEVNULL)
+    deadline = time.monotonic() + 60
+    while not os.path.exists(socket_path):
+        if time.monotonic() > deadline or template.poll() is not None:
+            template.kill()
+            raise RuntimeError("the forkserver template did not start")
+        time.sleep(0.05)
+    return template
+
+
+def main():
+    rows = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for raw in (False, True):
+            socket_path = os.path.join(tmp, f"xpython-{int(raw)}.sock")
+            template = start_template(socket_path, raw)
+            try:
+                regular, _ = time_to_kernel_info(raw)
+                lazy, _ = time_to_kernel_info(raw, ['--lazy'])
+                forked, _ = time_to_kernel_info(raw, ['--forkserver-client', socket_path])
+            finally:
+                template.terminate()
+                template.wait()
+            mode = "raw" if raw else "ipython"
+            rows.append([mode, f"{regular * 1e3:.0f}", f"{lazy * 1e3:.0f}", f"{forked * 1e3:.0f}"])
+    report("Time to first kernel_info_reply", ["mode", "regular (ms)", "lazy (ms)", "forkserver (ms)"], rows)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,48 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Measures cells producing many outputs. Each stream message and each
+# display looks up the context of the request being handled.
+
+from bench_utils import execute, report, start_kernel, timeit
+
+CELLS = {
+    'print x1000': "for i in range(1000): print(i)",
+    'write x1000': "import sys\nfor i in range(1000): sys.stdout.write(str(i)); sys.stdout.flush()",
+    'display x200': "from IPython.display import display\nfor i in range(200): display(i)",
+    'print in task x1000': "import asyncio\nasync def f():\n    for i in range(1000): print(i)\nawait asyncio.create_task(f())",
+}
+
+
+def run(raw, repeat=10):
+    km, kc = start_kernel(raw=raw)
+    try:
+        timings = {}
+        for name, code in CELLS.items():
+            if raw and 'await' in code:
+                continue
+            execute(kc, code)
+            median, _ = timeit(lambda: execute(kc, code), repeat=repeat)
+            timings[name] = median
+        return timings
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+
+
+def main():
+    for raw in (False, True):
+        rows = [[name, f"{median * 1e3:.1f}"] for name, median in run(raw).items()]
+        mode = "raw" if raw else "ipython"
+        report(f"Output heavy cells, {mode} mode", ["cell", "median (ms)"], rows)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,66 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Compares the conversion of published objects to JSON with the direct
+# conversion of the kernel and with pybind11_json, in the kernel, then
+# measures the round trip of displaying them.
+
+from bench_utils import execute, report, start_kernel, timeit
+
+SETUP = """\
+import time, xpython_runtime
+from IPython.display import display
+
+payloads = {
+    'small bundle': {'text/plain': 'x' * 100, 'text/html': '<b>' + 'x' * 100 + '</b>'},
+    'large bundle': {'text/plain': 'x' * 1000000, 'text/html': '<pre>' + 'x' * 1000000 + '</pre>'},
+    'nested json': {'application/json': {'rows': [{'id': i, 'value': i * 0.5, 'name': str(i), 'tags': ['a', 'b']} for i in range(20000)]}},
+}
+
+def measure(obj, direct, number):
+    start = time.perf_counter()
+    for _ in range(number):
+        xpython_runtime._to_json(obj, direct)
+    return (time.perf_counter() - start) / number
+"""
+
+
+def conversion(kc, name, direct, number=20):
+    code = f"print(measure(payloads[{name!r}], {direct}, {number}), end='')"
+    _, outputs = execute(kc, code)
+    return float(outputs[-1]['content']['text'])
+
+
+def main():
+    km, kc = start_kernel()
+    try:
+        execute(kc, SETUP)
+        names = ['small bundle', 'large bundle', 'nested json']
+
+        rows = []
+        for name in names:
+            direct = conversion(kc, name, True)
+            pybind11_json = conversion(kc, name, False)
+            rows.append([name, f"{pybind11_json * 1e6:.0f}", f"{direct * 1e6:.0f}", f"{pybind11_json / direct:.1f}x"])
+        report("Conversion to JSON", ["payload", "pybind11_json (us)", "direct (us)", "speedup"], rows)
+
+        rows = []
+        for name in names:
+            code = f"display(payloads[{name!r}], raw=True)"
+            median, _ = timeit(lambda: execute(kc, code), repeat=20)
+            rows.append([name, f"{median * 1e3:.2f}"])
+        report("Display round trip", ["payload", "median (ms)"], rows)
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel(now=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,53 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Compares a regular restart of the kernel, which starts a new process, to
+# an in-process soft restart, up to the end of a cell importing the given
+# modules again, e.g.
+#   python test/bench_restart.py numpy pandas
+
+import sys
+
+from bench_utils import execute, report, start_kernel, timeit
+
+
+def main():
+    modules = sys.argv[1:] or ['numpy']
+    import_code = "import " + ", ".join(modules)
+
+    rows = []
+    for raw in (False, True):
+        km, kc = start_kernel(raw=raw)
+        try:
+            execute(kc, import_code)
+
+            def hard_restart():
+                km.restart_kernel(now=False)
+                kc.wait_for_ready(timeout=60)
+                execute(kc, import_code)
+
+            def soft_restart():
+                execute(kc, "import xpython_runtime; xpython_runtime.soft_restart()")
+                execute(kc, import_code)
+
+            hard, _ = timeit(hard_restart, repeat=5)
+            soft, _ = timeit(soft_restart, repeat=5)
+        finally:
+            kc.stop_channels()
+            km.shutdown_kernel(now=True)
+
+        mode = "raw" if raw else "ipython"
+        rows.append([mode, f"{hard * 1e3:.0f}", f"{soft * 1e3:.0f}"])
+
+    report(f"Restart and {import_code}", ["mode", "hard (ms)", "soft (ms)"], rows)
+
+
+if __name__ == '__main__':
+    main()
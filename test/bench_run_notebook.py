@@ -0,0 +1,69 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Compares the time to execute a notebook with `xpython --run-notebook` and
+# with papermill, which drives the kernel over ZMQ. Both include the startup
+# of the interpreter. Requires papermill.
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+from bench_utils import report, timeit
+
+
+def make_notebook(path, cell_count):
+    cells = [{
+        'cell_type': 'code', 'execution_count': None, 'id': 'parameters',
+        'metadata': {'tags': ['parameters']}, 'outputs': [], 'source': 'n = 10'
+    }]
+    for i in range(cell_count):
+        cells.append({
+            'cell_type': 'code', 'execution_count': None, 'id': f'cell-{i}', 'metadata': {},
+            'outputs': [], 'source': f'x{i} = sum(range(n))\nprint(x{i})\nx{i}'
+        })
+    notebook = {
+        'cells': cells,
+        'metadata': {'kernelspec': {'name': 'xpython', 'display_name': 'Python (XPython)', 'language': 'python'}},
+        'nbformat': 4,
+        'nbformat_minor': 5
+    }
+    with open(path, 'w') as f:
+        json.dump(notebook, f)
+
+
+def main():
+    rows = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for cell_count in (10, 100, 500):
+            input_path = os.path.join(tmp, f'in-{cell_count}.ipynb')
+            output_path = os.path.join(tmp, f'out-{cell_count}.ipynb')
+            make_notebook(input_path, cell_count)
+
+            def run_in_process():
+                subprocess.run(['xpython', '--run-notebook', input_path, '--output', output_path, '-p', 'n', '100'],
+                               check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+            def run_papermill():
+                subprocess.run([sys.executable, '-m', 'papermill', '-k', 'xpython', '-p', 'n', '100',
+                                input_path, output_path],
+                               check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+            in_process, _ = timeit(run_in_process, repeat=5)
+            papermill, _ = timeit(run_papermill, repeat=5)
+            rows.append([cell_count, f"{in_process * 1e3:.0f}", f"{papermill * 1e3:.0f}",
+                         f"{papermill / in_process:.1f}x"])
+    report("Notebook execution", ["cells", "--run-notebook (ms)", "papermill (ms)", "speedup"], rows)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,63 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+# Helpers shared by the bench_*.py scripts. The benchmarks are not collected
+# by pytest, run them directly with an installed xpython kernel, e.g.
+#   python test/bench_comm_compression.py
+
+import statistics
+import time
+
+from jupyter_client.manager import start_new_kernel
+
+
+def start_kernel(raw=False, extra_arguments=None):
+    arguments = list(extra_arguments or [])
+    if raw:
+        arguments.append('--raw')
+    return start_new_kernel(kernel_name='xpython', extra_arguments=arguments)
+
+
+def execute(kc, code, timeout=60):
+    """Executes code and returns the reply and the iopub messages it produced."""
+    msg_id = kc.execute(code)
+    reply = kc.get_shell_msg(timeout=timeout)
+    while reply['parent_header'].get('msg_id') != msg_id:
+        reply = kc.get_shell_msg(timeout=timeout)
+
+    outputs = []
+    while True:
+        msg = kc.get_iopub_msg(timeout=timeout)
+        if msg['parent_header'].get('msg_id') != msg_id:
+            continue
+        if msg['msg_type'] == 'status' and msg['content']['execution_state'] == 'idle':
+            break
+        outputs.append(msg)
+    return reply, outputs
+
+
+def timeit(func, repeat=5, number=1):
+    """Returns the median and the minimum duration of func, in seconds."""
+    durations = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        for _ in range(number):
+            func()
+        durations.append((time.perf_counter() - start) / number)
+    return statistics.median(durations), min(durations)
+
+
+def report(title, header, rows):
+    widths = [max(len(str(v)) for v in column) for column in zip(header, *rows)]
+    print(f"\n{title}")
+    print("  ".join(str(h).ljust(w) for h, w in zip(header, widths)))
+    print("  ".join("-" * w for w in widths))
+    for row in rows:
+        print("  ".join(str(v).ljust(w) for v, w in zip(row, widths)))
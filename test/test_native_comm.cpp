@@ -0,0 +1,140 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "doctest/doctest.h"
+
+// The kernel runs in the process of the test, with the in-process
+// transport, which is POSIX only.
+#ifndef _WIN32
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xcomm.hpp"
+#include "xeus/xeus_context.hpp"
+#include "xeus/xguid.hpp"
+#include "xeus/xhelper.hpp"
+#include "xeus/xkernel.hpp"
+#include "xeus/xmessage.hpp"
+
+#include "pybind11/embed.h"
+#include "pybind11/pybind11.h"
+
+#include "xeus-python/xinproc.hpp"
+#include "xeus-python/xinterpreter_raw.hpp"
+#include "xeus-python/xnative_comm.hpp"
+
+namespace nl = nlohmann;
+namespace py = pybind11;
+
+namespace
+{
+    xeus::xmessage make_request(const std::string& msg_type, nl::json content)
+    {
+        nl::json header = xeus::make_header(msg_type, xeus::get_user_name(), "native-comm-test");
+        return xeus::xmessage(xeus::xmessage::guid_list(),
+                              std::move(header),
+                              nl::json::object(),
+                              nl::json::object(),
+                              std::move(content),
+                              xeus::buffer_sequence());
+    }
+
+    // Comms opened by the client on the native target
+    struct native_comms
+    {
+        std::mutex m_mutex;
+        std::vector<std::unique_ptr<xeus::xcomm>> m_comms;
+    };
+}
+
+TEST_SUITE("native_comm")
+{
+    TEST_CASE("round_trip")
+    {
+        py::scoped_interpreter guard{};
+
+        auto channels = xpyt::make_inproc_channels();
+        using interpreter_ptr = std::unique_ptr<xeus::xinterpreter>;
+        interpreter_ptr interpreter(new xpyt::raw_interpreter(py::globals(), true, true));
+        xeus::xkernel kernel(xeus::get_user_name(),
+                             xeus::make_empty_context(),
+                             std::move(interpreter),
+                             xpyt::make_inproc_server_factory(channels),
+                             xeus::make_in_memory_history_manager(),
+                             nullptr);
+
+        native_comms comms;
+        std::atomic<bool> gil_held(true);
+        xpyt::register_native_comm_target("xpython.native_test",
+            [&comms, &gil_held](xeus::xcomm&& comm, const xeus::xmessage&)
+            {
+                auto owned = std::make_unique<xeus::xcomm>(std::move(comm));
+                xeus::xcomm* echo_comm = owned.get();
+                xpyt::on_native_message(*echo_comm, [echo_comm, &gil_held](const xeus::xmessage& msg)
+                {
+                    gil_held = PyGILState_Check() != 0;
+                    echo_comm->send(nl::json::object(), {{"echo", msg.content()["data"]}}, xeus::buffer_sequence());
+                });
+                std::lock_guard<std::mutex> lock(comms.m_mutex);
+                comms.m_comms.push_back(std::move(owned));
+            });
+        REQUIRE(xpyt::is_native_comm_target("xpython.native_test"));
+
+        nl::json echo;
+        {
+            // The kernel thread acquires the GIL to run its event loop
+            py::gil_scoped_release release;
+            std::thread kernel_thread([&kernel]() { kernel.start(); });
+            xpyt::xinproc_client client(channels);
+
+            std::string comm_id = xeus::new_xguid();
+            client.send_on_shell(make_request("comm_open", {
+                {"comm_id", comm_id},
+                {"target_name", "xpython.native_test"},
+                {"data", nl::json::object()}
+            }));
+            client.send_on_shell(make_request("comm_msg", {
+                {"comm_id", comm_id},
+                {"data", {{"n", 1}}}
+            }));
+
+            while (auto msg = client.receive_on_iopub(30000))
+            {
+                if (msg->header()["msg_type"] == "comm_msg" && msg->content()["comm_id"] == comm_id)
+                {
+                    echo = msg->content()["data"];
+                    break;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(comms.m_mutex);
+                comms.m_comms.clear();
+            }
+            client.send_on_control(make_request("shutdown_request", {{"restart", false}}));
+            kernel_thread.join();
+        }
+        xpyt::unregister_native_comm_target("xpython.native_test");
+
+        REQUIRE(echo.contains("echo"));
+        CHECK(echo["echo"]["n"] == 1);
+        CHECK_FALSE(gil_held);
+    }
+}
+
+#endif
@@ -0,0 +1,116 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+import unittest
+
+from jupyter_client.kernelspec import KernelSpecManager
+from jupyter_client.manager import KernelManager
+
+
+# The kernel is launched through a template by a client process, which
+# stays the process managed by jupyter_client.
+@unittest.skipIf(sys.platform.startswith('win'), "the forkserver mode requires a POSIX platform")
+class XeusPythonForkserverTests(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp = tempfile.TemporaryDirectory()
+        cls.socket_path = os.path.join(cls.tmp.name, 'forkserver.sock')
+        cls.template = subprocess.Popen(
+            ['xpython', '--forkserver', cls.socket_path],
+            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL
+        )
+        deadline = time.time() + 60
+        while not os.path.exists(cls.socket_path):
+            if time.time() > deadline or cls.template.poll() is not None:
+                cls.template.kill()
+                raise RuntimeError('the forkserver template did not start')
+            time.sleep(0.1)
+
+        spec_dir = os.path.join(cls.tmp.name, 'kernels', 'xpython-forkserver')
+        os.makedirs(spec_dir)
+        with open(os.path.join(spec_dir, 'kernel.json'), 'w') as f:
+            json.dump({
+                'argv': ['xpython', '--forkserver-client', cls.socket_path, '-f', '{connection_file}'],
+                'display_name': 'Python (forkserver)',
+                'language': 'python',
+                'env': {'XPYTHON_FORKSERVER_TEST': 'forwarded'}
+            }, f)
+
+        cls.cwd = os.path.realpath(os.path.join(cls.tmp.name, 'work'))
+        os.makedirs(cls.cwd)
+        spec_manager = KernelSpecManager(kernel_dirs=[os.path.join(cls.tmp.name, 'kernels')])
+        cls.km = KernelManager(kernel_name='xpython-forkserver', kernel_spec_manager=spec_manager)
+        cls.km.start_kernel(cwd=cls.cwd)
+        cls.kc = cls.km.client()
+        cls.kc.start_channels()
+        cls.kc.wait_for_ready(timeout=60)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.kc.stop_channels()
+        cls.km.shutdown_kernel()
+        cls.template.terminate()
+        cls.template.wait(timeout=10)
+        cls.tmp.cleanup()
+
+    def execute(self, code):
+        msg_id = self.kc.execute(code)
+        reply = self.kc.get_shell_msg(timeout=30)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        outputs = []
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=30)
+            if msg['parent_header'].get('msg_id') != msg_id:
+                continue
+            if msg['msg_type'] == 'status' and msg['content']['execution_state'] == 'idle':
+                return reply, outputs
+            outputs.append(msg)
+
+    def test_kernel_info(self):
+        msg_id = self.kc.kernel_info()
+        reply = self.kc.get_shell_msg(timeout=30)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['language_info']['name'], 'python')
+
+    def test_cwd_and_env(self):
+        reply, outputs = self.execute(
+            "import os\nprint(os.path.realpath(os.getcwd()), os.environ.get('XPYTHON_FORKSERVER_TEST'), end='')"
+        )
+        self.assertEqual(reply['content']['status'], 'ok')
+        streams = [msg for msg in outputs if msg['msg_type'] == 'stream']
+        self.assertEqual(streams[0]['content']['text'], self.cwd + ' forwarded')
+
+    def test_interrupt(self):
+        msg_id = self.kc.execute("x = 1\nwhile True: pass")
+        time.sleep(1)
+        # Sent to the client, which forwards it to the kernel
+        self.km.interrupt_kernel()
+        reply = self.kc.get_shell_msg(timeout=30)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['ename'], 'KeyboardInterrupt')
+
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=30)
+            if (msg['parent_header'].get('msg_id') == msg_id and msg['msg_type'] == 'status'
+                    and msg['content']['execution_state'] == 'idle'):
+                break
+        reply, outputs = self.execute("print(x, end='')")
+        self.assertEqual(reply['content']['status'], 'ok')
+
+
+if __name__ == '__main__':
+    unittest.main()
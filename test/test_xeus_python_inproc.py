@@ -0,0 +1,71 @@
+#############################################################################
+# Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and      #
+# Wolf Vollprecht                                                           #
+# Copyright (c) 2018, QuantStack                                            #
+#                                                                           #
+# Distributed under the terms of the BSD 3-Clause License.                  #
+#                                                                           #
+# The full license is in the file LICENSE, distributed with this software.  #
+#############################################################################
+
+import queue
+import sys
+import unittest
+
+try:
+    import xpython_extension
+except ImportError:
+    xpython_extension = None
+
+
+# A single kernel can run in a process, it is shared by the tests and runs
+# in raw mode so that it does not import IPython in the test process.
+@unittest.skipIf(xpython_extension is None or sys.platform.startswith('win'),
+                 "requires the xpython extension on a POSIX platform")
+class XeusPythonInProcessTests(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.kernel = xpython_extension.InProcessKernel(['--raw'])
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.kernel.shutdown()
+
+    def execute(self, code):
+        msg_id = self.kernel.execute(code)
+        reply = self.kernel.get_shell_msg(timeout=30)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        outputs = []
+        while True:
+            msg = self.kernel.get_iopub_msg(timeout=30)
+            if msg['parent_header'].get('msg_id') != msg_id:
+                continue
+            if msg['msg_type'] == 'status' and msg['content']['execution_state'] == 'idle':
+                return reply, outputs
+            outputs.append(msg)
+
+    def test_kernel_info(self):
+        msg_id = self.kernel.kernel_info()
+        reply = self.kernel.get_shell_msg(timeout=30)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['msg_type'], 'kernel_info_reply')
+        self.assertEqual(reply['content']['language_info']['name'], 'python')
+
+    def test_execute(self):
+        reply, outputs = self.execute("value = 6 * 7\nprint(value, end='')")
+        self.assertEqual(reply['content']['status'], 'ok')
+        streams = [msg for msg in outputs if msg['msg_type'] == 'stream']
+        self.assertEqual(streams[0]['content']['text'], '42')
+
+    def test_timeout(self):
+        with self.assertRaises(queue.Empty):
+            self.kernel.get_control_msg(timeout=0.1)
+
+    def test_single_kernel(self):
+        with self.assertRaises(RuntimeError):
+            xpython_extension.InProcessKernel(['--raw'])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -12,6 +12,7 @@ import unittest
 import jupyter_kernel_test
 from jupyter_client.manager import start_new_kernel
 import textwrap
+import time
 
 class XeusPythonTests(jupyter_kernel_test.KernelTests):
 
@@ -49,6 +50,15 @@ class XeusPythonTests(jupyter_kernel_test.KernelTests):
         reply, output_msgs = self.execute_helper(code='a = []; a.push_back(3)')
         self.assertEqual(output_msgs[0]['msg_type'], 'error')
     
+    def test_display_json_conversion(self):
+        self.flush_channels()
+        code = "from IPython.display import display\ndisplay({'application/json': {'a': [1, 2.5, None, True, 'é', (1, 2)], 'b': 2**63, 1: {}}, 'text/plain': 'x'}, raw=True)"
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+        data = output_msgs[0]['content']['data']
+        self.assertEqual(data['text/plain'], 'x')
+        self.assertEqual(data['application/json'], {'a': [1, 2.5, None, True, 'é', [1, 2]], 'b': 2**63, '1': {}})
+
     def test_toplevel_await(self):
         code =  textwrap.dedent(R"""
         import asyncio
@@ -75,6 +85,449 @@ class XeusPythonTests(jupyter_kernel_test.KernelTests):
         checkMsg(output_msgs[3], '\n')  # The newline after "World"
         checkMsg(output_msgs[4], '!')
 
+    def test_request_context_in_tasks(self):
+        self.flush_channels()
+        code = textwrap.dedent(R"""
+        import asyncio
+        async def f():
+            await asyncio.sleep(0.1)
+            print("task", end="")
+        await asyncio.create_task(f())
+        """)
+        msg_id = self.kc.execute(code)
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['content']['status'], 'ok')
+        # The output of the task is attributed to the cell which created it
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if msg['msg_type'] == 'stream':
+                break
+        self.assertEqual(msg['content']['text'], 'task')
+        self.assertEqual(msg['parent_header']['msg_id'], msg_id)
+
+    def test_completion_while_awaiting(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="import asyncio\nvalue = 42")
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        msg_id = self.kc.execute("print('waiting', flush=True)\nawait asyncio.sleep(2)")
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if msg['parent_header'].get('msg_id') == msg_id and msg['msg_type'] == 'stream':
+                break
+
+        # Handled by the shell while the cell awaits, from the snapshot
+        complete_id = self.kc.complete('val')
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['parent_header']['msg_id'], complete_id)
+        self.assertIn('value', reply['content']['matches'])
+        self.assertTrue(reply['content']['metadata']['approximate'])
+
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+    def test_input(self):
+        self.flush_channels()
+        self.kc.execute("input()", allow_stdin=False)
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['content']['status'], 'error')
+        self.flush_channels()
+
+        code = textwrap.dedent(R"""
+        import asyncio, xpython_runtime
+        ticks = 0
+        async def tick():
+            global ticks
+            while True:
+                ticks += 1
+                await asyncio.sleep(0.01)
+        task = asyncio.create_task(tick())
+        name = await xpython_runtime.ainput('name: ')
+        task.cancel()
+        print(name, ticks > 1, end='')
+        """)
+        msg_id = self.kc.execute(code, allow_stdin=True)
+        msg = self.kc.get_stdin_msg(timeout=10)
+        self.assertEqual(msg['content']['prompt'], 'name: ')
+        # The event loop keeps running while the input is awaited
+        time.sleep(0.5)
+        self.kc.input('xeus')
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['status'], 'ok')
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if msg['msg_type'] == 'stream':
+                break
+        self.assertEqual(msg['content']['text'], 'xeus True')
+
+    def test_comm_coroutine_handlers(self):
+        code = textwrap.dedent(R"""
+        import asyncio
+        from comm import create_comm
+
+        received = []
+
+        async def handler(msg):
+            n = msg['content']['data']['n']
+            # Later messages complete first unless the comm is ordered
+            await asyncio.sleep(0.05 * (3 - n))
+            received.append(n)
+            if len(received) == 3:
+                c.send(data={'received': received})
+
+        c = create_comm(target_name='xpython.test', ordered=True)
+        c.on_msg(handler)
+        print(c.comm_id, end='')
+        """)
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+        comm_id = next(m['content']['text'] for m in output_msgs if m['msg_type'] == 'stream')
+
+        for n in range(3):
+            msg = self.kc.session.msg('comm_msg', {'comm_id': comm_id, 'data': {'n': n}})
+            self.kc.shell_channel.send(msg)
+
+        # The handlers complete after the kernel is idle again, the last
+        # one sends the order in which they completed
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if msg['msg_type'] == 'comm_msg' and msg['content']['comm_id'] == comm_id:
+                break
+        self.assertEqual(msg['content']['data']['received'], [0, 1, 2])
+
+    def test_comm_shared_memory_buffers(self):
+        code = textwrap.dedent(R"""
+        from comm import create_comm
+        c = create_comm(target_name='xpython.test', shared_memory=True, shm_threshold=1024)
+        print(c.comm_id, c.shared_memory is not None, end='')
+        """)
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+        text = next(m['content']['text'] for m in output_msgs if m['msg_type'] == 'stream')
+        comm_id, available = text.split()
+        if available != 'True':
+            self.skipTest('shared memory is not available on this platform')
+
+        # Act as two local consumers accepting the shm transport
+        def send_transport_msg(metadata, session=None):
+            msg = self.kc.session.msg('comm_msg', {'comm_id': comm_id, 'data': {}}, metadata=metadata)
+            if session is not None:
+                msg['header']['session'] = session
+            self.kc.shell_channel.send(msg)
+            # Handled once the kernel is idle again
+            while True:
+                status = self.kc.get_iopub_msg(timeout=10)
+                if (status['parent_header'].get('msg_id') == msg['header']['msg_id']
+                        and status['msg_type'] == 'status'
+                        and status['content']['execution_state'] == 'idle'):
+                    break
+
+        send_transport_msg({'buffer_transports': ['shm']})
+        send_transport_msg({'buffer_transports': ['shm']}, session='other-consumer')
+
+        reply, output_msgs = self.execute_helper(
+            code="c.send(data={'n': 1}, buffers=[bytes(range(256)) * 64, b'small'])"
+        )
+        self.assertEqual(reply['content']['status'], 'ok')
+        comm_msg = next(m for m in output_msgs if m['msg_type'] == 'comm_msg')
+        handles = comm_msg['metadata']['buffer_handles']
+        self.assertIsNone(handles[1])
+        self.assertEqual(bytes(comm_msg['buffers'][1]), b'small')
+        self.assertEqual(len(comm_msg['buffers'][0]), 0)
+
+        from multiprocessing import shared_memory
+        handle = handles[0]
+        try:
+            shm = shared_memory.SharedMemory(name=handle['segment'], track=False)
+        except TypeError:
+            shm = shared_memory.SharedMemory(name=handle['segment'])
+        try:
+            data = bytes(shm.buf[handle['offset']:handle['offset'] + handle['size']])
+        finally:
+            shm.close()
+        self.assertEqual(data, bytes(range(256)) * 64)
+
+        # A second release by the same consumer and unknown ids are ignored,
+        # the block is held by the other consumer
+        send_transport_msg({'buffer_release': [handle['id']]})
+        send_transport_msg({'buffer_release': [handle['id'], handle['id'] + 1]})
+        reply, output_msgs = self.execute_helper(code="print(c.shared_memory['outstanding'], end='')")
+        self.assertEqual(output_msgs[0]['content']['text'], '1')
+
+        send_transport_msg({'buffer_release': [handle['id']]}, session='other-consumer')
+        reply, output_msgs = self.execute_helper(code="print(c.shared_memory['outstanding'], end='')")
+        self.assertEqual(output_msgs[0]['content']['text'], '0')
+
+        # Buffers are sent inline once a peer that does not read the shared
+        # memory talked on the comm
+        send_transport_msg({}, session='remote-frontend')
+        reply, output_msgs = self.execute_helper(code="c.send(data={'n': 2}, buffers=[bytes(range(256)) * 64])")
+        comm_msg = next(m for m in output_msgs if m['msg_type'] == 'comm_msg')
+        self.assertNotIn('buffer_handles', comm_msg['metadata'])
+        self.assertEqual(bytes(comm_msg['buffers'][0]), bytes(range(256)) * 64)
+
+    def test_comm_compressed_buffers(self):
+        code = textwrap.dedent(R"""
+        from comm import create_comm
+        received = []
+        c = create_comm(target_name='xpython.test', compression=['zstd', 'lz4'], compression_threshold=1024)
+        c.on_msg(lambda msg: received.append(bytes(msg['buffers'][0])))
+        print(c.comm_id, c.compression, end='')
+        """)
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+        comm_open = next(m for m in output_msgs if m['msg_type'] == 'comm_open')
+        comm_id = comm_open['content']['comm_id']
+        codecs = comm_open['metadata'].get('buffer_codecs', [])
+
+        # Frontend side implementations of the codecs
+        decoders = {}
+        encoders = {}
+        try:
+            import zstandard
+            decoders['zstd'] = lambda b: zstandard.ZstdDecompressor().decompress(b)
+            encoders['zstd'] = lambda b: zstandard.ZstdCompressor().compress(b)
+        except ImportError:
+            pass
+        try:
+            import lz4.frame
+            decoders['lz4'] = lz4.frame.decompress
+            encoders['lz4'] = lz4.frame.compress
+        except ImportError:
+            pass
+        accepted = [name for name in codecs if name in decoders]
+        if not accepted:
+            self.skipTest('no codec available in both the kernel and the test environment')
+        codec = accepted[0]
+
+        def send_comm_msg(metadata, buffers=None):
+            msg = self.kc.session.msg('comm_msg', {'comm_id': comm_id, 'data': {}}, metadata=metadata)
+            self.kc.session.send(self.kc.shell_channel.socket, msg, buffers=buffers)
+            outputs = []
+            while True:
+                status = self.kc.get_iopub_msg(timeout=10)
+                if status['parent_header'].get('msg_id') != msg['header']['msg_id']:
+                    continue
+                if status['msg_type'] == 'status' and status['content']['execution_state'] == 'idle':
+                    return outputs
+                outputs.append(status)
+
+        payload = bytes(range(256)) * 64
+        send_comm_msg({'buffer_codecs': [codec]})
+        reply, output_msgs = self.execute_helper(code="c.send(data={}, buffers=[bytes(range(256)) * 64, b'small'])")
+        self.assertEqual(reply['content']['status'], 'ok')
+        comm_msg = next(m for m in output_msgs if m['msg_type'] == 'comm_msg')
+        self.assertEqual(comm_msg['metadata']['buffer_encodings'], [codec, None])
+        self.assertEqual(decoders[codec](bytes(comm_msg['buffers'][0])), payload)
+        self.assertEqual(bytes(comm_msg['buffers'][1]), b'small')
+
+        # Inbound buffers are decoded before reaching the handler
+        send_comm_msg({'buffer_encodings': [codec]}, buffers=[encoders[codec](payload)])
+        reply, output_msgs = self.execute_helper(code="print(received[-1] == bytes(range(256)) * 64, end='')")
+        self.assertEqual(output_msgs[0]['content']['text'], 'True')
+
+        # A corrupted buffer is reported as a Python error, the handler is
+        # not called
+        outputs = send_comm_msg({'buffer_encodings': [codec]}, buffers=[b'corrupted'])
+        errors = [m['content']['text'] for m in outputs if m['msg_type'] == 'stream']
+        self.assertIn('ValueError', ''.join(errors))
+        reply, output_msgs = self.execute_helper(code="print(len(received), end='')")
+        self.assertEqual(output_msgs[0]['content']['text'], '1')
+
+        # Buffers are sent uncompressed once a peer that did not accept the
+        # codec talked on the comm
+        msg = self.kc.session.msg('comm_msg', {'comm_id': comm_id, 'data': {}})
+        msg['header']['session'] = 'other-frontend'
+        self.kc.shell_channel.send(msg)
+        reply, output_msgs = self.execute_helper(code="print(c.compression, end='')")
+        self.assertEqual(output_msgs[0]['content']['text'], 'None')
+
+    def test_comm_conflation(self):
+        code = textwrap.dedent(R"""
+        from comm import create_comm
+        c = create_comm(target_name='xpython.test', conflate=True)
+        for i in range(100):
+            c.send(data={'method': 'update', 'state': {'value': i, 'step': i % 2}})
+        c.send(data={'method': 'custom', 'content': {}})
+        """)
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        # The pending update is flushed before the custom message
+        comm_msgs = [m for m in output_msgs if m['msg_type'] == 'comm_msg']
+        self.assertEqual(len(comm_msgs), 2)
+        self.assertEqual(comm_msgs[0]['content']['data']['state'], {'value': 99, 'step': 1})
+        self.assertEqual(comm_msgs[1]['content']['data']['method'], 'custom')
+
+        reply, output_msgs = self.execute_helper(
+            code="s = c.conflation_stats; print(s['pending'], s['max_pending'], s['conflated'], s['sent'], end='')"
+        )
+        self.assertEqual(output_msgs[0]['content']['text'], '0 100 99 1')
+
+    def test_concurrent_threads(self):
+        # Exercises the state locked on free-threaded builds from several
+        # threads at once, it must also hold with the GIL.
+        code = textwrap.dedent(R"""
+        import threading
+        import traceback
+        import xpython_runtime
+        from comm import create_comm
+        from IPython.display import display
+
+        errors = []
+
+        def worker(n):
+            try:
+                c = create_comm(target_name='xpython.test', conflate=True)
+                for i in range(50):
+                    c.send(data={'method': 'update', 'state': {'value': i}})
+                    display({'text/plain': f'{n} {i}'}, raw=True)
+                    try:
+                        raise ValueError(i)
+                    except ValueError:
+                        traceback.format_exc()
+                    xpython_runtime.code_cache_info()
+                    xpython_runtime.handle_resolutions()
+                c.close()
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=worker, args=(n,)) for n in range(8)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        print(len(errors), end='')
+        """)
+        reply, output_msgs = self.execute_helper(code=code, timeout=60)
+        self.assertEqual(reply['content']['status'], 'ok')
+        stream = [m for m in output_msgs if m['msg_type'] == 'stream']
+        self.assertEqual(stream[-1]['content']['text'], '0')
+
+    def test_interrupt(self):
+        self.flush_channels()
+        msg_id = self.kc.execute("x = 1\nwhile True: pass")
+        time.sleep(1)
+        # Signal based interrupt
+        self.km.interrupt_kernel()
+
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['status'], 'error')
+        self.assertEqual(reply['content']['ename'], 'KeyboardInterrupt')
+
+        # Leftover messages of the interrupted cell
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if (msg['parent_header'].get('msg_id') == msg_id and msg['msg_type'] == 'status'
+                    and msg['content']['execution_state'] == 'idle'):
+                break
+
+        # The state of the kernel survives the interrupt
+        reply, output_msgs = self.execute_helper(code="print(x, end='')")
+        self.assertEqual(output_msgs[0]['content']['text'], '1')
+
+    def test_interrupt_await(self):
+        self.flush_channels()
+        msg_id = self.kc.execute("import asyncio\ny = 2\nawait asyncio.sleep(100)")
+        time.sleep(1)
+        # The cell awaits, its task is cancelled
+        self.km.interrupt_kernel()
+
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['status'], 'error')
+        self.assertIn(reply['content']['ename'], ('CancelledError', 'KeyboardInterrupt'))
+
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if (msg['parent_header'].get('msg_id') == msg_id and msg['msg_type'] == 'status'
+                    and msg['content']['execution_state'] == 'idle'):
+                break
+
+        # The loop of the kernel survives the interrupt
+        reply, output_msgs = self.execute_helper(code="print(y, end='')")
+        self.assertEqual(output_msgs[0]['content']['text'], '2')
+
+    def test_soft_restart(self):
+        self.flush_channels()
+        code = textwrap.dedent(R"""
+        import colorsys
+        import xpython_runtime
+        from comm import create_comm
+        restart_value = 42
+        c = create_comm(target_name='xpython.test')
+        xpython_runtime.soft_restart()
+        """)
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        code = textwrap.dedent(R"""
+        import sys
+        import xpython_runtime
+        info = xpython_runtime.soft_restart_info()
+        print('restart_value' in globals(), 'colorsys' in sys.modules, 'colorsys' in info['removed_modules'],
+              info['closed_comms'] >= 1, end='')
+        """)
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(output_msgs[0]['content']['text'], 'False False True True')
+
+
+# The deferred configuration is postponed for long enough that it only
+# happens on the first request that needs it.
+class XeusPythonLazyTests(unittest.TestCase):
+
+    def start(self, *arguments):
+        km, kc = start_new_kernel(kernel_name='xpython',
+                                  extra_arguments=['--lazy', '--lazy-delay', '3600', *arguments])
+        self.addCleanup(km.shutdown_kernel)
+        self.addCleanup(kc.stop_channels)
+        return kc
+
+    def execute(self, kc, code):
+        msg_id = kc.execute(code)
+        reply = kc.get_shell_msg(timeout=60)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['status'], 'ok')
+        text = ''
+        while True:
+            msg = kc.get_iopub_msg(timeout=30)
+            if msg['parent_header'].get('msg_id') != msg_id:
+                continue
+            if msg['msg_type'] == 'stream':
+                text += msg['content']['text']
+            elif msg['msg_type'] == 'status' and msg['content']['execution_state'] == 'idle':
+                return text
+
+    def test_kernel_info_before_ipython(self):
+        kc = self.start()
+        kc.kernel_info()
+        reply = kc.get_shell_msg(timeout=30)
+        self.assertEqual(reply['msg_type'], 'kernel_info_reply')
+        replied_at = reply['header']['date'].timestamp()
+
+        # The first execute initializes the shell before running the code
+        text = self.execute(kc, "import xpython_runtime\n"
+                                "info = xpython_runtime.startup_info()\n"
+                                "print(info['lazy'], info['ready_at'], get_ipython() is not None, end='')")
+        lazy, ready_at, has_shell = text.split()
+        self.assertEqual(lazy, 'True')
+        self.assertGreater(float(ready_at), replied_at)
+        self.assertEqual(has_shell, 'True')
+
+    def test_raw_imports_jedi_on_completion(self):
+        kc = self.start('--raw')
+        kc.kernel_info()
+        reply = kc.get_shell_msg(timeout=30)
+        self.assertEqual(reply['msg_type'], 'kernel_info_reply')
+
+        self.assertEqual(self.execute(kc, "import sys\nprint('jedi' in sys.modules, end='')"), 'False')
+        kc.complete('pri', 3)
+        reply = kc.get_shell_msg(timeout=60)
+        self.assertIn('print', reply['content']['matches'])
+        self.assertEqual(self.execute(kc, "print('jedi' in sys.modules, end='')"), 'True')
 
 if __name__ == '__main__':
     unittest.main()
@@ -8,6 +8,12 @@
 # The full license is in the file LICENSE, distributed with this software.  #
 #############################################################################
 
+import json
+import os
+import subprocess
+import tempfile
+import textwrap
+import time
 import unittest
 import jupyter_kernel_test
 
@@ -74,6 +80,310 @@ class XeusPythonRawTests(jupyter_kernel_test.KernelTests):
             traceback[2]
         )
 
+    def test_xeus_python_code_cache(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="import xpython_runtime; before = xpython_runtime.code_cache_info()"
+        )
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        # The cached interactive expression still triggers the display hook
+        for _ in range(2):
+            reply, output_msgs = self.execute_helper(code="a = 20\na * 2 + 2")
+            self.assertEqual(output_msgs[0]['msg_type'], 'execute_result')
+            self.assertEqual(output_msgs[0]['content']['data']['text/plain'], '42')
+
+        reply, output_msgs = self.execute_helper(
+            code="after = xpython_runtime.code_cache_info(); print(after['hits'] - before['hits'], end='')"
+        )
+        self.assertEqual(output_msgs[0]['content']['text'], '1')
+
+    def test_xeus_python_execution_timing(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="import xpython_runtime; xpython_runtime.reset_execution_timing(); xpython_runtime.set_execution_timing(True)"
+        )
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        reply, output_msgs = self.execute_helper(code="a = 20\na * 2 + 2")
+        timing = reply['content']['execution_timing']
+        for phase in ('input_setup', 'compile', 'user_code', 'display_hook', 'finalize'):
+            self.assertGreaterEqual(timing[phase], 0)
+        # The reply is timed after it has been sent
+        self.assertNotIn('reply', timing)
+
+        reply, output_msgs = self.execute_helper(
+            code="xpython_runtime.set_execution_timing(False); h = xpython_runtime.execution_timing_histograms(); print(h['reply']['count'], sum(h['user_code']['buckets']), end='')"
+        )
+        self.assertNotIn('execution_timing', reply['content'])
+        self.assertEqual(output_msgs[0]['content']['text'], '2 2')
+
+        # Disabled timings leave the histograms untouched
+        reply, output_msgs = self.execute_helper(
+            code="h = xpython_runtime.execution_timing_histograms(); print(h['reply']['count'], sum(h['user_code']['buckets']), end='')"
+        )
+        self.assertEqual(output_msgs[0]['content']['text'], '2 2')
+
+    def test_xeus_python_memory_accounting(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="import xpython_runtime; xpython_runtime.clear_memory_history(); xpython_runtime.set_memory_accounting(True, top_allocations=3)"
+        )
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        reply, output_msgs = self.execute_helper(code="data = [bytes(1000) for i in range(10000)]")
+        memory = reply['content']['memory']
+        self.assertGreater(memory['allocated_blocks'], 0)
+        self.assertTrue(memory['top_allocations'])
+
+        reply, output_msgs = self.execute_helper(
+            code="xpython_runtime.set_memory_accounting(False); print(len(xpython_runtime.memory_history()), end='')"
+        )
+        self.assertEqual(output_msgs[0]['content']['text'], '1')
+
+        reply, output_msgs = self.execute_helper(code="a = 1")
+        self.assertNotIn('memory', reply['content'])
+
+        # A tracing started by the user is not stopped with the accounting
+        reply, output_msgs = self.execute_helper(code=(
+            "import tracemalloc; tracemalloc.start(); xpython_runtime.set_memory_accounting(True, top_allocations=3); "
+            "xpython_runtime.set_memory_accounting(False); print(tracemalloc.is_tracing(), end=''); tracemalloc.stop()"
+        ))
+        self.assertEqual(output_msgs[0]['content']['text'], 'True')
+
+    def test_xeus_python_gc_tuning(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="import gc, xpython_runtime; xpython_runtime.set_gc_tuning(True, freeze_blocks=10000)"
+        )
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        reply, output_msgs = self.execute_helper(code="data = [[i] for i in range(100000)]; gc.collect()")
+        self.assertGreaterEqual(reply['content']['gc']['collections'][2], 1)
+
+        reply, output_msgs = self.execute_helper(
+            code="info = xpython_runtime.gc_info(); print(info['freezes'] > 0, gc.get_freeze_count() > 0, end='')"
+        )
+        self.assertEqual(output_msgs[0]['content']['text'], 'True True')
+
+        reply, output_msgs = self.execute_helper(
+            code="xpython_runtime.set_gc_tuning(False); print(gc.get_freeze_count(), end='')"
+        )
+        self.assertEqual(output_msgs[0]['content']['text'], '0')
+
+    def test_xeus_python_subshell(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="import threading, xpython_runtime; event = threading.Event(); sid = xpython_runtime.create_subshell(); print(sid, end='')"
+        )
+        subshell_id = output_msgs[0]['content']['text']
+
+        # The cell of the subshell waits for the main shell
+        msg = self.kc.session.msg('execute_request', {
+            'code': "print('started', flush=True); shared = event.wait(10)",
+            'silent': False, 'store_history': False, 'user_expressions': {}, 'allow_stdin': False
+        })
+        msg['header']['subshell_id'] = subshell_id
+        self.kc.shell_channel.send(msg)
+        while True:
+            output = self.kc.get_iopub_msg(timeout=10)
+            if output['parent_header'].get('msg_id') == msg['header']['msg_id'] and output['msg_type'] == 'stream':
+                break
+
+        # The main shell answers while the subshell runs, soft restarts are
+        # refused meanwhile
+        msg_id = self.kc.execute(textwrap.dedent("""\
+            try:
+                xpython_runtime.soft_restart()
+                refused = False
+            except RuntimeError:
+                refused = True
+            event.set()
+        """))
+        replies = {}
+        for _ in range(2):
+            reply = self.kc.get_shell_msg(timeout=10)
+            replies[reply['parent_header']['msg_id']] = reply['content']['status']
+        self.assertEqual(replies, {msg_id: 'ok', msg['header']['msg_id']: 'ok'})
+
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(
+            code="print(shared, refused, xpython_runtime.delete_subshell(sid), xpython_runtime.list_subshells(), end='')"
+        )
+        self.assertEqual(output_msgs[0]['content']['text'], 'True True True []')
+
+    def test_xeus_python_completion_while_busy(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="import os\nvalue = 42")
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        msg_id = self.kc.execute("import time; time.sleep(3)")
+        time.sleep(0.5)
+
+        # Requests received on the control thread while the cell runs are
+        # answered from the snapshot of the namespace
+        for code in ('os.pa', 'val'):
+            msg = self.kc.session.msg('complete_request', {'code': code, 'cursor_pos': len(code)})
+            self.kc.control_channel.send(msg)
+            reply = self.kc.control_channel.get_msg(timeout=2)
+            self.assertEqual(reply['parent_header']['msg_id'], msg['header']['msg_id'])
+            self.assertTrue(reply['content']['metadata']['approximate'])
+            self.assertTrue(reply['content']['matches'])
+
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        # Once idle, the live namespace is used again
+        self.kc.complete('val')
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertIn('value', reply['content']['matches'])
+        self.assertNotIn('approximate', reply['content']['metadata'])
+
+    def test_xeus_python_interrupt(self):
+        self.flush_channels()
+        msg_id = self.kc.execute("x = 1\nwhile True: pass")
+        time.sleep(1)
+        # Message based interrupt, handled by the control thread
+        msg = self.kc.session.msg('interrupt_request', {})
+        self.kc.control_channel.send(msg)
+        reply = self.kc.control_channel.get_msg(timeout=10)
+        self.assertEqual(reply['msg_type'], 'interrupt_reply')
+
+        reply = self.kc.get_shell_msg(timeout=10)
+        self.assertEqual(reply['parent_header']['msg_id'], msg_id)
+        self.assertEqual(reply['content']['status'], 'error')
+        self.assertEqual(reply['content']['ename'], 'KeyboardInterrupt')
+
+        # Leftover messages of the interrupted cell
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if (msg['parent_header'].get('msg_id') == msg_id and msg['msg_type'] == 'status'
+                    and msg['content']['execution_state'] == 'idle'):
+                break
+
+        # The state of the kernel survives the interrupt
+        reply, output_msgs = self.execute_helper(code="print(x, end='')")
+        self.assertEqual(output_msgs[0]['content']['text'], '1')
+
+    def test_xeus_python_checkpoint(self):
+        self.flush_channels()
+        code = textwrap.dedent("""\
+            import os, tempfile, xpython_runtime
+            path = os.path.join(tempfile.mkdtemp(), 'ns.ckpt')
+            data = bytearray(b'x' * 100000)
+            numbers = [1, 2, 3]
+            alias = numbers
+            gen = (i for i in range(3))
+            report = xpython_runtime.checkpoint(path)
+            del data, numbers, alias
+            restored = xpython_runtime.restore(path)
+            print(len(data), numbers, alias is numbers, 'gen' in report['skipped'], 'data' in restored['restored'],
+                  oct(os.stat(path).st_mode & 0o777), end='')
+        """)
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+        self.assertEqual(output_msgs[0]['content']['text'], '100000 [1, 2, 3] True True True 0o600')
+
+        # Idle hibernation, the namespace is restored by the next execution.
+        # The timer restarts after each request, the polls are spaced by
+        # more than the timeout.
+        reply, output_msgs = self.execute_helper(
+            code="value = list(range(10)); xpython_runtime.set_idle_hibernation(0.2)"
+        )
+        self.assertEqual(reply['content']['status'], 'ok')
+        deadline = time.time() + 10
+        hibernated = False
+        while not hibernated and time.time() < deadline:
+            time.sleep(0.5)
+            reply, output_msgs = self.execute_helper(
+                code="print('value' in xpython_runtime.hibernation_info()['last_checkpoint'].get('saved', []), end='')"
+            )
+            hibernated = output_msgs[0]['content']['text'] == 'True'
+        self.assertTrue(hibernated)
+        reply, output_msgs = self.execute_helper(
+            code="info = xpython_runtime.hibernation_info(); print(sum(value), oct(os.stat(os.path.dirname(info['path'])).st_mode & 0o777), end='')"
+        )
+        self.assertEqual(output_msgs[0]['content']['text'], '45 0o700')
+        self.execute_helper(code="xpython_runtime.set_idle_hibernation(0)")
+
+
+class XeusPythonRunNotebookTests(unittest.TestCase):
+
+    def run_notebook(self, sources, *arguments):
+        cells = [
+            {'cell_type': 'code', 'execution_count': None, 'id': f'cell-{i}',
+             'metadata': {'tags': tags}, 'outputs': [], 'source': source}
+            for i, (source, tags) in enumerate(sources)
+        ]
+        notebook = {'cells': cells, 'metadata': {}, 'nbformat': 4, 'nbformat_minor': 5}
+        with tempfile.TemporaryDirectory() as tmp:
+            input_path = os.path.join(tmp, 'in.ipynb')
+            output_path = os.path.join(tmp, 'out.ipynb')
+            with open(input_path, 'w') as f:
+                json.dump(notebook, f)
+            process = subprocess.run(
+                ['xpython', '--raw', '--run-notebook', input_path, '--output', output_path, *arguments],
+                stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=120
+            )
+            with open(output_path) as f:
+                return process.returncode, json.load(f)['cells']
+
+    def test_parameters_and_outputs(self):
+        status, cells = self.run_notebook(
+            [("n = 1\nname = 'default'", ['parameters']), ("print(name * n)\nprint('end')", [])],
+            '-p', 'n', '2', '-p', 'name', 'ab'
+        )
+        self.assertEqual(status, 0)
+        self.assertEqual(cells[1]['metadata']['tags'], ['injected-parameters'])
+        self.assertEqual(cells[2]['outputs'], [{'output_type': 'stream', 'name': 'stdout', 'text': 'abab\nend\n'}])
+
+    def test_stop_on_error(self):
+        sources = [("raise ValueError('failed')", []), ("print('after')", [])]
+        status, cells = self.run_notebook(sources)
+        self.assertEqual(status, 1)
+        self.assertEqual(cells[0]['outputs'][0]['ename'], 'ValueError')
+        self.assertEqual(cells[1]['outputs'], [])
+
+        status, cells = self.run_notebook(sources, '--allow-errors')
+        self.assertEqual(status, 0)
+        self.assertEqual(cells[1]['outputs'][0]['text'], 'after\n')
+
+    def test_default_output(self):
+        cell = {'cell_type': 'code', 'execution_count': None, 'id': 'cell-0',
+                'metadata': {}, 'outputs': [], 'source': "raise ValueError('failed')"}
+        notebook = {'cells': [cell], 'metadata': {}, 'nbformat': 4, 'nbformat_minor': 5}
+        with tempfile.TemporaryDirectory() as tmp:
+            input_path = os.path.join(tmp, 'in.ipynb')
+            with open(input_path, 'w') as f:
+                json.dump(notebook, f)
+            process = subprocess.run(['xpython', '--raw', '--run-notebook', input_path],
+                                     stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=120)
+            self.assertEqual(process.returncode, 1)
+            with open(input_path) as f:
+                self.assertEqual(json.load(f), notebook)
+            with open(os.path.join(tmp, 'in.out.ipynb')) as f:
+                self.assertEqual(json.load(f)['cells'][0]['outputs'][0]['ename'], 'ValueError')
+
+    def test_unreadable_source(self):
+        cell = {'cell_type': 'code', 'execution_count': None, 'id': 'cell-0',
+                'metadata': {}, 'outputs': [], 'source': ["print(1)\n", 2]}
+        notebook = {'cells': [cell], 'metadata': {}, 'nbformat': 4, 'nbformat_minor': 5}
+        with tempfile.TemporaryDirectory() as tmp:
+            input_path = os.path.join(tmp, 'in.ipynb')
+            with open(input_path, 'w') as f:
+                json.dump(notebook, f)
+            process = subprocess.run(['xpython', '--raw', '--run-notebook', input_path],
+                                     stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=120)
+            self.assertEqual(process.returncode, 2)
+            self.assertFalse(os.path.exists(os.path.join(tmp, 'in.out.ipynb')))
+
+    def test_comms_raise(self):
+        sources = [("from comm import create_comm\ncreate_comm(target_name='xpython.test')", [])]
+        status, cells = self.run_notebook(sources)
+        self.assertEqual(status, 1)
+        self.assertEqual(cells[0]['outputs'][0]['ename'], 'RuntimeError')
+
 
 if __name__ == '__main__':
     unittest.main()